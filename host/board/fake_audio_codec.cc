@@ -0,0 +1,222 @@
+#include "fake_audio_codec.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <thread>
+#include <chrono>
+#include <cstring>
+
+#define TAG "FakeAudioCodec"
+
+struct WavHeader {
+    char riff[4];
+    uint32_t riff_size;
+    char wave[4];
+    char fmt[4];
+    uint32_t fmt_size;
+    uint16_t format;
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+    char data[4];
+    uint32_t data_size;
+} __attribute__((packed));
+
+// The WAV header is rewritten after this many new samples, so a killed process leaves a readable file
+#define OUTPUT_HEADER_INTERVAL_SAMPLES 16000
+
+static void SleepUntil(int64_t time_us) {
+    int64_t now = esp_timer_get_time();
+    if (time_us > now) {
+        std::this_thread::sleep_for(std::chrono::microseconds(time_us - now));
+    }
+}
+
+FakeAudioCodec::FakeAudioCodec(int input_sample_rate, int output_sample_rate, const std::string& input_path,
+    const std::string& output_path, bool loop_input) : loop_input_(loop_input) {
+    duplex_ = true;
+    input_reference_ = false;
+    input_channels_ = 1;
+    output_channels_ = 1;
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+
+    if (!input_path.empty() && !LoadInput(input_path)) {
+        ESP_LOGE(TAG, "Failed to load %s, the microphone is silent", input_path.c_str());
+    }
+    if (!output_path.empty()) {
+        output_file_ = fopen(output_path.c_str(), "wb");
+        if (output_file_ == nullptr) {
+            ESP_LOGE(TAG, "Failed to open %s", output_path.c_str());
+        } else {
+            WriteHeader();
+        }
+    }
+}
+
+FakeAudioCodec::~FakeAudioCodec() {
+    Finish();
+    if (output_file_ != nullptr) {
+        fclose(output_file_);
+    }
+}
+
+// 16 bit PCM of any rate and channel count, mixed down to mono and resampled to the input rate
+bool FakeAudioCodec::LoadInput(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    WavHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.riff, "RIFF", 4) == 0
+        && memcmp(header.wave, "WAVE", 4) == 0 && header.format == 1 && header.bits_per_sample == 16 && header.channels > 0;
+    if (!ok) {
+        ESP_LOGE(TAG, "%s is not a 16 bit PCM WAV file", path.c_str());
+        fclose(file);
+        return false;
+    }
+    // Skip chunks between fmt and data
+    fseek(file, 20 + header.fmt_size, SEEK_SET);
+    char chunk_id[4];
+    uint32_t chunk_size = 0;
+    while (fread(chunk_id, 4, 1, file) == 1 && fread(&chunk_size, 4, 1, file) == 1 && memcmp(chunk_id, "data", 4) != 0) {
+        fseek(file, chunk_size, SEEK_CUR);
+    }
+    std::vector<int16_t> pcm(chunk_size / sizeof(int16_t));
+    pcm.resize(fread(pcm.data(), sizeof(int16_t), pcm.size(), file));
+    fclose(file);
+
+    size_t frames = pcm.size() / header.channels;
+    std::vector<int16_t> mono(frames);
+    for (size_t i = 0; i < frames; i++) {
+        int sum = 0;
+        for (int c = 0; c < header.channels; c++) {
+            sum += pcm[i * header.channels + c];
+        }
+        mono[i] = sum / header.channels;
+    }
+    if ((int)header.sample_rate != input_sample_rate_) {
+        AudioResampler resampler;
+        resampler.Configure(header.sample_rate, input_sample_rate_);
+        input_pcm_.resize(resampler.GetOutputSamples(mono.size()));
+        resampler.Process(mono.data(), mono.size(), input_pcm_.data());
+    } else {
+        input_pcm_ = std::move(mono);
+    }
+    ESP_LOGI(TAG, "Microphone input: %s, %u ms%s", path.c_str(),
+        (unsigned)(input_pcm_.size() * 1000 / input_sample_rate_), loop_input_ ? ", looped" : "");
+    return true;
+}
+
+int FakeAudioCodec::Read(int16_t* dest, int samples) {
+    // The clock starts with the first read, a frame is returned once its last sample has been captured
+    if (input_start_us_ < 0) {
+        input_start_us_ = esp_timer_get_time();
+    }
+    input_position_ += samples;
+    SleepUntil(input_start_us_ + input_position_ * 1000000 / input_sample_rate_);
+
+    for (int i = 0; i < samples; i++) {
+        if (input_offset_ >= input_pcm_.size() && loop_input_ && !input_pcm_.empty()) {
+            input_offset_ = 0;
+        }
+        dest[i] = input_offset_ < input_pcm_.size() ? input_pcm_[input_offset_++] : 0;
+    }
+    return samples;
+}
+
+// Requires output_mutex_
+int64_t FakeAudioCodec::PendingEndUs() const {
+    return pending_start_us_ + (int64_t)pending_.size() * 1000000 / output_sample_rate_;
+}
+
+// Moves the samples played by now from the ring to the file. Requires output_mutex_
+void FakeAudioCodec::CommitPlayed(int64_t now_us) {
+    if (pending_start_us_ < 0) {
+        return;
+    }
+    size_t played = std::min<int64_t>((now_us - pending_start_us_) * output_sample_rate_ / 1000000, pending_.size());
+    if (played == 0) {
+        return;
+    }
+    std::vector<int16_t> chunk(pending_.begin(), pending_.begin() + played);
+    pending_.erase(pending_.begin(), pending_.begin() + played);
+    pending_start_us_ += (int64_t)played * 1000000 / output_sample_rate_;
+    WriteOutput(chunk.data(), chunk.size());
+}
+
+int FakeAudioCodec::Write(const int16_t* data, int samples) {
+    const int64_t ring_us = (int64_t)AUDIO_CODEC_DMA_DESC_NUM * AUDIO_CODEC_DMA_FRAME_NUM * 1000000 / output_sample_rate_;
+    const int64_t data_us = (int64_t)samples * 1000000 / output_sample_rate_;
+    int64_t wait_until;
+    {
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        int64_t now = esp_timer_get_time();
+        CommitPlayed(now);
+        if (pending_start_us_ < 0 || pending_.empty()) {
+            // The ring ran empty and played silence since the last sample
+            if (pending_start_us_ >= 0 && now > pending_start_us_) {
+                std::vector<int16_t> silence((now - pending_start_us_) * output_sample_rate_ / 1000000);
+                WriteOutput(silence.data(), silence.size());
+            }
+            pending_start_us_ = now;
+        }
+        wait_until = PendingEndUs() + data_us - ring_us;
+    }
+    // Blocks like i2s_channel_write until the data fits into the ring
+    SleepUntil(wait_until);
+
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    CommitPlayed(esp_timer_get_time());
+    pending_.insert(pending_.end(), data, data + samples);
+    return samples;
+}
+
+void FakeAudioCodec::Finish() {
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    CommitPlayed(esp_timer_get_time());
+    if (output_file_ != nullptr) {
+        WriteHeader();
+        fflush(output_file_);
+    }
+}
+
+// Requires output_mutex_
+void FakeAudioCodec::WriteOutput(const int16_t* data, size_t samples) {
+    if (output_file_ == nullptr || samples == 0) {
+        return;
+    }
+    fwrite(data, sizeof(int16_t), samples, output_file_);
+    output_samples_ += samples;
+    if (output_samples_ - header_samples_ >= OUTPUT_HEADER_INTERVAL_SAMPLES) {
+        WriteHeader();
+    }
+}
+
+// Requires output_mutex_
+void FakeAudioCodec::WriteHeader() {
+    WavHeader header;
+    memcpy(header.riff, "RIFF", 4);
+    header.riff_size = 36 + output_samples_ * sizeof(int16_t);
+    memcpy(header.wave, "WAVE", 4);
+    memcpy(header.fmt, "fmt ", 4);
+    header.fmt_size = 16;
+    header.format = 1;
+    header.channels = 1;
+    header.sample_rate = output_sample_rate_;
+    header.byte_rate = output_sample_rate_ * sizeof(int16_t);
+    header.block_align = sizeof(int16_t);
+    header.bits_per_sample = 16;
+    memcpy(header.data, "data", 4);
+    header.data_size = output_samples_ * sizeof(int16_t);
+    long position = ftell(output_file_);
+    fseek(output_file_, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, output_file_);
+    if (position > (long)sizeof(header)) {
+        fseek(output_file_, position, SEEK_SET);
+    }
+    header_samples_ = output_samples_;
+}
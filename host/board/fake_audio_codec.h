@@ -0,0 +1,51 @@
+#ifndef _FAKE_AUDIO_CODEC_H
+#define _FAKE_AUDIO_CODEC_H
+
+#include "audio_codec.h"
+
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A codec backed by WAV files and paced by the clock like the I2S DMA: Read returns a frame once it has been
+// "captured", Write blocks while the output ring is full, and the speaker file gets the samples as they are
+// "played", with silence where nothing was written.
+// The speaker file has the level of the decoded audio, the volume is not applied.
+class FakeAudioCodec : public AudioCodec {
+public:
+    // An empty input path is silence, an empty output path discards the output
+    FakeAudioCodec(int input_sample_rate, int output_sample_rate, const std::string& input_path,
+        const std::string& output_path, bool loop_input);
+    virtual ~FakeAudioCodec();
+
+    // Writes the samples played so far and completes the WAV header, called before the process exits
+    void Finish();
+
+private:
+    std::vector<int16_t> input_pcm_;
+    bool loop_input_;
+    size_t input_offset_ = 0;
+    int64_t input_start_us_ = -1;
+    int64_t input_position_ = 0;
+
+    std::mutex output_mutex_;
+    FILE* output_file_ = nullptr;
+    uint32_t output_samples_ = 0;
+    uint32_t header_samples_ = 0;
+    // Samples in the ring, the first one starts playing at pending_start_us_
+    std::deque<int16_t> pending_;
+    int64_t pending_start_us_ = -1;
+
+    virtual int Read(int16_t* dest, int samples) override;
+    virtual int Write(const int16_t* data, int samples) override;
+
+    bool LoadInput(const std::string& path);
+    int64_t PendingEndUs() const;
+    void CommitPlayed(int64_t now_us);
+    void WriteOutput(const int16_t* data, size_t samples);
+    void WriteHeader();
+};
+
+#endif // _FAKE_AUDIO_CODEC_H
@@ -0,0 +1,122 @@
+#include "fake_board.h"
+#include "fake_audio_codec.h"
+#include "loopback_web_socket.h"
+#include "iot/thing_manager.h"
+
+#include <esp_log.h>
+#include <esp_app_desc.h>
+#include <font_awesome_symbols.h>
+
+#include <cstring>
+#include <algorithm>
+
+#define TAG "FakeBoard"
+
+// Answers the version check with the running version, so there is no upgrade, and the configured chat server
+class FakeHttp : public Http {
+public:
+    virtual void SetHeader(const std::string& key, const std::string& value) override {}
+
+    virtual bool Open(const std::string& method, const std::string& url, const std::string& content) override {
+        auto& config = FakeBoard::config();
+        body_ = "{\"firmware\":{\"version\":\"" + std::string(esp_app_get_description()->version) + "\",\"url\":\"\"},";
+        body_ += "\"websocket\":{\"url\":\"" + config.server_url + "\",\"token\":\"" + config.token + "\"}}";
+        read_offset_ = 0;
+        ESP_LOGI(TAG, "%s %s", method.c_str(), url.c_str());
+        return true;
+    }
+
+    virtual void Close() override {}
+    virtual int GetStatusCode() const override { return 200; }
+    virtual std::string GetResponseHeader(const std::string& key) const override { return ""; }
+    virtual size_t GetBodyLength() const override { return body_.size(); }
+    virtual const std::string& GetBody() override { return body_; }
+
+    virtual int Read(char* buffer, size_t buffer_size) override {
+        size_t size = std::min(buffer_size, body_.size() - read_offset_);
+        memcpy(buffer, body_.data() + read_offset_, size);
+        read_offset_ += size;
+        return size;
+    }
+
+private:
+    std::string body_;
+    size_t read_offset_ = 0;
+};
+
+class FakeMqtt : public Mqtt {
+public:
+    virtual bool Connect(const std::string broker_address, int broker_port, const std::string client_id,
+        const std::string username, const std::string password) override {
+        ESP_LOGE(TAG, "MQTT is not available on the host");
+        return false;
+    }
+    virtual void Disconnect() override {}
+    virtual bool Publish(const std::string topic, const std::string payload, int qos) override { return false; }
+    virtual bool Subscribe(const std::string topic, int qos) override { return false; }
+    virtual bool Unsubscribe(const std::string topic) override { return false; }
+    virtual bool IsConnected() override { return false; }
+};
+
+class FakeUdp : public Udp {
+public:
+    virtual bool Connect(const std::string& host, int port) override {
+        ESP_LOGE(TAG, "UDP is not available on the host");
+        return false;
+    }
+    virtual void Disconnect() override {}
+    virtual int Send(const std::string& data) override { return -1; }
+};
+
+FakeBoard::FakeBoard() {
+    auto& thing_manager = iot::ThingManager::GetInstance();
+    thing_manager.AddThing(iot::CreateThing("Speaker"));
+}
+
+std::string FakeBoard::GetBoardType() {
+    return "host";
+}
+
+std::string FakeBoard::GetBoardJson() {
+    return "{\"type\":\"" BOARD_TYPE "\",\"name\":\"" BOARD_NAME "\"}";
+}
+
+AudioCodec* FakeBoard::GetAudioCodec() {
+    auto& config = FakeBoard::config();
+    static FakeAudioCodec audio_codec(config.input_sample_rate, config.output_sample_rate,
+        config.input_path, config.output_path, config.loop_input);
+    return &audio_codec;
+}
+
+Http* FakeBoard::CreateHttp() {
+    return new FakeHttp();
+}
+
+WebSocket* FakeBoard::CreateWebSocket() {
+    auto& config = FakeBoard::config();
+    if (config.server_url.rfind("loopback:", 0) == 0) {
+        return new LoopbackWebSocket(config.loopback_sample_rate, config.loopback_turn_ms);
+    }
+    return new WebSocket();
+}
+
+Mqtt* FakeBoard::CreateMqtt() {
+    return new FakeMqtt();
+}
+
+Udp* FakeBoard::CreateUdp() {
+    return new FakeUdp();
+}
+
+void FakeBoard::StartNetwork() {
+    ESP_LOGI(TAG, "Network ready, chat server %s", config().server_url.c_str());
+}
+
+const char* FakeBoard::GetNetworkStateIcon() {
+    return FONT_AWESOME_WIFI;
+}
+
+void FakeBoard::SetPowerSaveMode(bool enabled) {
+}
+
+DECLARE_BOARD(FakeBoard);
@@ -0,0 +1,47 @@
+#ifndef _FAKE_BOARD_H
+#define _FAKE_BOARD_H
+
+#include "board.h"
+
+#include <string>
+
+// The board of the host build: a FakeAudioCodec, a canned OTA response pointing at the chat server, a real
+// ws:// client or the loopback server, and MQTT/UDP stand-ins that fail to connect (the OTA response never
+// selects MQTT). Configure before the first Board::GetInstance()
+struct FakeBoardConfig {
+    int input_sample_rate = 16000;
+    int output_sample_rate = 24000;
+    std::string input_path;
+    std::string output_path;
+    bool loop_input = false;
+    // ws://host:port/path or loopback://
+    std::string server_url = "loopback://";
+    std::string token = "test-token";
+    // Loopback server: downlink sample rate, and the audio of a turn when the server detects the end of speech
+    int loopback_sample_rate = 24000;
+    int loopback_turn_ms = 3000;
+};
+
+class FakeBoard : public Board {
+public:
+    static FakeBoardConfig& config() {
+        static FakeBoardConfig config;
+        return config;
+    }
+
+    FakeBoard();
+    virtual std::string GetBoardType() override;
+    virtual AudioCodec* GetAudioCodec() override;
+    virtual Http* CreateHttp() override;
+    virtual WebSocket* CreateWebSocket() override;
+    virtual Mqtt* CreateMqtt() override;
+    virtual Udp* CreateUdp() override;
+    virtual void StartNetwork() override;
+    virtual const char* GetNetworkStateIcon() override;
+    virtual void SetPowerSaveMode(bool enabled) override;
+
+private:
+    virtual std::string GetBoardJson() override;
+};
+
+#endif // _FAKE_BOARD_H
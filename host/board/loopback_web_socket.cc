@@ -0,0 +1,187 @@
+#include "loopback_web_socket.h"
+
+#include <esp_log.h>
+#include <cJSON.h>
+
+#include <chrono>
+#include <cstring>
+
+#define TAG "Loopback"
+
+LoopbackWebSocket::LoopbackWebSocket(int sample_rate, int turn_ms) : sample_rate_(sample_rate), turn_ms_(turn_ms) {
+}
+
+LoopbackWebSocket::~LoopbackWebSocket() {
+    bool was_connected;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        was_connected = connected_;
+        connected_ = false;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    // Like the socket client, closing the channel reports the disconnection
+    if (was_connected && on_disconnected_) {
+        on_disconnected_();
+    }
+}
+
+bool LoopbackWebSocket::Connect(const char* uri) {
+    ESP_LOGI(TAG, "Connected to the loopback server, %d Hz downlink", sample_rate_);
+    connected_ = true;
+    thread_ = std::thread([this]() {
+        ServerLoop();
+    });
+    if (on_connected_) {
+        on_connected_();
+    }
+    return true;
+}
+
+bool LoopbackWebSocket::Send(const std::string& data) {
+    return Send(data.data(), data.size(), false, true);
+}
+
+bool LoopbackWebSocket::Send(const void* data, size_t len, bool binary, bool fin) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!connected_) {
+        return false;
+    }
+    std::string message((const char*)data, len);
+    // An abort has to reach the speaking server at once, it's not queued behind the turn being spoken
+    if (!binary && message.find("\"type\":\"abort\"") != std::string::npos) {
+        aborted_ = true;
+    }
+    requests_.emplace_back(binary, std::move(message));
+    cv_.notify_all();
+    return true;
+}
+
+bool LoopbackWebSocket::IsConnected() const {
+    return connected_;
+}
+
+void LoopbackWebSocket::ServerLoop() {
+    while (true) {
+        std::pair<bool, std::string> request;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return !connected_ || !requests_.empty(); });
+            if (!connected_) {
+                return;
+            }
+            request = std::move(requests_.front());
+            requests_.pop_front();
+        }
+        if (request.first) {
+            HandleAudio(request.second);
+        } else {
+            HandleText(request.second);
+        }
+    }
+}
+
+void LoopbackWebSocket::HandleText(const std::string& text) {
+    auto root = cJSON_Parse(text.c_str());
+    if (root == nullptr) {
+        ESP_LOGE(TAG, "Invalid JSON: %s", text.c_str());
+        return;
+    }
+    auto type = cJSON_GetObjectItem(root, "type");
+    auto state = cJSON_GetObjectItem(root, "state");
+    if (!cJSON_IsString(type)) {
+        ESP_LOGE(TAG, "Missing message type: %s", text.c_str());
+    } else if (strcmp(type->valuestring, "hello") == 0) {
+        // The downlink is the uplink played back, so it has the frame duration of the uplink
+        auto audio_params = cJSON_GetObjectItem(root, "audio_params");
+        auto frame_duration = cJSON_GetObjectItem(audio_params, "frame_duration");
+        if (frame_duration != nullptr) {
+            frame_duration_ = frame_duration->valueint;
+        }
+        auto packing = cJSON_GetObjectItem(audio_params, "packing");
+        packing_ = cJSON_IsString(packing) && strcmp(packing->valuestring, "length_prefixed") == 0;
+        std::string reply = "{\"type\":\"hello\",\"transport\":\"websocket\",\"session_id\":\"loopback\",";
+        reply += "\"audio_params\":{\"format\":\"opus\",\"sample_rate\":" + std::to_string(sample_rate_);
+        reply += ",\"channels\":1,\"frame_duration\":" + std::to_string(frame_duration_);
+        if (packing_) {
+            reply += ",\"packing\":\"length_prefixed\"";
+        }
+        reply += "}}";
+        Reply(reply);
+    } else if (strcmp(type->valuestring, "listen") == 0 && cJSON_IsString(state)) {
+        if (strcmp(state->valuestring, "start") == 0) {
+            auto mode = cJSON_GetObjectItem(root, "mode");
+            auto_stop_ = !cJSON_IsString(mode) || strcmp(mode->valuestring, "manual") != 0;
+            listening_ = true;
+            turn_.clear();
+        } else if (strcmp(state->valuestring, "stop") == 0 && listening_) {
+            listening_ = false;
+            Speak();
+        }
+    } else if (strcmp(type->valuestring, "metrics") == 0) {
+        ESP_LOGI(TAG, "Client metrics: %s", text.c_str());
+    }
+    cJSON_Delete(root);
+}
+
+void LoopbackWebSocket::HandleAudio(const std::string& data) {
+    if (!listening_) {
+        return;
+    }
+    if (!packing_) {
+        turn_.push_back(data);
+    } else {
+        // Frames prefixed with their size, 16 bits big endian
+        size_t offset = 0;
+        while (offset + 2 <= data.size()) {
+            size_t size = ((uint8_t)data[offset] << 8) | (uint8_t)data[offset + 1];
+            if (offset + 2 + size > data.size()) {
+                ESP_LOGE(TAG, "Truncated packed frame");
+                break;
+            }
+            turn_.push_back(data.substr(offset + 2, size));
+            offset += 2 + size;
+        }
+    }
+    if (auto_stop_ && (int)turn_.size() * frame_duration_ >= turn_ms_) {
+        listening_ = false;
+        Speak();
+    }
+}
+
+// Plays the turn back at the frame rate, stops early on abort
+void LoopbackWebSocket::Speak() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        aborted_ = false;
+    }
+    int duration_ms = turn_.size() * frame_duration_;
+    Reply("{\"type\":\"stt\",\"text\":\"" + std::to_string(turn_.size()) + " frames\"}");
+    Reply("{\"type\":\"llm\",\"emotion\":\"happy\",\"text\":\"\"}");
+    Reply("{\"type\":\"tts\",\"state\":\"start\",\"sample_rate\":" + std::to_string(sample_rate_) + "}");
+    Reply("{\"type\":\"tts\",\"state\":\"sentence_start\",\"text\":\"Echo of " + std::to_string(duration_ms) + " ms\"}");
+
+    auto next_frame = std::chrono::steady_clock::now();
+    for (const auto& frame : turn_) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (cv_.wait_until(lock, next_frame, [this]() { return aborted_ || !connected_; })) {
+                break;
+            }
+        }
+        if (on_data_) {
+            on_data_(frame.data(), frame.size(), true);
+        }
+        next_frame += std::chrono::milliseconds(frame_duration_);
+    }
+    turn_.clear();
+    Reply("{\"type\":\"tts\",\"state\":\"stop\"}");
+}
+
+void LoopbackWebSocket::Reply(const std::string& json) {
+    if (on_data_) {
+        on_data_(json.c_str(), json.size(), false);
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef _LOOPBACK_WEB_SOCKET_H
+#define _LOOPBACK_WEB_SOCKET_H
+
+#include <web_socket.h>
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <condition_variable>
+
+// An in-process chat server behind the WebSocket interface, for running the protocol without a network.
+// It answers the hello, records the uplink of each turn and speaks it back as the TTS stream at the frame rate.
+// A turn ends with "listen stop", or after turn_ms of audio when the server has to detect the end of speech.
+class LoopbackWebSocket : public WebSocket {
+public:
+    LoopbackWebSocket(int sample_rate, int turn_ms);
+    virtual ~LoopbackWebSocket();
+
+    virtual bool Connect(const char* uri) override;
+    virtual bool Send(const std::string& data) override;
+    virtual bool Send(const void* data, size_t len, bool binary = false, bool fin = true) override;
+    virtual bool IsConnected() const override;
+
+private:
+    int sample_rate_;
+    int turn_ms_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread thread_;
+    bool connected_ = false;
+    // Client messages in order, true for binary
+    std::deque<std::pair<bool, std::string>> requests_;
+    bool aborted_ = false;
+
+    // Owned by the server thread after the hello
+    int frame_duration_ = 60;
+    bool packing_ = false;
+    bool listening_ = false;
+    bool auto_stop_ = true;
+    std::vector<std::string> turn_;
+
+    void ServerLoop();
+    void HandleText(const std::string& text);
+    void HandleAudio(const std::string& data);
+    void Speak();
+    void Reply(const std::string& json);
+};
+
+#endif // _LOOPBACK_WEB_SOCKET_H
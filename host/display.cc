@@ -0,0 +1,55 @@
+#include "display.h"
+
+#include <esp_log.h>
+
+#define TAG "Display"
+
+// The display of the host build prints what the screen would show, repeated values are left out
+Display::Display() {
+}
+
+Display::~Display() {
+}
+
+void Display::SetStatus(const char* status) {
+    DisplayLockGuard lock(this);
+    // The clock updates the status every 10 seconds while idle
+    static std::string last_status;
+    if (last_status != status) {
+        last_status = status;
+        ESP_LOGI(TAG, "Status: %s", status);
+    }
+}
+
+void Display::ShowNotification(const std::string &notification, int duration_ms) {
+    ShowNotification(notification.c_str(), duration_ms);
+}
+
+void Display::ShowNotification(const char* notification, int duration_ms) {
+    DisplayLockGuard lock(this);
+    ESP_LOGI(TAG, "Notification: %s", notification);
+}
+
+void Display::Update() {
+}
+
+void Display::SetEmotion(const char* emotion) {
+    DisplayLockGuard lock(this);
+    ESP_LOGI(TAG, "Emotion: %s", emotion);
+}
+
+void Display::SetIcon(const char* icon) {
+    DisplayLockGuard lock(this);
+    ESP_LOGI(TAG, "Icon: %s", icon);
+}
+
+void Display::SetChatMessage(const char* role, const char* content) {
+    DisplayLockGuard lock(this);
+    if (content[0] != '\0') {
+        ESP_LOGI(TAG, "%s: %s", role, content);
+    }
+}
+
+void Display::SetTheme(const std::string& theme_name) {
+    current_theme_name_ = theme_name;
+}
@@ -0,0 +1,218 @@
+#include <sdkconfig.h>
+#include <esp_err.h>
+#include <esp_system.h>
+#include <esp_rom_sys.h>
+#include <esp_random.h>
+#include <esp_mac.h>
+#include <esp_flash.h>
+#include <esp_chip_info.h>
+#include <esp_app_desc.h>
+#include <esp_partition.h>
+#include <esp_ota_ops.h>
+#include <esp_heap_caps.h>
+#include <mbedtls/base64.h>
+#include <esp_log.h>
+
+#include <malloc.h>
+#include <unistd.h>
+
+#include <thread>
+#include <chrono>
+#include <random>
+#include <cstring>
+
+#define TAG "HostSystem"
+
+#ifndef HOST_PROJECT_VER
+#define HOST_PROJECT_VER "0.0.0"
+#endif
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_OTA_VALIDATE_FAILED: return "ESP_ERR_OTA_VALIDATE_FAILED";
+    default: return "UNKNOWN ERROR";
+    }
+}
+
+void esp_restart() {
+    ESP_LOGW(TAG, "Restart requested, exiting");
+    fflush(stdout);
+    _exit(3);
+}
+
+// A notional heap of this size minus what the allocator handed out, so differences are allocation sizes.
+// mallinfo2() only covers the main arena, call mallopt(M_ARENA_MAX, 1) to account for all threads
+#define HOST_HEAP_SIZE (256 * 1024 * 1024)
+
+static size_t HeapUsed() {
+    auto info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+size_t heap_caps_get_free_size(int caps) {
+    size_t used = HeapUsed();
+    return used < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - used : 0;
+}
+
+size_t heap_caps_get_minimum_free_size(int caps) {
+    return heap_caps_get_free_size(caps);
+}
+
+size_t heap_caps_get_largest_free_block(int caps) {
+    return heap_caps_get_free_size(caps);
+}
+
+uint32_t esp_get_free_heap_size() {
+    return heap_caps_get_free_size(MALLOC_CAP_8BIT);
+}
+
+uint32_t esp_get_minimum_free_heap_size() {
+    return heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+}
+
+void esp_rom_delay_us(uint32_t us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+uint32_t esp_random() {
+    static std::random_device device;
+    return device();
+}
+
+void esp_fill_random(void* buf, size_t len) {
+    uint8_t* bytes = (uint8_t*)buf;
+    for (size_t i = 0; i < len; i++) {
+        bytes[i] = esp_random() & 0xFF;
+    }
+}
+
+esp_err_t esp_read_mac(uint8_t* mac, esp_mac_type_t type) {
+    char hostname[64] = {};
+    gethostname(hostname, sizeof(hostname) - 1);
+    // FNV-1a of the host name
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char* p = hostname; *p != '\0'; p++) {
+        hash = (hash ^ (uint8_t)*p) * 1099511628211ULL;
+    }
+    for (int i = 0; i < 6; i++) {
+        mac[i] = (hash >> (i * 8)) & 0xFF;
+    }
+    mac[0] = (mac[0] & 0xFC) | 0x02;
+    mac[5] += type;
+    return ESP_OK;
+}
+
+esp_err_t esp_flash_get_size(esp_flash_t* chip, uint32_t* out_size) {
+    *out_size = 16 * 1024 * 1024;
+    return ESP_OK;
+}
+
+void esp_chip_info(esp_chip_info_t* out_info) {
+    memset(out_info, 0, sizeof(*out_info));
+    out_info->model = CHIP_POSIX_LINUX;
+    out_info->cores = CONFIG_FREERTOS_NUMBER_OF_CORES;
+}
+
+const esp_app_desc_t* esp_app_get_description() {
+    static esp_app_desc_t desc = []() {
+        esp_app_desc_t desc = {};
+        strncpy(desc.version, HOST_PROJECT_VER, sizeof(desc.version) - 1);
+        strncpy(desc.project_name, "xiaozhi", sizeof(desc.project_name) - 1);
+        strncpy(desc.time, __TIME__, sizeof(desc.time) - 1);
+        strncpy(desc.date, __DATE__, sizeof(desc.date) - 1);
+        strncpy(desc.idf_ver, "host", sizeof(desc.idf_ver) - 1);
+        return desc;
+    }();
+    return &desc;
+}
+
+static const esp_partition_t partitions[] = {
+    {ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, 0x9000, 0x4000, "nvs", false},
+    {ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x20000, 0x600000, "ota_0", false},
+    {ESP_PARTITION_TYPE_APP, (esp_partition_subtype_t)(ESP_PARTITION_SUBTYPE_APP_OTA_0 + 1), 0x620000, 0x600000, "ota_1", false},
+};
+#define PARTITION_COUNT (sizeof(partitions) / sizeof(partitions[0]))
+
+// The iterator is the index of the partition plus one
+esp_partition_iterator_t esp_partition_find(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label) {
+    return (esp_partition_iterator_t)1;
+}
+
+const esp_partition_t* esp_partition_get(esp_partition_iterator_t iterator) {
+    return &partitions[(uintptr_t)iterator - 1];
+}
+
+esp_partition_iterator_t esp_partition_next(esp_partition_iterator_t iterator) {
+    uintptr_t next = (uintptr_t)iterator + 1;
+    return next <= PARTITION_COUNT ? (esp_partition_iterator_t)next : nullptr;
+}
+
+const esp_partition_t* esp_ota_get_running_partition() {
+    return &partitions[1];
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from) {
+    return &partitions[2];
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* ota_state) {
+    *ota_state = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback() {
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size, esp_ota_handle_t* out_handle) {
+    ESP_LOGE(TAG, "Firmware upgrades are not supported on the host");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle) {
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+int mbedtls_base64_encode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t needed = (slen + 2) / 3 * 4;
+    if (dst == nullptr || dlen < needed + 1) {
+        *olen = needed + 1;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+    unsigned char* out = dst;
+    for (size_t i = 0; i < slen; i += 3) {
+        uint32_t block = src[i] << 16;
+        if (i + 1 < slen) block |= src[i + 1] << 8;
+        if (i + 2 < slen) block |= src[i + 2];
+        *out++ = alphabet[(block >> 18) & 0x3F];
+        *out++ = alphabet[(block >> 12) & 0x3F];
+        *out++ = i + 1 < slen ? alphabet[(block >> 6) & 0x3F] : '=';
+        *out++ = i + 2 < slen ? alphabet[block & 0x3F] : '=';
+    }
+    *out = '\0';
+    *olen = needed;
+    return 0;
+}
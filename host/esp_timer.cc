@@ -0,0 +1,140 @@
+#include <esp_timer.h>
+
+#include <pthread.h>
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    int64_t period_us = 0;
+    int64_t alarm_us = -1;
+};
+
+static int64_t fixed_time_us = -1;
+
+static int64_t RealTime() {
+    static auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+int64_t esp_timer_get_time() {
+    if (fixed_time_us >= 0) {
+        return fixed_time_us;
+    }
+    return RealTime();
+}
+
+void host_timer_set_time(int64_t time_us) {
+    fixed_time_us = time_us;
+}
+
+// Armed timers ordered by alarm time, served by one thread started with the first timer
+static std::mutex timers_mutex;
+static std::condition_variable timers_cv;
+static std::multimap<int64_t, esp_timer_handle_t> armed_timers;
+
+static void Disarm(esp_timer_handle_t timer) {
+    for (auto it = armed_timers.lower_bound(timer->alarm_us); it != armed_timers.end() && it->first == timer->alarm_us; ++it) {
+        if (it->second == timer) {
+            armed_timers.erase(it);
+            break;
+        }
+    }
+    timer->alarm_us = -1;
+}
+
+static void Arm(esp_timer_handle_t timer, int64_t alarm_us) {
+    timer->alarm_us = alarm_us;
+    armed_timers.emplace(alarm_us, timer);
+    timers_cv.notify_one();
+}
+
+static void TimerLoop() {
+    pthread_setname_np(pthread_self(), "esp_timer");
+    std::unique_lock<std::mutex> lock(timers_mutex);
+    while (true) {
+        if (armed_timers.empty()) {
+            timers_cv.wait(lock);
+            continue;
+        }
+        auto next = armed_timers.begin();
+        int64_t now = RealTime();
+        if (next->first > now) {
+            timers_cv.wait_for(lock, std::chrono::microseconds(next->first - now));
+            continue;
+        }
+        auto timer = next->second;
+        armed_timers.erase(next);
+        timer->alarm_us = -1;
+        if (timer->period_us > 0) {
+            Arm(timer, now + timer->period_us);
+        }
+        // The callback may start, stop or delete timers
+        auto callback = timer->callback;
+        auto arg = timer->arg;
+        lock.unlock();
+        callback(arg);
+        lock.lock();
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+    static std::once_flag started;
+    std::call_once(started, []() {
+        std::thread(TimerLoop).detach();
+    });
+    auto timer = new esp_timer();
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    if (timer->alarm_us >= 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->period_us = 0;
+    Arm(timer, RealTime() + timeout_us);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    if (timer->alarm_us >= 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->period_us = period;
+    Arm(timer, RealTime() + period);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    if (timer->alarm_us < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->period_us = 0;
+    Disarm(timer);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    if (timer->alarm_us >= 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    delete timer;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    return timer->alarm_us >= 0;
+}
@@ -0,0 +1,338 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
+#include <esp_timer.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <list>
+#include <cstring>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+
+struct HostTask {
+    std::string name;
+    UBaseType_t number = 0;
+    UBaseType_t priority = 0;
+    BaseType_t core = tskNO_AFFINITY;
+    pthread_t thread = {};
+    uint8_t* stack = nullptr;
+    size_t stack_size = 0;
+    uint32_t stack_depth = 0;
+    bool idle = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t notifications = 0;
+};
+
+struct HostEventGroup {
+    std::mutex mutex;
+    std::condition_variable cv;
+    EventBits_t bits = 0;
+};
+
+// Added to the stack_depth of every task, the x86-64 frames of the firmware code are larger than on Xtensa
+#define STACK_HEADROOM (512 * 1024)
+#define STACK_FILL_BYTE 0xa5
+
+// Tasks are never freed, other tasks may still hold the handle of a task that ended
+static std::mutex tasks_mutex;
+static std::list<HostTask*> tasks;
+static UBaseType_t next_task_number = 1;
+static HostTask idle_tasks[portNUM_PROCESSORS];
+static thread_local HostTask* current_task = nullptr;
+
+static int64_t ThreadCpuTime(pthread_t thread) {
+    clockid_t clock;
+    struct timespec ts;
+    if (pthread_getcpuclockid(thread, &clock) != 0 || clock_gettime(clock, &ts) != 0) {
+        return 0;
+    }
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t ProcessCpuTime() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+struct TaskStart {
+    HostTask* task;
+    TaskFunction_t function;
+    void* parameters;
+};
+
+static HostTask* NewTask(const char* name, UBaseType_t priority, BaseType_t core) {
+    auto task = new HostTask();
+    task->name = name;
+    task->priority = priority;
+    task->core = core;
+    return task;
+}
+
+// Called on the thread of the task, only running threads are in the list
+static void RegisterTask(HostTask* task) {
+    current_task = task;
+    task->thread = pthread_self();
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    task->number = next_task_number++;
+    tasks.push_back(task);
+}
+
+static void UnregisterTask(HostTask* task) {
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    tasks.remove(task);
+}
+
+uint64_t host_run_time_counter() {
+    return esp_timer_get_time();
+}
+
+BaseType_t xPortGetCoreID() {
+    int cpu = sched_getcpu();
+    return cpu < 0 ? 0 : cpu % portNUM_PROCESSORS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth, void* parameters,
+    UBaseType_t priority, TaskHandle_t* created_task, BaseType_t core_id) {
+    auto task = NewTask(name, priority, core_id);
+    if (created_task != nullptr) {
+        *created_task = task;
+    }
+    task->stack_depth = stack_depth;
+    task->stack_size = (stack_depth + STACK_HEADROOM + 4095) & ~4095;
+    if (posix_memalign((void**)&task->stack, 4096, task->stack_size) != 0) {
+        return pdFAIL;
+    }
+    memset(task->stack, STACK_FILL_BYTE, task->stack_size);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, task->stack, task->stack_size);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int ret = pthread_create(&thread, &attr, [](void* arg) -> void* {
+        auto start = (TaskStart*)arg;
+        auto task = start->task;
+        auto function = start->function;
+        auto parameters = start->parameters;
+        delete start;
+        RegisterTask(task);
+        // Linux limits thread names to 15 characters
+        pthread_setname_np(pthread_self(), task->name.substr(0, 15).c_str());
+        function(parameters);
+        UnregisterTask(task);
+        return nullptr;
+    }, new TaskStart{task, function, parameters});
+    pthread_attr_destroy(&attr);
+    return ret == 0 ? pdPASS : pdFAIL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* parameters,
+    UBaseType_t priority, TaskHandle_t* created_task) {
+    return xTaskCreatePinnedToCore(function, name, stack_depth, parameters, priority, created_task, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth, void* parameters,
+    UBaseType_t priority, StackType_t* stack_buffer, StaticTask_t* task_buffer, BaseType_t core_id) {
+    TaskHandle_t task = nullptr;
+    xTaskCreatePinnedToCore(function, name, stack_depth, parameters, priority, &task, core_id);
+    return task;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == nullptr || task == current_task) {
+        // The thread ends when the task function returns
+        return;
+    }
+    UnregisterTask(task);
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    if (task == nullptr) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    if (task->stack == nullptr) {
+        return 0;
+    }
+    // The stack grows down, the bytes never written are still painted at the bottom.
+    // The used part includes the thread control block glibc keeps at the top
+    size_t unused = 0;
+    while (unused < task->stack_size && task->stack[unused] == STACK_FILL_BYTE) {
+        unused++;
+    }
+    size_t used = task->stack_size - unused;
+    return used < task->stack_depth ? task->stack_depth - used : 0;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+// Threads not created as tasks (main, the timer thread) get a task on first use
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    if (current_task == nullptr) {
+        char name[16] = {};
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        RegisterTask(NewTask(name, 1, tskNO_AFFINITY));
+    }
+    return current_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifications++;
+    }
+    task->cv.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait) {
+    auto task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    auto ready = [task]() { return task->notifications > 0; };
+    if (ticks_to_wait == portMAX_DELAY) {
+        task->cv.wait(lock, ready);
+    } else {
+        task->cv.wait_for(lock, std::chrono::milliseconds(ticks_to_wait), ready);
+    }
+    uint32_t count = task->notifications;
+    if (count > 0) {
+        task->notifications = clear_count_on_exit ? 0 : count - 1;
+    }
+    return count;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks() {
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    return tasks.size() + portNUM_PROCESSORS;
+}
+
+// Requires tasks_mutex, the thread of a task in the list is still running
+static configRUN_TIME_COUNTER_TYPE RunTimeCounter(HostTask* task) {
+    if (task->idle) {
+        // Each core's share of the time the process did not use
+        int64_t unused = esp_timer_get_time() * portNUM_PROCESSORS - ProcessCpuTime();
+        return (configRUN_TIME_COUNTER_TYPE)std::max<int64_t>(unused / portNUM_PROCESSORS, 0);
+    }
+    if (std::find(tasks.begin(), tasks.end(), task) == tasks.end()) {
+        return 0;
+    }
+    return (configRUN_TIME_COUNTER_TYPE)ThreadCpuTime(task->thread);
+}
+
+configRUN_TIME_COUNTER_TYPE ulTaskGetRunTimeCounter(TaskHandle_t task) {
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    return RunTimeCounter(task);
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCore(BaseType_t core_id) {
+    auto task = &idle_tasks[core_id];
+    if (!task->idle) {
+        task->name = "IDLE" + std::to_string(core_id);
+        task->core = core_id;
+        task->idle = true;
+    }
+    return task;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* task_status_array, UBaseType_t array_size,
+    configRUN_TIME_COUNTER_TYPE* total_run_time) {
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        xTaskGetIdleTaskHandleForCore(i);
+    }
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    if (array_size < tasks.size() + portNUM_PROCESSORS) {
+        return 0;
+    }
+    UBaseType_t count = 0;
+    auto fill = [&](HostTask* task) {
+        TaskStatus_t& status = task_status_array[count++];
+        status = {};
+        status.xHandle = task;
+        status.pcTaskName = task->name.c_str();
+        status.xTaskNumber = task->number;
+        status.eCurrentState = eReady;
+        status.uxCurrentPriority = task->priority;
+        status.uxBasePriority = task->priority;
+        status.ulRunTimeCounter = RunTimeCounter(task);
+        status.xCoreID = task->core;
+    };
+    for (auto task : tasks) {
+        fill(task);
+    }
+    for (auto& task : idle_tasks) {
+        fill(&task);
+    }
+    if (total_run_time != nullptr) {
+        *total_run_time = portGET_RUN_TIME_COUNTER_VALUE();
+    }
+    return count;
+}
+
+EventGroupHandle_t xEventGroupCreate() {
+    return new HostEventGroup();
+}
+
+void vEventGroupDelete(EventGroupHandle_t event_group) {
+    delete event_group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t event_group, EventBits_t bits) {
+    EventBits_t result;
+    {
+        std::lock_guard<std::mutex> lock(event_group->mutex);
+        event_group->bits |= bits;
+        result = event_group->bits;
+    }
+    event_group->cv.notify_all();
+    return result;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t event_group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(event_group->mutex);
+    EventBits_t previous = event_group->bits;
+    event_group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t event_group) {
+    std::lock_guard<std::mutex> lock(event_group->mutex);
+    return event_group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t event_group, EventBits_t bits, BaseType_t clear_on_exit,
+    BaseType_t wait_for_all_bits, TickType_t ticks_to_wait) {
+    std::unique_lock<std::mutex> lock(event_group->mutex);
+    auto satisfied = [&]() {
+        EventBits_t set = event_group->bits & bits;
+        return wait_for_all_bits ? set == bits : set != 0;
+    };
+    bool ok;
+    if (ticks_to_wait == portMAX_DELAY) {
+        event_group->cv.wait(lock, satisfied);
+        ok = true;
+    } else {
+        ok = event_group->cv.wait_for(lock, std::chrono::milliseconds(ticks_to_wait), satisfied);
+    }
+    // Like FreeRTOS: the bits before they were cleared, or the current bits on timeout
+    EventBits_t result = event_group->bits;
+    if (ok && clear_on_exit) {
+        event_group->bits &= ~bits;
+    }
+    return result;
+}
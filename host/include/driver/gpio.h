@@ -0,0 +1,12 @@
+#ifndef HOST_DRIVER_GPIO_H
+#define HOST_DRIVER_GPIO_H
+
+#include "esp_err.h"
+
+// Only the type, the host board has no pins
+typedef enum {
+    GPIO_NUM_NC = -1,
+    GPIO_NUM_0 = 0,
+} gpio_num_t;
+
+#endif // HOST_DRIVER_GPIO_H
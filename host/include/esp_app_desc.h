@@ -0,0 +1,22 @@
+#ifndef HOST_ESP_APP_DESC_H
+#define HOST_ESP_APP_DESC_H
+
+#include <cstdint>
+
+typedef struct {
+    uint32_t magic_word;
+    uint32_t secure_version;
+    uint32_t reserv1[2];
+    char version[32];
+    char project_name[32];
+    char time[16];
+    char date[16];
+    char idf_ver[32];
+    uint8_t app_elf_sha256[32];
+    uint32_t reserv2[20];
+} esp_app_desc_t;
+
+// The version comes from PROJECT_VER of the firmware CMakeLists.txt, see host/CMakeLists.txt
+const esp_app_desc_t* esp_app_get_description();
+
+#endif // HOST_ESP_APP_DESC_H
@@ -0,0 +1,19 @@
+#ifndef HOST_ESP_CHIP_INFO_H
+#define HOST_ESP_CHIP_INFO_H
+
+#include <cstdint>
+
+typedef enum {
+    CHIP_POSIX_LINUX = 999,
+} esp_chip_model_t;
+
+typedef struct {
+    esp_chip_model_t model;
+    uint32_t features;
+    uint16_t revision;
+    uint8_t cores;
+} esp_chip_info_t;
+
+void esp_chip_info(esp_chip_info_t* out_info);
+
+#endif // HOST_ESP_CHIP_INFO_H
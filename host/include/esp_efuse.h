@@ -0,0 +1,8 @@
+#ifndef HOST_ESP_EFUSE_H
+#define HOST_ESP_EFUSE_H
+
+#include "esp_err.h"
+
+// No efuses on the host: ESP_EFUSE_BLOCK_USR_DATA is not defined, so there is no serial number
+
+#endif // HOST_ESP_EFUSE_H
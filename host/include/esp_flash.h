@@ -0,0 +1,12 @@
+#ifndef HOST_ESP_FLASH_H
+#define HOST_ESP_FLASH_H
+
+#include <cstdint>
+
+#include "esp_err.h"
+
+typedef struct esp_flash_t esp_flash_t;
+
+esp_err_t esp_flash_get_size(esp_flash_t* chip, uint32_t* out_size);
+
+#endif // HOST_ESP_FLASH_H
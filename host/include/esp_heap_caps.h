@@ -0,0 +1,22 @@
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <cstdlib>
+#include <cstddef>
+
+// One heap on the host, the capabilities are ignored
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+
+inline void* heap_caps_malloc(size_t size, int) { return malloc(size); }
+inline void* heap_caps_calloc(size_t count, size_t size, int) { return calloc(count, size); }
+inline void heap_caps_free(void* ptr) { free(ptr); }
+
+// A fixed notional heap minus the bytes in use, see esp_system.cc
+size_t heap_caps_get_free_size(int caps);
+size_t heap_caps_get_minimum_free_size(int caps);
+size_t heap_caps_get_largest_free_block(int caps);
+
+#endif // HOST_ESP_HEAP_CAPS_H
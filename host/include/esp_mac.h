@@ -0,0 +1,18 @@
+#ifndef HOST_ESP_MAC_H
+#define HOST_ESP_MAC_H
+
+#include <cstdint>
+
+#include "esp_err.h"
+
+typedef enum {
+    ESP_MAC_WIFI_STA,
+    ESP_MAC_WIFI_SOFTAP,
+    ESP_MAC_BT,
+    ESP_MAC_ETH,
+} esp_mac_type_t;
+
+// A locally administered address derived from the host name, stable across runs on one machine
+esp_err_t esp_read_mac(uint8_t* mac, esp_mac_type_t type);
+
+#endif // HOST_ESP_MAC_H
@@ -0,0 +1,8 @@
+#ifndef HOST_ESP_ROM_SYS_H
+#define HOST_ESP_ROM_SYS_H
+
+#include <cstdint>
+
+void esp_rom_delay_us(uint32_t us);
+
+#endif // HOST_ESP_ROM_SYS_H
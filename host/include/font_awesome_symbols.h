@@ -0,0 +1,9 @@
+#ifndef HOST_FONT_AWESOME_SYMBOLS_H
+#define HOST_FONT_AWESOME_SYMBOLS_H
+
+// The icons the core uses, as words for the console display
+#define FONT_AWESOME_DOWNLOAD "[download]"
+#define FONT_AWESOME_WIFI "[wifi]"
+#define FONT_AWESOME_WIFI_OFF "[wifi off]"
+
+#endif // HOST_FONT_AWESOME_SYMBOLS_H
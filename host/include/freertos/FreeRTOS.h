@@ -0,0 +1,40 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include <sys/time.h>
+
+#include "sdkconfig.h"
+// Pulled in by the port headers of ESP-IDF, the firmware sources rely on it
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+
+// FreeRTOS on POSIX threads for the host build. Priorities and core affinity are not applied, the host
+// scheduler decides. One tick is one millisecond.
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portNUM_PROCESSORS CONFIG_FREERTOS_NUMBER_OF_CORES
+#define tskNO_AFFINITY 0x7fffffff
+
+// Run time counters in microseconds, like the esp_timer based counter of the firmware
+#define configRUN_TIME_COUNTER_TYPE uint32_t
+#define portGET_RUN_TIME_COUNTER_VALUE() ((configRUN_TIME_COUNTER_TYPE)host_run_time_counter())
+uint64_t host_run_time_counter();
+
+// The core of the calling thread modulo the cores of the configuration
+BaseType_t xPortGetCoreID();
+
+#endif // HOST_FREERTOS_H
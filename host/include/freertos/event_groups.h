@@ -0,0 +1,17 @@
+#ifndef HOST_FREERTOS_EVENT_GROUPS_H
+#define HOST_FREERTOS_EVENT_GROUPS_H
+
+#include "FreeRTOS.h"
+
+typedef struct HostEventGroup* EventGroupHandle_t;
+typedef TickType_t EventBits_t;
+
+EventGroupHandle_t xEventGroupCreate();
+void vEventGroupDelete(EventGroupHandle_t event_group);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t event_group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t event_group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t event_group);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t event_group, EventBits_t bits, BaseType_t clear_on_exit,
+    BaseType_t wait_for_all_bits, TickType_t ticks_to_wait);
+
+#endif // HOST_FREERTOS_EVENT_GROUPS_H
@@ -0,0 +1,64 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef struct HostTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+// The memory of a static task is not used, the thread has its own stack
+typedef struct {
+    uint8_t reserved[16];
+} StaticTask_t;
+
+typedef enum {
+    eRunning = 0,
+    eReady,
+    eBlocked,
+    eSuspended,
+    eDeleted,
+    eInvalid
+} eTaskState;
+
+typedef struct {
+    TaskHandle_t xHandle;
+    const char* pcTaskName;
+    UBaseType_t xTaskNumber;
+    eTaskState eCurrentState;
+    UBaseType_t uxCurrentPriority;
+    UBaseType_t uxBasePriority;
+    configRUN_TIME_COUNTER_TYPE ulRunTimeCounter;
+    StackType_t* pxStackBase;
+    uint32_t usStackHighWaterMark;
+    BaseType_t xCoreID;
+} TaskStatus_t;
+
+// Each task is a thread named after the task, so perf, top -H and gdb show the firmware task names
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* parameters,
+    UBaseType_t priority, TaskHandle_t* created_task);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth, void* parameters,
+    UBaseType_t priority, TaskHandle_t* created_task, BaseType_t core_id);
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth, void* parameters,
+    UBaseType_t priority, StackType_t* stack_buffer, StaticTask_t* task_buffer, BaseType_t core_id);
+// A task deletes itself as the last statement of its function, the thread then ends.
+// Other tasks can't be stopped on the host, deleting one only unregisters it
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait);
+
+// CPU time of the threads from the kernel, the idle tasks get the time the process left unused on each core
+UBaseType_t uxTaskGetNumberOfTasks();
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* task_status_array, UBaseType_t array_size,
+    configRUN_TIME_COUNTER_TYPE* total_run_time);
+configRUN_TIME_COUNTER_TYPE ulTaskGetRunTimeCounter(TaskHandle_t task);
+TaskHandle_t xTaskGetIdleTaskHandleForCore(BaseType_t core_id);
+
+// Stacks are painted like on the device and have headroom for the larger frames of x86-64, the mark is
+// counted against the requested stack_depth and is 0 once a task went past it
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+#endif // HOST_FREERTOS_TASK_H
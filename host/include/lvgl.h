@@ -0,0 +1,9 @@
+#ifndef HOST_LVGL_H
+#define HOST_LVGL_H
+
+// The host display prints to the console (host/display.cc), the LVGL types are only declared
+typedef struct _lv_font_t lv_font_t;
+typedef struct _lv_display_t lv_display_t;
+typedef struct _lv_obj_t lv_obj_t;
+
+#endif // HOST_LVGL_H
@@ -0,0 +1,24 @@
+#ifndef HOST_MBEDTLS_AES_H
+#define HOST_MBEDTLS_AES_H
+
+#include <cstddef>
+
+// The UDP audio channel of the MQTT protocol is encrypted with AES-CTR. The host has no MQTT transport
+// (see host/board/fake_board.cc), so encryption only has to compile and always fails
+#define MBEDTLS_ERR_AES_BAD_INPUT_DATA -0x0021
+
+typedef struct {
+    unsigned char key[16];
+} mbedtls_aes_context;
+
+inline void mbedtls_aes_init(mbedtls_aes_context*) {}
+inline void mbedtls_aes_free(mbedtls_aes_context*) {}
+inline int mbedtls_aes_setkey_enc(mbedtls_aes_context*, const unsigned char*, unsigned int) {
+    return MBEDTLS_ERR_AES_BAD_INPUT_DATA;
+}
+inline int mbedtls_aes_crypt_ctr(mbedtls_aes_context*, size_t, size_t*, unsigned char*, unsigned char*,
+    const unsigned char*, unsigned char*) {
+    return MBEDTLS_ERR_AES_BAD_INPUT_DATA;
+}
+
+#endif // HOST_MBEDTLS_AES_H
@@ -0,0 +1,11 @@
+#ifndef HOST_MBEDTLS_BASE64_H
+#define HOST_MBEDTLS_BASE64_H
+
+#include <cstddef>
+
+#define MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL -0x002A
+
+// Same contract as mbedtls: *olen gets the length without the terminating zero, or the size needed if dlen is too small
+int mbedtls_base64_encode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen);
+
+#endif // HOST_MBEDTLS_BASE64_H
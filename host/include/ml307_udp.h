@@ -0,0 +1,6 @@
+#ifndef HOST_ML307_UDP_H
+#define HOST_ML307_UDP_H
+
+// The ML307 modem transports don't exist on the host, the fake board hands out its own implementations
+
+#endif // HOST_ML307_UDP_H
@@ -0,0 +1,29 @@
+#ifndef HOST_OPUS_DECODER_H
+#define HOST_OPUS_DECODER_H
+
+#include <vector>
+#include <cstdint>
+
+struct OpusDecoder;
+
+// Host build of the esp-opus-encoder decoder wrapper on the system libopus.
+// An empty packet runs packet loss concealment for one frame.
+class OpusDecoderWrapper {
+public:
+    OpusDecoderWrapper(int sample_rate, int channels, int duration_ms = 60);
+    ~OpusDecoderWrapper();
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+
+    bool Decode(std::vector<uint8_t>&& opus, std::vector<int16_t>& pcm);
+    void ResetState();
+
+private:
+    OpusDecoder* audio_dec_ = nullptr;
+    int sample_rate_;
+    int duration_ms_;
+    int frame_size_;
+};
+
+#endif // HOST_OPUS_DECODER_H
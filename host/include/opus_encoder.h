@@ -0,0 +1,37 @@
+#ifndef HOST_OPUS_ENCODER_H
+#define HOST_OPUS_ENCODER_H
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+struct OpusEncoder;
+
+// Host build of the esp-opus-encoder wrapper on the system libopus, same interface and same encoder settings.
+// The firmware links a fixed point libopus, packets are bit exact only against a fixed point host build.
+class OpusEncoderWrapper {
+public:
+    OpusEncoderWrapper(int sample_rate, int channels, int duration_ms = 60);
+    ~OpusEncoderWrapper();
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+
+    void SetDtx(bool enable);
+    void SetComplexity(int complexity);
+    void Encode(std::vector<int16_t>&& pcm, std::function<void(std::vector<uint8_t>&& opus)> handler);
+    bool IsBufferEmpty() const { return in_buffer_.empty(); }
+    void ResetState();
+
+private:
+    OpusEncoder* audio_enc_ = nullptr;
+    int sample_rate_;
+    int duration_ms_;
+    int frame_size_;
+    std::vector<int16_t> in_buffer_;
+};
+
+// Makes the next Encode call block for stall_ms, so the uplink queues up behind it as on a busy device
+void host_encoder_stall(int stall_ms);
+
+#endif // HOST_OPUS_ENCODER_H
@@ -0,0 +1,27 @@
+#ifndef HOST_OPUS_RESAMPLER_H
+#define HOST_OPUS_RESAMPLER_H
+
+#include <cstdint>
+
+// The component wraps the SILK resampler, which libopus does not export. The host version interpolates
+// linearly, it only runs for ratios AudioResampler has no polyphase table for and is not bit exact.
+class OpusResampler {
+public:
+    OpusResampler() = default;
+    ~OpusResampler() = default;
+
+    void Configure(int input_sample_rate, int output_sample_rate);
+    void Process(const int16_t* input, int input_samples, int16_t* output);
+    int GetOutputSamples(int input_samples);
+
+    int input_sample_rate() const { return input_sample_rate_; }
+    int output_sample_rate() const { return output_sample_rate_; }
+
+private:
+    int input_sample_rate_ = 0;
+    int output_sample_rate_ = 0;
+    int16_t last_sample_ = 0;
+    double position_ = 0;  // of the next output, in input samples after the last sample of the previous block
+};
+
+#endif // HOST_OPUS_RESAMPLER_H
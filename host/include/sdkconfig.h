@@ -0,0 +1,28 @@
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+// Configuration of the host build, the counterpart of the sdkconfig.h generated by menuconfig.
+// Force included into the firmware sources, values can be overridden with -D on the cmake command line.
+// The host has no AFE, the audio path is the one of the boards without it: simple VAD and no wake word.
+
+#define CONFIG_IDF_TARGET "linux"
+#define CONFIG_IDF_TARGET_LINUX 1
+#define CONFIG_FREERTOS_NUMBER_OF_CORES 2
+
+#ifndef CONFIG_OTA_URL
+#define CONFIG_OTA_URL "http://localhost/xiaozhi/ota/"
+#endif
+#ifndef CONFIG_SOUND_CACHE_SIZE
+#define CONFIG_SOUND_CACHE_SIZE 256
+#endif
+#ifndef CONFIG_OPUS_ENCODER_COMPLEXITY_MIN
+#define CONFIG_OPUS_ENCODER_COMPLEXITY_MIN 0
+#endif
+#ifndef CONFIG_OPUS_ENCODER_COMPLEXITY_MAX
+#define CONFIG_OPUS_ENCODER_COMPLEXITY_MAX 5
+#endif
+#ifndef CONFIG_USE_SIMPLE_VAD
+#define CONFIG_USE_SIMPLE_VAD 1
+#endif
+
+#endif // HOST_SDKCONFIG_H
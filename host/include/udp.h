@@ -0,0 +1,25 @@
+#ifndef HOST_UDP_H
+#define HOST_UDP_H
+
+#include <string>
+#include <functional>
+
+// The Udp interface of the esp-ml307 component, implemented by the boards
+class Udp {
+public:
+    virtual ~Udp() = default;
+    virtual bool Connect(const std::string& host, int port) = 0;
+    virtual void Disconnect() = 0;
+    virtual int Send(const std::string& data) = 0;
+    virtual void OnMessage(std::function<void(const std::string& data)> callback) { message_callback_ = callback; }
+
+    bool connected() const { return connected_; }
+    int remote_port() const { return remote_port_; }
+
+protected:
+    std::function<void(const std::string& data)> message_callback_;
+    bool connected_ = false;
+    int remote_port_ = 0;
+};
+
+#endif // HOST_UDP_H
@@ -0,0 +1,54 @@
+#ifndef HOST_WEB_SOCKET_H
+#define HOST_WEB_SOCKET_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstddef>
+
+// The component header brings in the FreeRTOS task API, the firmware sources rely on it
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// The WebSocket client of the esp-ml307 component on POSIX sockets, plain ws:// only.
+// The methods are virtual so boards can return an in-process server instead (host/board/loopback_web_socket.h).
+// OnData gets text messages with a terminating zero after the last byte, like the component
+class WebSocket {
+public:
+    WebSocket();
+    virtual ~WebSocket();
+
+    void SetHeader(const char* key, const char* value);
+    virtual bool Connect(const char* uri);
+    virtual bool Send(const std::string& data);
+    virtual bool Send(const void* data, size_t len, bool binary = false, bool fin = true);
+    virtual bool IsConnected() const;
+
+    void OnConnected(std::function<void()> callback) { on_connected_ = callback; }
+    void OnDisconnected(std::function<void()> callback) { on_disconnected_ = callback; }
+    void OnData(std::function<void(const char*, size_t, bool binary)> callback) { on_data_ = callback; }
+    void OnError(std::function<void(int)> callback) { on_error_ = callback; }
+
+protected:
+    std::map<std::string, std::string> headers_;
+    std::function<void()> on_connected_;
+    std::function<void()> on_disconnected_;
+    std::function<void(const char*, size_t, bool binary)> on_data_;
+    std::function<void(int)> on_error_;
+
+private:
+    int fd_ = -1;
+    std::atomic<bool> connected_ = false;
+    std::mutex send_mutex_;
+    std::thread receive_thread_;
+
+    bool SendFrame(int opcode, const void* data, size_t len, bool fin);
+    bool ReadExactly(void* buffer, size_t size);
+    void ReceiveLoop();
+};
+
+#endif // HOST_WEB_SOCKET_H
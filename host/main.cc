@@ -0,0 +1,180 @@
+// The firmware core on the host: Application, the protocols, the audio tasks and the scheduler on a FakeBoard.
+//
+//   xiaozhi_host [options]
+//     --input FILE.wav       microphone input, silence without it
+//     --loop-input           repeat the input file
+//     --output FILE.wav      speaker output as played, with the silence between the writes
+//     --input-rate HZ        codec input sample rate (16000)
+//     --output-rate HZ       codec output sample rate (24000)
+//     --server URL           ws://host:port/path or loopback:// (default)
+//     --token TOKEN          access token for the server
+//     --loopback-rate HZ     downlink sample rate of the loopback server (24000)
+//     --turn-ms MS           audio per turn when the loopback server detects the end of speech (3000)
+//     --script "CMD; ..."    commands to run instead of reading them from stdin
+//
+// Commands, one per line on stdin or separated by ';' in the script:
+//   chat | listen | stop | abort       ToggleChatState, StartListening, StopListening, AbortSpeaking
+//   wait MS                            sleep
+//   stall MS                           block the next uplink encode for MS, the frames captured meanwhile queue up
+//   expect STATE [MS]                  wait up to MS (10000) for a device state, exit 1 if it doesn't come
+//   stats                              task CPU usage over one second and the latency histograms
+//   quit                               complete the output file and exit
+//
+// A CI run without a network: --input speech.wav --output out.wav --script "expect idle; chat; expect speaking;
+// expect listening 20000; quit", then check the exit code and compare out.wav with the input.
+
+#include "application.h"
+#include "system_info.h"
+#include "latency_metrics.h"
+#include "board/fake_board.h"
+#include "board/fake_audio_codec.h"
+
+#include <esp_log.h>
+#include <opus_encoder.h>
+#include <nvs_flash.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <iostream>
+
+#define TAG "main"
+
+static const char* const STATE_NAMES[] = {
+    "unknown", "starting", "configuring", "idle", "connecting", "listening", "speaking", "upgrading", "activating",
+    "fatal_error"
+};
+
+static void Usage(const char* program) {
+    fprintf(stderr, "Usage: %s [--input FILE.wav] [--loop-input] [--output FILE.wav] [--input-rate HZ] [--output-rate HZ]\n"
+        "    [--server URL] [--token TOKEN] [--loopback-rate HZ] [--turn-ms MS] [--script \"CMD; ...\"]\n", program);
+}
+
+[[noreturn]] static void Exit(int code) {
+    static_cast<FakeAudioCodec*>(Board::GetInstance().GetAudioCodec())->Finish();
+    fflush(stdout);
+    fflush(stderr);
+    // The tasks never end, skip the static destructors they still use
+    _exit(code);
+}
+
+static bool WaitForState(const std::string& name, int timeout_ms) {
+    auto& app = Application::GetInstance();
+    for (int elapsed = 0; elapsed <= timeout_ms; elapsed += 10) {
+        if (name == STATE_NAMES[app.GetDeviceState()]) {
+            return true;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return false;
+}
+
+static void RunCommand(const std::string& line) {
+    std::istringstream words(line);
+    std::string command;
+    if (!(words >> command)) {
+        return;
+    }
+    auto& app = Application::GetInstance();
+    if (command == "chat") {
+        app.ToggleChatState();
+    } else if (command == "listen") {
+        app.StartListening();
+    } else if (command == "stop") {
+        app.StopListening();
+    } else if (command == "abort") {
+        app.Schedule([&app]() {
+            app.AbortSpeaking(kAbortReasonNone);
+        });
+    } else if (command == "wait") {
+        int ms = 0;
+        words >> ms;
+        vTaskDelay(pdMS_TO_TICKS(ms));
+    } else if (command == "stall") {
+        int ms = 0;
+        words >> ms;
+        host_encoder_stall(ms);
+    } else if (command == "expect") {
+        std::string state;
+        int timeout_ms = 10000;
+        words >> state >> timeout_ms;
+        if (!WaitForState(state, timeout_ms)) {
+            ESP_LOGE(TAG, "Expected state %s within %d ms, the state is %s", state.c_str(), timeout_ms,
+                STATE_NAMES[app.GetDeviceState()]);
+            Exit(1);
+        }
+    } else if (command == "stats") {
+        SystemInfo::PrintRealTimeStats(pdMS_TO_TICKS(1000));
+        LatencyMetrics::GetInstance().Dump();
+    } else if (command == "quit") {
+        Exit(0);
+    } else {
+        ESP_LOGW(TAG, "Unknown command: %s", command.c_str());
+    }
+}
+
+int main(int argc, char* argv[]) {
+    auto& config = FakeBoard::config();
+    std::string script;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--loop-input") {
+            config.loop_input = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            Usage(argv[0]);
+            return 2;
+        }
+        const char* value = argv[++i];
+        if (arg == "--input") {
+            config.input_path = value;
+        } else if (arg == "--output") {
+            config.output_path = value;
+        } else if (arg == "--input-rate") {
+            config.input_sample_rate = atoi(value);
+        } else if (arg == "--output-rate") {
+            config.output_sample_rate = atoi(value);
+        } else if (arg == "--server") {
+            config.server_url = value;
+        } else if (arg == "--token") {
+            config.token = value;
+        } else if (arg == "--loopback-rate") {
+            config.loopback_sample_rate = atoi(value);
+        } else if (arg == "--turn-ms") {
+            config.loopback_turn_ms = atoi(value);
+        } else if (arg == "--script") {
+            script = value;
+        } else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+
+    ESP_ERROR_CHECK(nvs_flash_init());
+
+    // Start() runs the main event loop and never returns, on a task like app_main
+    xTaskCreate([](void* arg) {
+        Application::GetInstance().Start();
+    }, "main", 4096 * 2, nullptr, 1, nullptr);
+
+    if (!script.empty()) {
+        std::istringstream commands(script);
+        std::string command;
+        while (std::getline(commands, command, ';')) {
+            RunCommand(command);
+        }
+        Exit(0);
+    }
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        RunCommand(line);
+    }
+    Exit(0);
+}
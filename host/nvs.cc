@@ -0,0 +1,145 @@
+#include <nvs.h>
+#include <nvs_flash.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <cstring>
+
+struct NvsEntry {
+    bool is_string = false;
+    std::string string_value;
+    int32_t int_value = 0;
+};
+
+struct NvsHandle {
+    std::string ns;
+    bool read_write;
+};
+
+typedef std::map<std::string, NvsEntry> NvsNamespace;
+
+// Writes take effect at once, nvs_commit has nothing left to do
+static std::mutex nvs_mutex;
+static std::map<std::string, NvsNamespace> namespaces;
+static std::map<nvs_handle_t, NvsHandle> handles;
+static nvs_handle_t next_handle = 1;
+
+esp_err_t nvs_flash_init() {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase() {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    namespaces.clear();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* namespace_name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    if (open_mode == NVS_READONLY && namespaces.find(namespace_name) == namespaces.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    namespaces[namespace_name];
+    *out_handle = next_handle++;
+    handles[*out_handle] = {namespace_name, open_mode == NVS_READWRITE};
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    handles.erase(handle);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return ESP_OK;
+}
+
+// Requires nvs_mutex
+static NvsNamespace* FindNamespace(nvs_handle_t handle, bool write) {
+    auto it = handles.find(handle);
+    if (it == handles.end() || (write && !it->second.read_write)) {
+        return nullptr;
+    }
+    return &namespaces[it->second.ns];
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* out_value, size_t* length) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    auto ns = FindNamespace(handle, false);
+    if (ns == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    auto it = ns->find(key);
+    if (it == ns->end() || !it->second.is_string) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    const std::string& value = it->second.string_value;
+    if (out_value == nullptr) {
+        *length = value.size() + 1;
+        return ESP_OK;
+    }
+    if (*length < value.size() + 1) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(out_value, value.c_str(), value.size() + 1);
+    *length = value.size() + 1;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    auto ns = FindNamespace(handle, true);
+    if (ns == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    auto& entry = (*ns)[key];
+    entry.is_string = true;
+    entry.string_value = value;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char* key, int32_t* out_value) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    auto ns = FindNamespace(handle, false);
+    if (ns == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    auto it = ns->find(key);
+    if (it == ns->end() || it->second.is_string) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *out_value = it->second.int_value;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_i32(nvs_handle_t handle, const char* key, int32_t value) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    auto ns = FindNamespace(handle, true);
+    if (ns == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    auto& entry = (*ns)[key];
+    entry.is_string = false;
+    entry.int_value = value;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    auto ns = FindNamespace(handle, true);
+    if (ns == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ns->erase(key) > 0 ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    auto ns = FindNamespace(handle, true);
+    if (ns == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ns->clear();
+    return ESP_OK;
+}
@@ -0,0 +1,153 @@
+#include "opus_encoder.h"
+#include "opus_decoder.h"
+#include "opus_resampler.h"
+
+#include <esp_log.h>
+#include <opus.h>
+
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#define TAG "OpusHost"
+
+// Largest packet produced by the component
+#define MAX_OPUS_PACKET_SIZE 1000
+
+static std::atomic<int> encoder_stall_ms{0};
+
+void host_encoder_stall(int stall_ms) {
+    encoder_stall_ms = stall_ms;
+}
+
+OpusEncoderWrapper::OpusEncoderWrapper(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), duration_ms_(duration_ms) {
+    int error;
+    audio_enc_ = opus_encoder_create(sample_rate, channels, OPUS_APPLICATION_VOIP, &error);
+    if (audio_enc_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", error);
+        return;
+    }
+    // Same defaults as the firmware component
+    SetDtx(true);
+    SetComplexity(5);
+    frame_size_ = sample_rate / 1000 * channels * duration_ms;
+}
+
+OpusEncoderWrapper::~OpusEncoderWrapper() {
+    if (audio_enc_ != nullptr) {
+        opus_encoder_destroy(audio_enc_);
+    }
+}
+
+void OpusEncoderWrapper::SetDtx(bool enable) {
+    opus_encoder_ctl(audio_enc_, OPUS_SET_DTX(enable ? 1 : 0));
+}
+
+void OpusEncoderWrapper::SetComplexity(int complexity) {
+    opus_encoder_ctl(audio_enc_, OPUS_SET_COMPLEXITY(complexity));
+}
+
+void OpusEncoderWrapper::Encode(std::vector<int16_t>&& pcm, std::function<void(std::vector<uint8_t>&& opus)> handler) {
+    if (audio_enc_ == nullptr) {
+        ESP_LOGE(TAG, "Audio encoder is not configured");
+        return;
+    }
+    int stall_ms = encoder_stall_ms.exchange(0);
+    if (stall_ms > 0) {
+        ESP_LOGI(TAG, "Encoder stalled for %d ms", stall_ms);
+        std::this_thread::sleep_for(std::chrono::milliseconds(stall_ms));
+    }
+    in_buffer_.insert(in_buffer_.end(), pcm.begin(), pcm.end());
+
+    while ((int)in_buffer_.size() >= frame_size_) {
+        uint8_t opus[MAX_OPUS_PACKET_SIZE];
+        auto ret = opus_encode(audio_enc_, in_buffer_.data(), frame_size_, opus, MAX_OPUS_PACKET_SIZE);
+        if (ret < 0) {
+            ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
+            return;
+        }
+        if (handler != nullptr) {
+            handler(std::vector<uint8_t>(opus, opus + ret));
+        }
+        in_buffer_.erase(in_buffer_.begin(), in_buffer_.begin() + frame_size_);
+    }
+}
+
+void OpusEncoderWrapper::ResetState() {
+    if (audio_enc_ != nullptr) {
+        opus_encoder_ctl(audio_enc_, OPUS_RESET_STATE);
+        in_buffer_.clear();
+    }
+}
+
+OpusDecoderWrapper::OpusDecoderWrapper(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), duration_ms_(duration_ms) {
+    int error;
+    audio_dec_ = opus_decoder_create(sample_rate, channels, &error);
+    if (audio_dec_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio decoder, error code: %d", error);
+        return;
+    }
+    frame_size_ = sample_rate / 1000 * channels * duration_ms;
+}
+
+OpusDecoderWrapper::~OpusDecoderWrapper() {
+    if (audio_dec_ != nullptr) {
+        opus_decoder_destroy(audio_dec_);
+    }
+}
+
+bool OpusDecoderWrapper::Decode(std::vector<uint8_t>&& opus, std::vector<int16_t>& pcm) {
+    if (audio_dec_ == nullptr) {
+        ESP_LOGE(TAG, "Audio decoder is not configured");
+        return false;
+    }
+    pcm.resize(frame_size_);
+    auto ret = opus_decode(audio_dec_, opus.empty() ? nullptr : opus.data(), opus.size(), pcm.data(), pcm.size(), 0);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Failed to decode audio, error code: %d", ret);
+        return false;
+    }
+    pcm.resize(ret);
+    return true;
+}
+
+void OpusDecoderWrapper::ResetState() {
+    if (audio_dec_ != nullptr) {
+        opus_decoder_ctl(audio_dec_, OPUS_RESET_STATE);
+    }
+}
+
+void OpusResampler::Configure(int input_sample_rate, int output_sample_rate) {
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+    last_sample_ = 0;
+    position_ = -1;
+}
+
+int OpusResampler::GetOutputSamples(int input_samples) {
+    double step = (double)input_sample_rate_ / output_sample_rate_;
+    double span = input_samples - 1 - position_;
+    return span > 0 ? (int)std::ceil(span / step) : 0;
+}
+
+void OpusResampler::Process(const int16_t* input, int input_samples, int16_t* output) {
+    if (input_samples == 0) {
+        return;
+    }
+    double step = (double)input_sample_rate_ / output_sample_rate_;
+    int count = GetOutputSamples(input_samples);
+    for (int k = 0; k < count; k++) {
+        double position = position_ + k * step;
+        int index = (int)std::floor(position);
+        double fraction = position - index;
+        double a = index < 0 ? last_sample_ : input[index];
+        double b = input[std::min(index + 1, input_samples - 1)];
+        output[k] = (int16_t)std::lround(a + (b - a) * fraction);
+    }
+    position_ += count * step - input_samples;
+    last_sample_ = input[input_samples - 1];
+}
@@ -0,0 +1,120 @@
+// The PCM kernels of audio_codecs/audio_kernels.h against the per-sample code they replaced, bit for bit.
+
+#include "host_test.h"
+#include "audio_kernels.h"
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+
+// Q16 gain of NoAudioCodec::Write for a volume of 0-100
+static int32_t VolumeGain(int volume) {
+    return pow(double(volume) / 100.0, 2) * 65536;
+}
+
+// NoAudioCodec::Write before the kernel: a 64-bit product clamped to 32 bits
+static int32_t ScaleReference(int16_t sample, int32_t gain_q16) {
+    int64_t temp = int64_t(sample) * gain_q16;
+    if (temp > INT32_MAX) {
+        return INT32_MAX;
+    } else if (temp < INT32_MIN) {
+        return INT32_MIN;
+    }
+    return static_cast<int32_t>(temp);
+}
+
+// Every 16-bit sample at every volume step, the unity gain of volume 100 included
+static void TestScalePcm16To32() {
+    std::vector<int16_t> input(65536);
+    for (int i = 0; i < 65536; i++) {
+        input[i] = (int16_t)(i - 32768);
+    }
+    std::vector<int32_t> output(input.size());
+    for (int volume = 0; volume <= 100; volume++) {
+        int32_t gain = VolumeGain(volume);
+        CHECK(gain >= 0 && gain <= 65536);
+        ScalePcm16To32(input.data(), output.data(), gain, input.size());
+        int mismatches = 0;
+        for (size_t i = 0; i < input.size(); i++) {
+            mismatches += output[i] != ScaleReference(input[i], gain);
+        }
+        CHECK_EQ(mismatches, 0);
+    }
+    CHECK_EQ(VolumeGain(100), 65536);
+    CHECK_EQ(VolumeGain(0), 0);
+}
+
+// Odd lengths and offsets, so an unrolled or vectorized loop has to handle its tail
+static void TestScalePcm16To32Lengths() {
+    std::vector<int16_t> input(67);
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = (int16_t)(i * 977 - 32000);
+    }
+    int32_t gain = VolumeGain(70);
+    for (size_t offset = 0; offset < 4; offset++) {
+        for (size_t length = 0; length + offset <= input.size(); length++) {
+            std::vector<int32_t> output(length + 1, 0x5a5a5a5a);
+            ScalePcm16To32(input.data() + offset, output.data(), gain, length);
+            for (size_t i = 0; i < length; i++) {
+                CHECK_EQ(output[i], ScaleReference(input[offset + i], gain));
+            }
+            // Nothing written past the end
+            CHECK_EQ(output[length], 0x5a5a5a5a);
+        }
+    }
+}
+
+// NoAudioCodec::Read before the kernel
+static int16_t ShiftReference(int32_t sample) {
+    int32_t value = sample >> 12;
+    return (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
+}
+
+// The 32-bit range in coarse steps, every value around the clamp points, and the extremes
+static void TestShiftSaturatePcm32To16() {
+    std::vector<int32_t> input;
+    for (int64_t value = INT32_MIN; value <= INT32_MAX; value += 65521) {
+        input.push_back((int32_t)value);
+    }
+    for (int64_t edge : {(int64_t)INT16_MAX << 12, (int64_t)-INT16_MAX << 12, (int64_t)INT16_MIN << 12, (int64_t)0}) {
+        for (int64_t value = edge - 8192; value <= edge + 8192; value++) {
+            input.push_back((int32_t)value);
+        }
+    }
+    input.push_back(INT32_MAX);
+    input.push_back(INT32_MIN);
+    std::vector<int16_t> output(input.size());
+    ShiftSaturatePcm32To16(input.data(), output.data(), 12, input.size());
+    int mismatches = 0;
+    for (size_t i = 0; i < input.size(); i++) {
+        mismatches += output[i] != ShiftReference(input[i]);
+    }
+    CHECK_EQ(mismatches, 0);
+    CHECK_EQ(output[output.size() - 1], -INT16_MAX);
+    CHECK_EQ(output[output.size() - 2], INT16_MAX);
+}
+
+static void TestShiftSaturatePcm32To16Lengths() {
+    std::vector<int32_t> input(67);
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = (int32_t)(i * 0x3f1e2d3c);
+    }
+    for (size_t offset = 0; offset < 4; offset++) {
+        for (size_t length = 0; length + offset <= input.size(); length++) {
+            std::vector<int16_t> output(length + 1, 0x5a5a);
+            ShiftSaturatePcm32To16(input.data() + offset, output.data(), 12, length);
+            for (size_t i = 0; i < length; i++) {
+                CHECK_EQ(output[i], ShiftReference(input[offset + i]));
+            }
+            CHECK_EQ(output[length], 0x5a5a);
+        }
+    }
+}
+
+int main() {
+    RUN_TEST(TestScalePcm16To32);
+    RUN_TEST(TestScalePcm16To32Lengths);
+    RUN_TEST(TestShiftSaturatePcm32To16);
+    RUN_TEST(TestShiftSaturatePcm32To16Lengths);
+    return TEST_RESULT();
+}
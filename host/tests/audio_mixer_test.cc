@@ -0,0 +1,206 @@
+// AudioMixer sample by sample: a voice alone, the sum of both, the ducking ramp of the speech voice while a
+// UI sound plays and back, saturation of the sum, the FIFOs wrapping around, and the fade-out of a voice.
+
+#include "host_test.h"
+#include "audio_mixer.h"
+
+#include <vector>
+#include <cstdint>
+
+#define CAPACITY 64
+#define UNITY 32768
+
+static std::vector<int16_t> Ramp(size_t count, int start, int step) {
+    std::vector<int16_t> samples(count);
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = (int16_t)(start + step * (int)i);
+    }
+    return samples;
+}
+
+static std::vector<int16_t> Mix(AudioMixer& mixer, size_t max_samples) {
+    std::vector<int16_t> out(max_samples);
+    out.resize(mixer.Mix(out.data(), max_samples));
+    return out;
+}
+
+// Speech sample i of a chunk of n ramping the ducking from duck_from to duck_to, as Mix computes it
+static int32_t DuckedSpeech(int16_t sample, int32_t gain, int32_t duck_from, int32_t duck_to, size_t n, size_t i) {
+    int32_t duck = duck_from + (duck_to - duck_from) / (int32_t)n * (int32_t)i;
+    return (sample * (int32_t)(((int64_t)gain * duck) >> 15)) >> 15;
+}
+
+static void TestSingleVoice() {
+    AudioMixer mixer;
+    mixer.Initialize(CAPACITY);
+    auto speech = Ramp(20, -1000, 97);
+    CHECK_EQ(mixer.Push(kMixerVoiceSpeech, speech.data(), speech.size()), 20);
+    CHECK_EQ(mixer.Available(kMixerVoiceSpeech), 20);
+    // Unity gain passes the samples through, in pieces no larger than asked for
+    auto out = Mix(mixer, 8);
+    CHECK_EQ(out.size(), 8);
+    for (size_t i = 0; i < out.size(); i++) {
+        CHECK_EQ(out[i], speech[i]);
+    }
+    mixer.SetGain(kMixerVoiceSpeech, 0.5f);
+    out = Mix(mixer, 32);
+    CHECK_EQ(out.size(), 12);
+    for (size_t i = 0; i < out.size(); i++) {
+        CHECK_EQ(out[i], (speech[8 + i] * 16384) >> 15);
+    }
+    CHECK(mixer.Empty());
+    CHECK_EQ(Mix(mixer, 32).size(), 0);
+
+    // The UI voice alone is not ducked and does not start a ramp
+    auto ui = Ramp(10, 500, -111);
+    mixer.Push(kMixerVoiceUi, ui.data(), ui.size());
+    out = Mix(mixer, 32);
+    CHECK_EQ(out.size(), 10);
+    for (size_t i = 0; i < out.size(); i++) {
+        CHECK_EQ(out[i], ui[i]);
+    }
+}
+
+static void TestDuckingRamp() {
+    AudioMixer mixer;
+    mixer.Initialize(CAPACITY);
+    mixer.SetDucking(0.25f);
+    const int32_t ducked = 8192;
+    auto speech = Ramp(48, 2000, 50);
+    auto ui = Ramp(16, -300, 37);
+    mixer.Push(kMixerVoiceSpeech, speech.data(), speech.size());
+    mixer.Push(kMixerVoiceUi, ui.data(), ui.size());
+
+    // Only the overlap is mixed while both voices play, the speech ramps down to the ducking level over it
+    auto out = Mix(mixer, 32);
+    CHECK_EQ(out.size(), 16);
+    for (size_t i = 0; i < out.size(); i++) {
+        CHECK_EQ(out[i], DuckedSpeech(speech[i], UNITY, UNITY, ducked, 16, i) + ui[i]);
+    }
+    // The ramp is monotonic and ends one step short of the ducking level
+    CHECK(DuckedSpeech(10000, UNITY, UNITY, ducked, 16, 15) < DuckedSpeech(10000, UNITY, UNITY, ducked, 16, 1));
+
+    // More UI sound: the speech stays ducked
+    mixer.Push(kMixerVoiceUi, ui.data(), 8);
+    out = Mix(mixer, 32);
+    CHECK_EQ(out.size(), 8);
+    for (size_t i = 0; i < out.size(); i++) {
+        CHECK_EQ(out[i], DuckedSpeech(speech[16 + i], UNITY, ducked, ducked, 8, i) + ui[i]);
+    }
+
+    // The UI voice drained: the speech ramps back up to unity over the next chunk, then plays unchanged
+    out = Mix(mixer, 12);
+    CHECK_EQ(out.size(), 12);
+    for (size_t i = 0; i < out.size(); i++) {
+        CHECK_EQ(out[i], DuckedSpeech(speech[24 + i], UNITY, ducked, UNITY, 12, i));
+    }
+    CHECK(out[0] < speech[24]);
+    out = Mix(mixer, 32);
+    CHECK_EQ(out.size(), 12);
+    for (size_t i = 0; i < out.size(); i++) {
+        CHECK_EQ(out[i], speech[36 + i]);
+    }
+
+    // Clear forgets the ducking level
+    mixer.Push(kMixerVoiceSpeech, speech.data(), 4);
+    mixer.Push(kMixerVoiceUi, ui.data(), 4);
+    Mix(mixer, 4);
+    mixer.Clear();
+    CHECK(mixer.Empty());
+    mixer.Push(kMixerVoiceSpeech, speech.data(), 4);
+    out = Mix(mixer, 4);
+    for (size_t i = 0; i < out.size(); i++) {
+        CHECK_EQ(out[i], speech[i]);
+    }
+}
+
+static void TestSaturation() {
+    AudioMixer mixer;
+    mixer.Initialize(CAPACITY);
+    const int16_t speech[] = {30000, -30000, 20000, -20000, INT16_MAX, INT16_MIN, 100};
+    const int16_t ui[] = {30000, -30000, 12767, -12768, INT16_MAX, INT16_MIN, -100};
+    const int16_t expected[] = {INT16_MAX, INT16_MIN, 32767, -32768, INT16_MAX, INT16_MIN, 0};
+    mixer.Push(kMixerVoiceSpeech, speech, 7);
+    mixer.Push(kMixerVoiceUi, ui, 7);
+    // No ducking, so the sum is plain
+    mixer.SetDucking(1.0f);
+    auto out = Mix(mixer, 7);
+    CHECK_EQ(out.size(), 7);
+    for (size_t i = 0; i < out.size(); i++) {
+        CHECK_EQ(out[i], expected[i]);
+    }
+
+    // A gain above unity saturates a single voice too, gains are capped at 2
+    mixer.SetGain(kMixerVoiceUi, 5.0f);
+    const int16_t loud[] = {20000, -20000, 1000};
+    mixer.Push(kMixerVoiceUi, loud, 3);
+    out = Mix(mixer, 3);
+    CHECK_EQ(out[0], INT16_MAX);
+    CHECK_EQ(out[1], INT16_MIN);
+    CHECK_EQ(out[2], 2000);
+}
+
+static void TestWrapAndOverflow() {
+    AudioMixer mixer;
+    mixer.Initialize(CAPACITY);
+    CHECK_EQ(mixer.capacity(), CAPACITY);
+    auto samples = Ramp(CAPACITY + 10, 0, 13);
+    // A full voice drops what does not fit
+    CHECK_EQ(mixer.Push(kMixerVoiceSpeech, samples.data(), samples.size()), CAPACITY);
+    CHECK_EQ(mixer.Push(kMixerVoiceSpeech, samples.data(), 1), 0);
+    auto out = Mix(mixer, 40);
+    CHECK_EQ(out.size(), 40);
+    // The next push wraps around the end of the FIFO and is read back in order
+    CHECK_EQ(mixer.Push(kMixerVoiceSpeech, samples.data() + CAPACITY, 10), 10);
+    out = Mix(mixer, CAPACITY);
+    CHECK_EQ(out.size(), CAPACITY - 40 + 10);
+    for (size_t i = 0; i < out.size(); i++) {
+        CHECK_EQ(out[i], samples[40 + i]);
+    }
+    mixer.Clear(kMixerVoiceSpeech);
+    CHECK_EQ(mixer.Available(kMixerVoiceSpeech), 0);
+}
+
+static void TestFadeOut() {
+    AudioMixer mixer;
+    mixer.Initialize(CAPACITY);
+    auto speech = Ramp(CAPACITY, 8000, 0);
+    auto ui = Ramp(CAPACITY, 100, 0);
+    // Wrap the speech FIFO so the fade runs over its end
+    mixer.Push(kMixerVoiceSpeech, speech.data(), 40);
+    CHECK_EQ(Mix(mixer, 40).size(), 40);
+    mixer.Push(kMixerVoiceSpeech, speech.data(), CAPACITY);
+    mixer.Push(kMixerVoiceUi, ui.data(), CAPACITY);
+
+    // The speech steps down to silence in equal steps and the rest of it is dropped, the UI voice is untouched
+    const size_t fade = 32;
+    CHECK_EQ(mixer.FadeOut(kMixerVoiceSpeech, fade), fade);
+    CHECK_EQ(mixer.Available(kMixerVoiceSpeech), fade);
+    CHECK_EQ(mixer.Available(kMixerVoiceUi), CAPACITY);
+    auto out = Mix(mixer, CAPACITY);
+    CHECK_EQ(out.size(), fade);
+    for (size_t i = 0; i < fade; i++) {
+        CHECK_EQ(out[i], 8000 * (int)(fade - 1 - i) / (int)fade + 100);
+    }
+    CHECK_EQ(mixer.Available(kMixerVoiceSpeech), 0);
+
+    // A voice shorter than the fade is faded over what it has, an empty one stays empty
+    mixer.Clear();
+    mixer.Push(kMixerVoiceSpeech, speech.data(), 4);
+    CHECK_EQ(mixer.FadeOut(kMixerVoiceSpeech, fade), 4);
+    out = Mix(mixer, CAPACITY);
+    CHECK_EQ(out.size(), 4);
+    CHECK_EQ(out[0], 6000);
+    CHECK_EQ(out[3], 0);
+    CHECK_EQ(mixer.FadeOut(kMixerVoiceSpeech, fade), 0);
+    CHECK(mixer.Empty());
+}
+
+int main() {
+    RUN_TEST(TestSingleVoice);
+    RUN_TEST(TestDuckingRamp);
+    RUN_TEST(TestSaturation);
+    RUN_TEST(TestWrapAndOverflow);
+    RUN_TEST(TestFadeOut);
+    return TEST_RESULT();
+}
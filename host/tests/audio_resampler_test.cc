@@ -0,0 +1,214 @@
+// AudioResampler on sines: the signal to noise ratio of the polyphase filters against the OpusResampler of the
+// host (linear interpolation), the rejection of tones above the output Nyquist frequency, the number of output
+// samples per call, and the same output whatever the chunking of the input.
+
+#include "host_test.h"
+#include "audio_resampler.h"
+
+#include <cmath>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+
+#define AMPLITUDE 10000.0
+#define DURATION_MS 1000
+// Output skipped before measuring, the filter history starts out as zeros
+#define SETTLE_MS 20
+
+struct SineFit {
+    double snr_db;
+    double amplitude;
+};
+
+// Least squares fit of a sine of known frequency and any phase, the rest of the signal is noise
+static SineFit FitSine(const std::vector<int16_t>& signal, int sample_rate, double frequency, size_t skip) {
+    double ss = 0, sc = 0, cc = 0, ys = 0, yc = 0;
+    for (size_t i = skip; i < signal.size(); i++) {
+        double w = 2.0 * M_PI * frequency * i / sample_rate;
+        double s = std::sin(w), c = std::cos(w);
+        ss += s * s;
+        sc += s * c;
+        cc += c * c;
+        ys += signal[i] * s;
+        yc += signal[i] * c;
+    }
+    double determinant = ss * cc - sc * sc;
+    double a = (ys * cc - yc * sc) / determinant;
+    double b = (yc * ss - ys * sc) / determinant;
+    double signal_power = 0, noise_power = 0;
+    for (size_t i = skip; i < signal.size(); i++) {
+        double w = 2.0 * M_PI * frequency * i / sample_rate;
+        double fit = a * std::sin(w) + b * std::cos(w);
+        signal_power += fit * fit;
+        noise_power += (signal[i] - fit) * (signal[i] - fit);
+    }
+    return SineFit{10.0 * std::log10(signal_power / std::max(noise_power, 1e-9)), std::sqrt(a * a + b * b)};
+}
+
+static std::vector<int16_t> Sine(int sample_rate, double frequency, int duration_ms) {
+    std::vector<int16_t> samples(sample_rate * duration_ms / 1000);
+    for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = (int16_t)std::lround(AMPLITUDE * std::sin(2.0 * M_PI * frequency * i / sample_rate));
+    }
+    return samples;
+}
+
+// Runs the input through in chunks of chunk_ms, as the audio paths do
+template <typename Resampler>
+static std::vector<int16_t> Resample(Resampler& resampler, const std::vector<int16_t>& input, int sample_rate, int chunk_ms) {
+    size_t chunk = sample_rate * chunk_ms / 1000;
+    std::vector<int16_t> output;
+    for (size_t offset = 0; offset < input.size(); offset += chunk) {
+        int count = std::min(chunk, input.size() - offset);
+        size_t start = output.size();
+        output.resize(start + resampler.GetOutputSamples(count));
+        resampler.Process(input.data() + offset, count, output.data() + start);
+    }
+    return output;
+}
+
+static void TestSineSnr() {
+    struct Case {
+        int input_rate;
+        int output_rate;
+        double frequency;
+    };
+    const Case cases[] = {
+        {24000, 16000, 440}, {24000, 16000, 1000}, {24000, 16000, 3000}, {24000, 16000, 6000},
+        {48000, 16000, 440}, {48000, 16000, 1000}, {48000, 16000, 3000}, {48000, 16000, 6000},
+        {16000, 24000, 1000}, {16000, 24000, 6000},
+        {24000, 48000, 1000}, {24000, 48000, 9000},
+        {8000, 16000, 1000}, {8000, 16000, 3000},
+    };
+    for (auto& c : cases) {
+        auto input = Sine(c.input_rate, c.frequency, DURATION_MS);
+        AudioResampler polyphase;
+        polyphase.Configure(c.input_rate, c.output_rate);
+        CHECK(polyphase.polyphase());
+        OpusResampler linear;
+        linear.Configure(c.input_rate, c.output_rate);
+        auto polyphase_output = Resample(polyphase, input, c.input_rate, 30);
+        auto linear_output = Resample(linear, input, c.input_rate, 30);
+        size_t skip = c.output_rate * SETTLE_MS / 1000;
+        auto polyphase_fit = FitSine(polyphase_output, c.output_rate, c.frequency, skip);
+        auto linear_fit = FitSine(linear_output, c.output_rate, c.frequency, skip);
+        printf("  %5d -> %5d %5.0f Hz: polyphase %5.1f dB gain %6.3f, linear %5.1f dB\n", c.input_rate, c.output_rate,
+            c.frequency, polyphase_fit.snr_db, polyphase_fit.amplitude / AMPLITUDE, linear_fit.snr_db);
+        // The stopband of the Kaiser window is about 70 dB, the Q15 taps and 16-bit output stay below it
+        CHECK(polyphase_fit.snr_db > 60);
+        // Integer decimation makes the linear resampler keep every n-th sample, exact on a sine in the band
+        // (its aliasing is what TestAliasRejection is about), every other ratio interpolates
+        if (c.input_rate % c.output_rate != 0) {
+            CHECK(polyphase_fit.snr_db > linear_fit.snr_db + 20);
+        }
+        // The passband ends at 90% of the lower Nyquist frequency
+        CHECK_NEAR(polyphase_fit.amplitude / AMPLITUDE, 1.0, 0.02);
+    }
+}
+
+// A tone the output rate cannot carry must not fold back into the band
+static void TestAliasRejection() {
+    struct Case {
+        int input_rate;
+        int output_rate;
+        double frequency;
+    };
+    const Case cases[] = {{24000, 16000, 10000}, {48000, 16000, 12000}, {48000, 16000, 20000}};
+    for (auto& c : cases) {
+        auto input = Sine(c.input_rate, c.frequency, DURATION_MS);
+        AudioResampler resampler;
+        resampler.Configure(c.input_rate, c.output_rate);
+        auto output = Resample(resampler, input, c.input_rate, 30);
+        double power = 0;
+        size_t skip = c.output_rate * SETTLE_MS / 1000;
+        for (size_t i = skip; i < output.size(); i++) {
+            power += (double)output[i] * output[i];
+        }
+        double rms = std::sqrt(power / (output.size() - skip));
+        // Below half a step the output rounds to silence, the rejection is reported as that floor
+        double rejection_db = 20.0 * std::log10(AMPLITUDE / std::sqrt(2.0) / std::max(rms, 0.5));
+        printf("  %5d -> %5d %5.0f Hz: %5.1f dB rejected\n", c.input_rate, c.output_rate, c.frequency, rejection_db);
+        CHECK(rejection_db > 50);
+    }
+}
+
+// The 30 ms chunks of the input path give whole outputs, odd chunks add up to the exact ratio,
+// and Process writes no more than GetOutputSamples promised
+static void TestOutputCounts() {
+    struct Case {
+        int input_rate;
+        int output_rate;
+        int chunk;
+        int output;
+    };
+    const Case cases[] = {{24000, 16000, 720, 480}, {48000, 16000, 1440, 480}, {24000, 16000, 480, 320}, {48000, 16000, 960, 320}};
+    for (auto& c : cases) {
+        AudioResampler resampler;
+        resampler.Configure(c.input_rate, c.output_rate);
+        std::vector<int16_t> input(c.chunk, 1000);
+        std::vector<int16_t> output(c.output + 1);
+        for (int i = 0; i < 50; i++) {
+            CHECK_EQ(resampler.GetOutputSamples(c.chunk), c.output);
+            output[c.output] = 0x5a5a;
+            resampler.Process(input.data(), c.chunk, output.data());
+            CHECK_EQ(output[c.output], 0x5a5a);
+        }
+    }
+
+    for (int input_rate : {24000, 48000}) {
+        AudioResampler resampler;
+        resampler.Configure(input_rate, 16000);
+        std::vector<int16_t> input(200, -1000);
+        std::vector<int16_t> output(201);
+        long total_input = 0;
+        long total_output = 0;
+        for (int i = 0; i < 1000; i++) {
+            int count = 1 + (i * 37) % 200;
+            int expected = resampler.GetOutputSamples(count);
+            output[expected] = 0x5a5a;
+            resampler.Process(input.data(), count, output.data());
+            CHECK_EQ(output[expected], 0x5a5a);
+            total_input += count;
+            total_output += expected;
+        }
+        long ideal = total_input * 16000 / input_rate;
+        CHECK(total_output >= ideal && total_output <= ideal + 1);
+    }
+}
+
+// The phase and history carry across calls, so the chunking does not change a single sample
+static void TestChunkingInvariance() {
+    auto input = Sine(24000, 1234, 500);
+    for (int i = 0; i < (int)input.size(); i += 7) {
+        input[i] = (int16_t)(input[i] / 2 + (i * 131) % 2000);
+    }
+    for (int output_rate : {16000, 48000}) {
+        AudioResampler whole;
+        whole.Configure(24000, output_rate);
+        std::vector<int16_t> expected(whole.GetOutputSamples(input.size()));
+        whole.Process(input.data(), input.size(), expected.data());
+
+        AudioResampler chunked;
+        chunked.Configure(24000, output_rate);
+        std::vector<int16_t> output;
+        size_t offset = 0;
+        for (int i = 0; offset < input.size(); i++) {
+            int count = std::min<size_t>(1 + (i * 53) % 300, input.size() - offset);
+            size_t start = output.size();
+            output.resize(start + chunked.GetOutputSamples(count));
+            chunked.Process(input.data() + offset, count, output.data() + start);
+            offset += count;
+        }
+        CHECK_EQ(output.size(), expected.size());
+        CHECK(output == expected);
+    }
+}
+
+int main() {
+    RUN_TEST(TestSineSnr);
+    RUN_TEST(TestAliasRejection);
+    RUN_TEST(TestOutputCounts);
+    RUN_TEST(TestChunkingInvariance);
+    return TEST_RESULT();
+}
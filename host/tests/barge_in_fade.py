@@ -0,0 +1,47 @@
+#!/usr/bin/env python3
+"""
+Runs xiaozhi_host through a turn aborted while speaking and checks the speaker file: the speech has to end in a
+fade, a jump from the speech level to silence is heard as a click.
+
+    python3 host/tests/barge_in_fade.py XIAOZHI_HOST OUTPUT_WAV
+"""
+import struct
+import subprocess
+import sys
+import wave
+
+SCRIPT = "expect idle; chat; expect speaking; wait 700; abort; wait 1500; quit"
+# Checked before the last sample that is not silence
+TAIL_MS = 30
+# Largest step between two samples of the tail, the speech is played at up to 16 bits
+MAX_STEP = 1000
+
+
+def main():
+    if len(sys.argv) < 3:
+        print(__doc__.strip(), file=sys.stderr)
+        return 2
+    result = subprocess.run([sys.argv[1], "--output", sys.argv[2], "--script", SCRIPT],
+                            stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True, timeout=60)
+    print(result.stdout, end="")
+    if result.returncode != 0 or "Barge-in: silent" not in result.stdout:
+        print("The turn was not aborted while speaking", file=sys.stderr)
+        return 1
+
+    with wave.open(sys.argv[2], "rb") as f:
+        rate = f.getframerate()
+        data = f.readframes(f.getnframes())
+    samples = struct.unpack(f"<{len(data) // 2}h", data)
+    end = max((i for i, value in enumerate(samples) if value != 0), default=-1)
+    if end < 0:
+        print("Nothing was played", file=sys.stderr)
+        return 1
+    # The step into the first silent sample counts too
+    tail = samples[max(0, end - rate * TAIL_MS // 1000):end + 1] + (0,)
+    step = max(abs(b - a) for a, b in zip(tail, tail[1:]))
+    print(f"Speech ends at {end * 1000 // rate} ms, largest step of the last {TAIL_MS} ms {step}")
+    return 0 if step <= MAX_STEP else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,46 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <cstdio>
+#include <cmath>
+
+// Minimal checks for the host tests run by ctest: a failed check is printed and the test exits with 1
+static int test_failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+    long long actual_value = (long long)(actual); \
+    long long expected_value = (long long)(expected); \
+    if (actual_value != expected_value) { \
+        fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #actual, #expected, \
+            actual_value, expected_value); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) do { \
+    double actual_value = (double)(actual); \
+    double expected_value = (double)(expected); \
+    if (std::fabs(actual_value - expected_value) > (tolerance)) { \
+        fprintf(stderr, "%s:%d: CHECK_NEAR(%s, %s, %s) failed: %g != %g\n", __FILE__, __LINE__, #actual, #expected, \
+            #tolerance, actual_value, expected_value); \
+        test_failures++; \
+    } \
+} while (0)
+
+// Runs a test function and reports it
+#define RUN_TEST(test) do { \
+    int failures_before = test_failures; \
+    test(); \
+    printf("%s %s\n", test_failures == failures_before ? "PASS" : "FAIL", #test); \
+} while (0)
+
+#define TEST_RESULT() (test_failures == 0 ? 0 : 1)
+
+#endif // HOST_TEST_H
@@ -0,0 +1,187 @@
+// JitterBuffer on scripted packet sequences: reordering, loss, late and duplicate packets, and the
+// playout depth it settles on for a given arrival jitter. The clock is set per packet, as in trace_replay.
+
+#include "host_test.h"
+#include "jitter_buffer.h"
+
+#include <esp_timer.h>
+
+#include <vector>
+#include <cstdint>
+
+#define SLOTS 16
+#define SLOT_SIZE 64
+#define FRAME_MS 60
+#define FRAME_US (FRAME_MS * 1000)
+
+// The payload is the sequence number, so the played order can be checked
+static void Put(JitterBuffer& buffer, uint32_t sequence, int64_t arrival_us) {
+    host_timer_set_time(arrival_us);
+    uint8_t payload[4] = {(uint8_t)sequence, (uint8_t)(sequence >> 8), (uint8_t)(sequence >> 16), (uint8_t)(sequence >> 24)};
+    buffer.Put(sequence, payload, sizeof(payload), arrival_us);
+}
+
+// Sequence of the packet played next, -1 for a concealed frame, -2 if nothing was due
+static int64_t Get(JitterBuffer& buffer) {
+    std::vector<uint8_t> packet;
+    if (!buffer.Get(packet)) {
+        return -2;
+    }
+    if (packet.empty()) {
+        return -1;
+    }
+    return packet[0] | packet[1] << 8 | packet[2] << 16 | (uint32_t)packet[3] << 24;
+}
+
+static void TestInOrder() {
+    JitterBuffer buffer(SLOTS, SLOT_SIZE);
+    buffer.Reset(FRAME_MS);
+    for (uint32_t i = 0; i < 20; i++) {
+        Put(buffer, 1000 + i, i * FRAME_US);
+        CHECK_EQ(Get(buffer), 1000 + i);
+    }
+    CHECK_EQ(Get(buffer), -2);
+    auto stats = buffer.GetStatistics();
+    CHECK_EQ(stats.received, 20);
+    CHECK_EQ(stats.played, 20);
+    CHECK_EQ(stats.concealed, 0);
+    CHECK_EQ(stats.underruns, 1);
+    CHECK_EQ(stats.jitter_ms, 0);
+    CHECK_EQ(stats.target_depth, 1);
+    CHECK_EQ(stats.buffered, 0);
+}
+
+static void TestReordered() {
+    JitterBuffer buffer(SLOTS, SLOT_SIZE);
+    buffer.Reset(FRAME_MS);
+    // A burst arriving out of order before playout starts is played in sequence order
+    const uint32_t order[] = {2, 0, 1, 4, 3, 5};
+    for (uint32_t sequence : order) {
+        Put(buffer, sequence, 0);
+    }
+    CHECK_EQ(buffer.GetStatistics().buffered, 6);
+    for (uint32_t i = 0; i < 6; i++) {
+        CHECK_EQ(Get(buffer), i);
+    }
+    auto stats = buffer.GetStatistics();
+    CHECK_EQ(stats.played, 6);
+    CHECK_EQ(stats.concealed, 0);
+    CHECK_EQ(stats.late, 0);
+
+    // Swapped while playing, the second one is still in time
+    Put(buffer, 7, 7 * FRAME_US);
+    Put(buffer, 6, 7 * FRAME_US);
+    CHECK_EQ(Get(buffer), 6);
+    CHECK_EQ(Get(buffer), 7);
+}
+
+static void TestLoss() {
+    JitterBuffer buffer(SLOTS, SLOT_SIZE);
+    buffer.Reset(FRAME_MS);
+    const uint32_t received[] = {0, 1, 3, 4, 7, 8};
+    for (uint32_t sequence : received) {
+        Put(buffer, sequence, sequence * FRAME_US);
+    }
+    // Each missing frame is concealed once
+    const int64_t expected[] = {0, 1, -1, 3, 4, -1, -1, 7, 8};
+    for (int64_t sequence : expected) {
+        CHECK_EQ(Get(buffer), sequence);
+    }
+    auto stats = buffer.GetStatistics();
+    CHECK_EQ(stats.received, 6);
+    CHECK_EQ(stats.played, 6);
+    CHECK_EQ(stats.concealed, 3);
+}
+
+static void TestLongGapIsSkipped() {
+    JitterBuffer buffer(SLOTS, SLOT_SIZE);
+    buffer.Reset(FRAME_MS);
+    Put(buffer, 0, 0);
+    Put(buffer, 10, 0);
+    CHECK_EQ(Get(buffer), 0);
+    // No more than three frames are concealed in a row, then playout jumps to the next packet
+    CHECK_EQ(Get(buffer), -1);
+    CHECK_EQ(Get(buffer), -1);
+    CHECK_EQ(Get(buffer), -1);
+    CHECK_EQ(Get(buffer), 10);
+    CHECK_EQ(buffer.GetStatistics().concealed, 3);
+}
+
+static void TestLateDuplicatedOverflowed() {
+    JitterBuffer buffer(SLOTS, SLOT_SIZE);
+    buffer.Reset(FRAME_MS);
+    for (uint32_t i = 0; i < 4; i++) {
+        Put(buffer, i, i * FRAME_US);
+    }
+    CHECK_EQ(Get(buffer), 0);
+    CHECK_EQ(Get(buffer), 1);
+    // Already played
+    Put(buffer, 1, 4 * FRAME_US);
+    // Already buffered
+    Put(buffer, 3, 4 * FRAME_US);
+    // Beyond the reorder window
+    Put(buffer, 2 + SLOTS, 4 * FRAME_US);
+    auto stats = buffer.GetStatistics();
+    CHECK_EQ(stats.received, 7);
+    CHECK_EQ(stats.late, 1);
+    CHECK_EQ(stats.duplicated, 1);
+    CHECK_EQ(stats.overflowed, 1);
+    CHECK_EQ(stats.buffered, 2);
+    CHECK_EQ(Get(buffer), 2);
+    CHECK_EQ(Get(buffer), 3);
+    CHECK_EQ(Get(buffer), -2);
+
+    // Clear drops everything, the next packet starts a new stream once it has waited for the target depth
+    Put(buffer, 50, 50 * FRAME_US);
+    buffer.Clear();
+    CHECK_EQ(buffer.GetStatistics().buffered, 0);
+    Put(buffer, 60, 60 * FRAME_US);
+    host_timer_set_time(60 * FRAME_US + SLOTS * FRAME_US);
+    CHECK_EQ(Get(buffer), 60);
+}
+
+static void TestDepthFollowsJitter() {
+    JitterBuffer buffer(SLOTS, SLOT_SIZE);
+    buffer.Reset(FRAME_MS);
+    // Every other packet arrives 20 ms late, so consecutive transit times differ by 20 ms
+    for (uint32_t i = 0; i < 200; i++) {
+        Put(buffer, i, i * FRAME_US + (i % 2) * 20000);
+        Get(buffer);
+    }
+    auto stats = buffer.GetStatistics();
+    CHECK_NEAR(stats.jitter_ms, 20, 2);
+    // One frame plus twice the jitter, in whole frames
+    CHECK_EQ(stats.target_depth, 2);
+
+    // A new stream holds the first packet back until the target depth is reached
+    buffer.Clear();
+    Put(buffer, 500, 500 * FRAME_US);
+    CHECK_EQ(Get(buffer), -2);
+    Put(buffer, 501, 501 * FRAME_US);
+    CHECK_EQ(Get(buffer), 500);
+
+    // Or until the packet has waited as long as the target depth lasts, at the end of a short stream
+    buffer.Clear();
+    Put(buffer, 600, 600 * FRAME_US);
+    host_timer_set_time(600 * FRAME_US + FRAME_US);
+    CHECK_EQ(Get(buffer), -2);
+    host_timer_set_time(600 * FRAME_US + 2 * FRAME_US);
+    CHECK_EQ(Get(buffer), 600);
+
+    // Reset forgets the jitter of the previous session
+    buffer.Reset(FRAME_MS);
+    stats = buffer.GetStatistics();
+    CHECK_EQ(stats.jitter_ms, 0);
+    CHECK_EQ(stats.target_depth, 1);
+    CHECK_EQ(stats.received, 0);
+}
+
+int main() {
+    RUN_TEST(TestInOrder);
+    RUN_TEST(TestReordered);
+    RUN_TEST(TestLoss);
+    RUN_TEST(TestLongGapIsSkipped);
+    RUN_TEST(TestLateDuplicatedOverflowed);
+    RUN_TEST(TestDepthFollowsJitter);
+    return TEST_RESULT();
+}
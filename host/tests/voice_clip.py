@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+"""
+Writes the microphone input of the xiaozhi_host tests: a second of quiet noise the voice detector takes as the
+floor, then a vowel (150 Hz with harmonics up to 3 kHz, as in voice_detector_test.cc) over the same noise.
+
+    python3 host/tests/voice_clip.py clip.wav [SECONDS]
+"""
+import math
+import random
+import struct
+import sys
+import wave
+
+SAMPLE_RATE = 16000
+NOISE = 60
+VOICE = 3000
+HARMONICS = 20
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__.strip(), file=sys.stderr)
+        return 2
+    seconds = int(sys.argv[2]) if len(sys.argv) > 2 else 8
+    noise = random.Random(1)
+    samples = []
+    for i in range(SAMPLE_RATE * (1 + seconds)):
+        value = noise.uniform(-NOISE, NOISE)
+        if i >= SAMPLE_RATE:
+            value += VOICE * sum(math.sin(2 * math.pi * 150 * k * i / SAMPLE_RATE) / k for k in range(1, HARMONICS + 1))
+        samples.append(max(-32768, min(32767, int(value))))
+    with wave.open(sys.argv[1], "wb") as f:
+        f.setnchannels(1)
+        f.setsampwidth(2)
+        f.setframerate(SAMPLE_RATE)
+        f.writeframes(struct.pack(f"<{len(samples)}h", *samples))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
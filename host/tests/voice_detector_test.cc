@@ -0,0 +1,174 @@
+// VoiceDetector on synthetic clips in the 30 ms chunks of the audio loop: voiced bursts over white noise and
+// mains hum with a DC offset, and hiss a little louder than the floor. The chunks sent and suppressed are
+// counted against what the onset and hangover rules give.
+
+#include "host_test.h"
+#include "voice_detector.h"
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#define SAMPLE_RATE 16000
+#define CHUNK_MS 30
+#define CHUNK_SAMPLES (SAMPLE_RATE * CHUNK_MS / 1000)
+// Chunks a burst is held for after its last voiced chunk: the 500 ms hangover counted down by 30 ms
+#define HANGOVER_CHUNKS 16
+
+// Deterministic white noise, so the counts do not depend on the run
+class Noise {
+public:
+    // Uniform samples with the given RMS in dBFS
+    int16_t Next(double level_db) {
+        state_ = state_ * 1664525u + 1013904223u;
+        double uniform = (double)(state_ >> 8) / (1u << 24) * 2.0 - 1.0;
+        return (int16_t)std::lround(uniform * std::sqrt(3.0) * Amplitude(level_db));
+    }
+    static double Amplitude(double level_db) { return 32768.0 * std::pow(10.0, level_db / 20.0); }
+
+private:
+    uint32_t state_ = 12345;
+};
+
+struct Clip {
+    std::vector<int16_t> samples;
+    Noise noise;
+    double phase = 0;  // of the hum, continuous across segments
+
+    // Background of white noise, 50 Hz hum and a DC offset, as a cheap microphone picks up
+    void Background(int chunks, double noise_db, double hum_db, int dc) {
+        for (int i = 0; i < chunks * CHUNK_SAMPLES; i++) {
+            samples.push_back(Mix(noise_db, hum_db, dc, 0));
+        }
+    }
+
+    // A vowel on top of the background: 150 Hz with harmonics falling off up to 3 kHz
+    void Voiced(int chunks, double voice_db, double noise_db, double hum_db, int dc) {
+        const int harmonics = 20;
+        double norm = 0;
+        for (int k = 1; k <= harmonics; k++) {
+            norm += 0.5 / (k * k);
+        }
+        double scale = Noise::Amplitude(voice_db) / std::sqrt(norm);
+        for (int i = 0; i < chunks * CHUNK_SAMPLES; i++) {
+            double voice = 0;
+            for (int k = 1; k <= harmonics; k++) {
+                voice += std::sin(2.0 * M_PI * 150.0 * k * i / SAMPLE_RATE) / k;
+            }
+            samples.push_back(Mix(noise_db, hum_db, dc, voice * scale));
+        }
+    }
+
+    int16_t Mix(double noise_db, double hum_db, int dc, double extra) {
+        double hum = hum_db > -120 ? std::sqrt(2.0) * Noise::Amplitude(hum_db) * std::sin(phase) : 0;
+        phase += 2.0 * M_PI * 50.0 / SAMPLE_RATE;
+        double value = noise.Next(noise_db) + hum + dc + extra;
+        return (int16_t)std::clamp(value, -32768.0, 32767.0);
+    }
+};
+
+struct Result {
+    int sent = 0;
+    int suppressed = 0;
+    int on = 0;
+    int off = 0;
+};
+
+static Result Run(VoiceDetector& detector, const Clip& clip) {
+    Result result;
+    detector.OnStateChange([&result](bool speaking) {
+        (speaking ? result.on : result.off)++;
+    });
+    for (size_t offset = 0; offset + CHUNK_SAMPLES <= clip.samples.size(); offset += CHUNK_SAMPLES) {
+        if (detector.Process(clip.samples.data() + offset, CHUNK_SAMPLES)) {
+            result.sent++;
+        } else {
+            result.suppressed++;
+        }
+    }
+    return result;
+}
+
+static void TestVoicedBurstsOverNoiseAndHum() {
+    const double noise_db = -50, hum_db = -40, voice_db = -20;
+    const int dc = 400;
+    const int lead = 67, burst = 20, gap = 34, bursts = 3;
+    Clip clip;
+    clip.Background(lead, noise_db, hum_db, dc);
+    for (int i = 0; i < bursts; i++) {
+        clip.Voiced(burst, voice_db, noise_db, hum_db, dc);
+        clip.Background(gap, noise_db, hum_db, dc);
+    }
+
+    VoiceDetector detector(SAMPLE_RATE);
+    auto result = Run(detector, clip);
+    int total = lead + bursts * (burst + gap);
+    // Every voiced chunk is sent, then the hangover, the rest of each gap and the lead-in are suppressed
+    int sent = bursts * (burst + HANGOVER_CHUNKS);
+    CHECK_EQ(result.sent + result.suppressed, total);
+    CHECK_EQ(result.sent, sent);
+    CHECK_EQ(result.suppressed, total - sent);
+    CHECK_EQ(result.on, bursts);
+    CHECK_EQ(result.off, bursts);
+    CHECK_EQ(detector.GetStatistics().chunks, total);
+    CHECK_EQ(detector.GetStatistics().voice_chunks, bursts * burst);
+    // The floor settled on the background, the DC offset is not part of it
+    CHECK_NEAR(detector.noise_floor_db(), -39.6, 1.5);
+    CHECK(!detector.speaking());
+}
+
+// The onset needs 60 ms of voice, a single loud chunk is sent but does not start speech
+static void TestShortClick() {
+    Clip clip;
+    clip.Background(20, -50, -120, 0);
+    clip.Voiced(1, -20, -50, -120, 0);
+    clip.Background(20, -50, -120, 0);
+    VoiceDetector detector(SAMPLE_RATE);
+    auto result = Run(detector, clip);
+    CHECK_EQ(result.sent, 1);
+    CHECK_EQ(result.suppressed, 40);
+    CHECK_EQ(result.on, 0);
+
+    // Reset starts over: the floor is taken again from the first chunk
+    detector.Reset();
+    CHECK_EQ(detector.GetStatistics().chunks, 0);
+    Clip loud;
+    loud.Background(10, -30, -120, 0);
+    result = Run(detector, loud);
+    CHECK_EQ(result.sent, 0);
+    CHECK_NEAR(detector.noise_floor_db(), -30, 1);
+}
+
+// Hiss 8 dB over the floor is above the weak margin but crosses zero too often for voice, and a hum that is
+// there from the start is the floor. A vowel at the same 8 dB over the floor does count.
+static void TestHissAndWeakVoice() {
+    Clip clip;
+    clip.Background(30, -55, -120, 0);
+    clip.Background(30, -47, -120, 0);
+    VoiceDetector detector(SAMPLE_RATE);
+    auto result = Run(detector, clip);
+    CHECK_EQ(result.sent, 0);
+    CHECK_EQ(result.on, 0);
+
+    Clip hum;
+    hum.Background(60, -70, -30, 200);
+    VoiceDetector hum_detector(SAMPLE_RATE);
+    result = Run(hum_detector, hum);
+    CHECK_EQ(result.sent, 0);
+
+    Clip weak;
+    weak.Background(30, -55, -120, 0);
+    weak.Voiced(10, -48, -55, -120, 0);
+    VoiceDetector weak_detector(SAMPLE_RATE);
+    result = Run(weak_detector, weak);
+    CHECK_EQ(result.sent, 10);
+    CHECK_EQ(result.on, 1);
+}
+
+int main() {
+    RUN_TEST(TestVoicedBurstsOverNoiseAndHum);
+    RUN_TEST(TestShortClick);
+    RUN_TEST(TestHissAndWeakVoice);
+    return TEST_RESULT();
+}
@@ -0,0 +1,44 @@
+#ifndef HOST_ALLOCATION_COUNTER_H
+#define HOST_ALLOCATION_COUNTER_H
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+#include <cstdint>
+
+// Counts the heap allocations of a benchmark through the global operator new and new[], include it in one
+// source only
+static std::atomic<uint64_t> allocations{0};
+
+// None of them is inlined, GCC would see malloc paired with operator delete, or operator new with free,
+// and warn of a mismatch
+__attribute__((noinline)) void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = malloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+__attribute__((noinline)) void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+__attribute__((noinline)) void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+__attribute__((noinline)) void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+__attribute__((noinline)) void operator delete[](void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+#endif // HOST_ALLOCATION_COUNTER_H
@@ -0,0 +1,281 @@
+// Benchmarks the PCM kernels of audio_codecs/audio_kernels.h on the host against the code they replaced.
+//
+//   read_audio   the input path of Application::ReadAudio for 1, 2 and 4 channel captures at 24 kHz resampled
+//                to 16 kHz: persistent buffers and the deinterleave/interleave kernels, against the vectors
+//                allocated per chunk before. Reports ns per input frame and heap allocations per chunk.
+//   write_gain   the volume of NoAudioCodec::Write: ScalePcm16To32 into a persistent buffer, against the
+//                vector per write and the clamped 64-bit product of before. Reports ns per sample.
+//   read_shift   the conversion of NoAudioCodec::Read: ShiftSaturatePcm32To16 from the persistent DMA buffer,
+//                against the vector per read and the nested ternary of before. The input is a raw dump of
+//                32-bit I2S slots when I2S_DUMP is given, a synthetic capture that also clips otherwise.
+//
+// usage: audio_kernels_bench [CHUNKS [I2S_DUMP]]
+
+#include "audio_kernels.h"
+#include "audio_resampler.h"
+#include "allocation_counter.h"
+
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+
+// 30 ms chunks of the audio loop
+#define INPUT_SAMPLE_RATE 24000
+#define OUTPUT_SAMPLE_RATE 16000
+#define CHUNK_MS 30
+#define MAX_CHANNELS 4
+
+struct Result {
+    double ns_per_frame;
+    double allocations_per_chunk;
+};
+
+template <typename Function>
+static Result Measure(int chunks, size_t frames_per_chunk, Function function) {
+    // One round to size the persistent buffers first, as the firmware does on its first chunk
+    function();
+    uint64_t start_allocations = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < chunks; i++) {
+        function();
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return Result{ns / chunks / frames_per_chunk, (double)(allocations.load() - start_allocations) / chunks};
+}
+
+// A few tones per channel, so the resampler filters real signal
+static void FillCapture(std::vector<int16_t>& capture, int channels, size_t frames) {
+    capture.resize(frames * channels);
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < channels; c++) {
+            capture[i * channels + c] = (int16_t)(((i * (c + 3) * 97) % 20000) - 10000);
+        }
+    }
+}
+
+// The ReadAudio of before: a vector per channel and per resampled channel, allocated for every chunk
+static void ReadAudioPerChunk(const std::vector<int16_t>& capture, int channels, AudioResampler* resamplers,
+    std::vector<int16_t>& data) {
+    size_t frames = capture.size() / channels;
+    std::vector<std::vector<int16_t>> planes(channels, std::vector<int16_t>(frames));
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < channels; c++) {
+            planes[c][i] = capture[i * channels + c];
+        }
+    }
+    std::vector<std::vector<int16_t>> resampled(channels);
+    for (int c = 0; c < channels; c++) {
+        resampled[c] = std::vector<int16_t>(resamplers[c].GetOutputSamples(frames));
+        resamplers[c].Process(planes[c].data(), frames, resampled[c].data());
+    }
+    size_t resampled_frames = resampled[0].size();
+    data = std::vector<int16_t>(resampled_frames * channels);
+    for (size_t i = 0; i < resampled_frames; i++) {
+        for (int c = 0; c < channels; c++) {
+            data[i * channels + c] = resampled[c][i];
+        }
+    }
+}
+
+// The ReadAudio of now, with the buffers kept across calls
+struct ReadAudioPipeline {
+    std::vector<int16_t> planar_buffer;
+    std::vector<int16_t> planar_resampled_buffer;
+
+    void Read(const std::vector<int16_t>& capture, int channels, AudioResampler* resamplers, std::vector<int16_t>& data) {
+        int frames = capture.size() / channels;
+        int resampled_frames = resamplers[0].GetOutputSamples(frames);
+        data.resize(resampled_frames * channels);
+        if (channels == 1) {
+            resamplers[0].Process(capture.data(), frames, data.data());
+            return;
+        }
+        planar_buffer.resize(frames * channels);
+        planar_resampled_buffer.resize(resampled_frames * channels);
+        DeinterleavePcm(capture.data(), planar_buffer.data(), channels, frames);
+        for (int c = 0; c < channels; c++) {
+            resamplers[c].Process(planar_buffer.data() + c * frames, frames,
+                planar_resampled_buffer.data() + c * resampled_frames);
+        }
+        InterleavePcm(planar_resampled_buffer.data(), data.data(), channels, resampled_frames);
+    }
+};
+
+// NoAudioCodec::Write before the kernel, without the i2s_channel_write
+static void WriteGainPerCall(const int16_t* data, int samples, int volume, std::vector<int32_t>& written) {
+    std::vector<int32_t> buffer(samples);
+    int32_t volume_factor = pow(double(volume) / 100.0, 2) * 65536;
+    for (int i = 0; i < samples; i++) {
+        int64_t temp = int64_t(data[i]) * volume_factor;
+        if (temp > INT32_MAX) {
+            buffer[i] = INT32_MAX;
+        } else if (temp < INT32_MIN) {
+            buffer[i] = INT32_MIN;
+        } else {
+            buffer[i] = static_cast<int32_t>(temp);
+        }
+    }
+    written.swap(buffer);
+}
+
+static bool BenchWriteGain(int chunks) {
+    // 20 ms chunks of the decode task at 24 kHz, written in DMA sized pieces like NoAudioCodec::Write
+    const int samples = 480;
+    const int piece = 240 * 2;
+    const int volume = 70;
+    std::vector<int16_t> pcm(samples);
+    for (int i = 0; i < samples; i++) {
+        pcm[i] = (int16_t)(((i * 131) % 65536) - 32768);
+    }
+    std::vector<int32_t> old_output;
+    std::vector<int32_t> new_output(piece);
+    int32_t gain = pow(double(volume) / 100.0, 2) * 65536;
+
+    auto old_result = Measure(chunks, samples, [&]() {
+        WriteGainPerCall(pcm.data(), samples, volume, old_output);
+    });
+    auto new_result = Measure(chunks, samples, [&]() {
+        for (int offset = 0; offset < samples; offset += piece) {
+            int count = std::min(piece, samples - offset);
+            ScalePcm16To32(pcm.data() + offset, new_output.data(), gain, count);
+        }
+    });
+    printf("write_gain       %12s %16s\n", "ns/sample", "allocs/write");
+    printf("  per call       %12.2f %16.2f\n", old_result.ns_per_frame, old_result.allocations_per_chunk);
+    printf("  kernel         %12.2f %16.2f\n", new_result.ns_per_frame, new_result.allocations_per_chunk);
+    return std::equal(new_output.begin(), new_output.begin() + samples, old_output.begin());
+}
+
+// NoAudioCodec::Read before the kernel, the i2s_channel_read replaced by a copy from the capture
+static void ReadShiftPerCall(const int32_t* slots, int16_t* dest, int samples) {
+    std::vector<int32_t> bit32_buffer(slots, slots + samples);
+    for (int i = 0; i < samples; i++) {
+        int32_t value = bit32_buffer[i] >> 12;
+        dest[i] = (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
+    }
+}
+
+static bool LoadI2sDump(const char* path, std::vector<int32_t>& slots) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    int32_t buffer[1024];
+    size_t count;
+    while ((count = fread(buffer, sizeof(int32_t), 1024, file)) > 0) {
+        slots.insert(slots.end(), buffer, buffer + count);
+    }
+    fclose(file);
+    return !slots.empty();
+}
+
+static bool BenchReadShift(int chunks, const char* dump_path) {
+    // 30 ms reads of the audio loop at 16 kHz, converted in DMA sized pieces like NoAudioCodec::Read
+    const int samples = 480;
+    const int piece = 240 * 2;
+    std::vector<int32_t> slots;
+    if (dump_path != nullptr) {
+        if (!LoadI2sDump(dump_path, slots)) {
+            fprintf(stderr, "Cannot read %s\n", dump_path);
+            return false;
+        }
+    } else {
+        // Speech level tones with a loud stretch that clips, in the upper bits as the microphones deliver them
+        slots.resize(samples * 16);
+        for (size_t i = 0; i < slots.size(); i++) {
+            double level = (i / samples) % 4 == 3 ? 1.5 : 0.2;
+            slots[i] = (int32_t)(level * 32767.0 * 4096.0 * sin(i * 0.05) + (int32_t)((i * 7919) % 4096));
+        }
+    }
+    size_t chunk_count = slots.size() / samples;
+    if (chunk_count == 0) {
+        fprintf(stderr, "The dump is shorter than one read\n");
+        return false;
+    }
+    std::vector<int16_t> old_output(samples);
+    std::vector<int16_t> new_output(samples);
+    std::vector<int32_t> dma_buffer(piece);
+    size_t old_chunk = 0;
+    size_t new_chunk = 0;
+
+    auto old_result = Measure(chunks, samples, [&]() {
+        ReadShiftPerCall(slots.data() + (old_chunk++ % chunk_count) * samples, old_output.data(), samples);
+    });
+    auto new_result = Measure(chunks, samples, [&]() {
+        const int32_t* read = slots.data() + (new_chunk++ % chunk_count) * samples;
+        for (int offset = 0; offset < samples; offset += piece) {
+            int count = std::min(piece, samples - offset);
+            std::copy(read + offset, read + offset + count, dma_buffer.begin());
+            ShiftSaturatePcm32To16(dma_buffer.data(), new_output.data() + offset, 12, count);
+        }
+    });
+    printf("read_shift       %12s %16s\n", "ns/sample", "allocs/read");
+    printf("  per call       %12.2f %16.2f\n", old_result.ns_per_frame, old_result.allocations_per_chunk);
+    printf("  kernel         %12.2f %16.2f\n", new_result.ns_per_frame, new_result.allocations_per_chunk);
+
+    // Every read of the capture, not only the last one measured
+    for (size_t c = 0; c < chunk_count; c++) {
+        ReadShiftPerCall(slots.data() + c * samples, old_output.data(), samples);
+        ShiftSaturatePcm32To16(slots.data() + c * samples, new_output.data(), 12, samples);
+        if (old_output != new_output) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool BenchReadAudio(int chunks) {
+    printf("read_audio       %-10s %12s %16s\n", "channels", "ns/frame", "allocs/chunk");
+    bool ok = true;
+    size_t frames = INPUT_SAMPLE_RATE * CHUNK_MS / 1000;
+    for (int channels : {1, 2, 4}) {
+        std::vector<int16_t> capture;
+        FillCapture(capture, channels, frames);
+
+        AudioResampler old_resamplers[MAX_CHANNELS];
+        AudioResampler new_resamplers[MAX_CHANNELS];
+        for (int c = 0; c < channels; c++) {
+            old_resamplers[c].Configure(INPUT_SAMPLE_RATE, OUTPUT_SAMPLE_RATE);
+            new_resamplers[c].Configure(INPUT_SAMPLE_RATE, OUTPUT_SAMPLE_RATE);
+        }
+        std::vector<int16_t> old_data;
+        std::vector<int16_t> new_data;
+        ReadAudioPipeline pipeline;
+        auto old_result = Measure(chunks, frames, [&]() {
+            ReadAudioPerChunk(capture, channels, old_resamplers, old_data);
+        });
+        auto new_result = Measure(chunks, frames, [&]() {
+            pipeline.Read(capture, channels, new_resamplers, new_data);
+        });
+        // Both ran the same number of chunks through resamplers of the same state, the output must match
+        ok = ok && old_data == new_data;
+        printf("  per chunk      %-10d %12.2f %16.2f\n", channels, old_result.ns_per_frame, old_result.allocations_per_chunk);
+        printf("  persistent     %-10d %12.2f %16.2f\n", channels, new_result.ns_per_frame, new_result.allocations_per_chunk);
+    }
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    int chunks = argc > 1 ? atoi(argv[1]) : 20000;
+    if (chunks <= 0) {
+        fprintf(stderr, "usage: %s [CHUNKS [I2S_DUMP]]\n", argv[0]);
+        return 2;
+    }
+    if (!BenchReadAudio(chunks)) {
+        fprintf(stderr, "read_audio: the outputs differ\n");
+        return 1;
+    }
+    if (!BenchWriteGain(chunks)) {
+        fprintf(stderr, "write_gain: the outputs differ\n");
+        return 1;
+    }
+    if (!BenchReadShift(chunks, argc > 2 ? argv[2] : nullptr)) {
+        fprintf(stderr, "read_shift: the outputs differ\n");
+        return 1;
+    }
+    return 0;
+}
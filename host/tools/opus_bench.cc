@@ -0,0 +1,130 @@
+// Sweeps the opus encoder and decoder over sample rates, frame durations, complexities and bitrates with
+// the same code as the opus_bench console command of the firmware (CONFIG_USE_OPUS_BENCHMARK).
+// Times are for this machine; compare configurations with each other, and take the numbers for the
+// initial complexities in Application::Start from the device.
+//
+// usage: opus_bench [-r 16000,24000] [-d 20,60] [-c 0,3,5] [-b 0,16000] [--csv] CLIP.wav|CLIP.p3...
+// WAV clips are 16 bit PCM of any rate and channel count, p3 clips are the firmware sounds in main/assets.
+
+#include "opus_benchmark.h"
+
+#include <malloc.h>
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+static bool ReadFile(const std::string& path, std::vector<char>& data) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    char buffer[65536];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + size);
+    }
+    fclose(file);
+    return true;
+}
+
+// The fmt and data chunks of a 16 bit PCM file, mixed down to mono
+static bool LoadWav(const std::vector<char>& data, std::vector<int16_t>& pcm, int& sample_rate) {
+    if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) != 0 || memcmp(data.data() + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+    int channels = 0;
+    size_t offset = 12;
+    while (offset + 8 <= data.size()) {
+        uint32_t chunk_size;
+        memcpy(&chunk_size, data.data() + offset + 4, 4);
+        const char* chunk = data.data() + offset + 8;
+        size_t available = std::min<size_t>(chunk_size, data.size() - offset - 8);
+        if (memcmp(data.data() + offset, "fmt ", 4) == 0 && available >= 16) {
+            uint16_t format, channel_count, bits;
+            uint32_t rate;
+            memcpy(&format, chunk, 2);
+            memcpy(&channel_count, chunk + 2, 2);
+            memcpy(&rate, chunk + 4, 4);
+            memcpy(&bits, chunk + 14, 2);
+            if (format != 1 || bits != 16 || channel_count == 0) {
+                return false;
+            }
+            channels = channel_count;
+            sample_rate = rate;
+        } else if (memcmp(data.data() + offset, "data", 4) == 0 && channels > 0) {
+            size_t frames = available / sizeof(int16_t) / channels;
+            const int16_t* samples = (const int16_t*)chunk;
+            pcm.resize(frames);
+            for (size_t i = 0; i < frames; i++) {
+                int sum = 0;
+                for (int c = 0; c < channels; c++) {
+                    sum += samples[i * channels + c];
+                }
+                pcm[i] = sum / channels;
+            }
+            return true;
+        }
+        offset += 8 + chunk_size + (chunk_size & 1);
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    // One malloc arena, so the heap figures of the benchmark task are accounted for
+    mallopt(M_ARENA_MAX, 1);
+
+    std::vector<int> sample_rates = {16000, 24000};
+    std::vector<int> durations = {20, 60};
+    std::vector<int> complexities = {0, 3, 5};
+    std::vector<int> bitrates = {0};
+    bool csv = false;
+    OpusBenchmark benchmark;
+    bool usage = false;
+    for (int i = 1; i < argc && !usage; i++) {
+        std::string arg = argv[i];
+        std::vector<int>* list = arg == "-r" ? &sample_rates : arg == "-d" ? &durations
+            : arg == "-c" ? &complexities : arg == "-b" ? &bitrates : nullptr;
+        if (list != nullptr) {
+            usage = i + 1 >= argc || !OpusBenchmark::ParseList(argv[++i], *list);
+        } else if (arg == "--csv") {
+            csv = true;
+        } else if (arg[0] != '-') {
+            std::vector<char> data;
+            if (!ReadFile(arg, data)) {
+                fprintf(stderr, "Cannot open %s\n", arg.c_str());
+                return 2;
+            }
+            std::vector<int16_t> pcm;
+            int sample_rate = 0;
+            if (arg.size() > 3 && arg.compare(arg.size() - 3, 3, ".p3") == 0) {
+                if (!benchmark.AddP3Clip(std::string_view(data.data(), data.size()))) {
+                    fprintf(stderr, "%s has no opus frames\n", arg.c_str());
+                    return 2;
+                }
+            } else if (LoadWav(data, pcm, sample_rate)) {
+                benchmark.AddClip(std::move(pcm), sample_rate);
+            } else {
+                fprintf(stderr, "%s is not a 16 bit PCM WAV file\n", arg.c_str());
+                return 2;
+            }
+        } else {
+            usage = true;
+        }
+    }
+    if (usage || !benchmark.HasClips()) {
+        fprintf(stderr, "usage: %s [-r 16000,24000] [-d 20,60] [-c 0,3,5] [-b 0,16000] [--csv] CLIP.wav|CLIP.p3...\n",
+            argv[0]);
+        return 2;
+    }
+
+    auto results = benchmark.Sweep(sample_rates, durations, complexities, bitrates, csv);
+    for (auto& result : results) {
+        if (!result.ok) {
+            return 1;
+        }
+    }
+    return 0;
+}
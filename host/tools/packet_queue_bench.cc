@@ -0,0 +1,135 @@
+// Compares the hand-off of incoming opus packets from the network task to the decode task:
+// the std::list of vectors behind a mutex the decode queue used to be, and the AudioPacketQueue ring.
+// A producer thread pushes packets of speech-like sizes while a consumer thread pops them, the push
+// latency percentiles are what the network callback pays, the allocations are counted for both sides.
+//
+// usage: packet_queue_bench [PACKETS]
+
+#include "audio_packet_queue.h"
+#include "allocation_counter.h"
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+
+#define PACKET_SLOTS 32
+#define PACKET_MAX_SIZE 1024
+
+class ListQueue {
+public:
+    bool Push(const uint8_t* data, size_t size) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.size() >= PACKET_SLOTS) {
+            return false;
+        }
+        queue_.emplace_back(data, data + size);
+        return true;
+    }
+    bool Pop(std::vector<uint8_t>& packet) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.empty()) {
+            return false;
+        }
+        packet = std::move(queue_.front());
+        queue_.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::list<std::vector<uint8_t>> queue_;
+};
+
+class RingQueue {
+public:
+    bool Push(const uint8_t* data, size_t size) { return queue_.Push(data, size); }
+    bool Pop(std::vector<uint8_t>& packet) { return queue_.Pop(packet); }
+
+private:
+    AudioPacketQueue queue_{PACKET_SLOTS, PACKET_MAX_SIZE};
+};
+
+template <typename Queue>
+static bool Run(const char* name, int packets) {
+    Queue queue;
+    std::vector<uint8_t> payload(PACKET_MAX_SIZE);
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = i * 131;
+    }
+    std::vector<uint32_t> push_ns(packets);
+    std::atomic<bool> done{false};
+    uint64_t received = 0;
+    uint64_t bytes = 0;
+
+    uint64_t start_allocations = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&]() {
+        std::vector<uint8_t> packet;
+        packet.reserve(PACKET_MAX_SIZE);
+        while (true) {
+            if (queue.Pop(packet)) {
+                received++;
+                bytes += packet.size();
+            } else if (done.load(std::memory_order_acquire)) {
+                if (!queue.Pop(packet)) {
+                    break;
+                }
+                received++;
+                bytes += packet.size();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint64_t full = 0;
+    uint64_t sent_bytes = 0;
+    for (int i = 0; i < packets; i++) {
+        // 60 ms opus packets of the TTS stream are a few hundred bytes
+        size_t size = 80 + (i * 37) % 320;
+        while (true) {
+            auto t0 = std::chrono::steady_clock::now();
+            bool pushed = queue.Push(payload.data(), size);
+            auto t1 = std::chrono::steady_clock::now();
+            if (pushed) {
+                push_ns[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+                break;
+            }
+            full++;
+            std::this_thread::yield();
+        }
+        sent_bytes += size;
+    }
+    done.store(true, std::memory_order_release);
+    consumer.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocated = allocations.load() - start_allocations;
+
+    std::sort(push_ns.begin(), push_ns.end());
+    printf("%-12s push p50 %5u ns p99 %6u ns max %8u ns, %6.2f allocs/packet, %8.0f packets/s, full %llu\n",
+        name, push_ns[packets / 2], push_ns[packets * 99 / 100], push_ns[packets - 1],
+        (double)allocated / packets, packets / seconds, (unsigned long long)full);
+    return received == (uint64_t)packets && bytes == sent_bytes;
+}
+
+int main(int argc, char** argv) {
+    int packets = argc > 1 ? atoi(argv[1]) : 200000;
+    if (packets <= 0) {
+        fprintf(stderr, "usage: %s [PACKETS]\n", argv[0]);
+        return 2;
+    }
+    bool ok = Run<ListQueue>("list+mutex", packets);
+    ok = Run<RingQueue>("spsc ring", packets) && ok;
+    if (!ok) {
+        fprintf(stderr, "Packets were lost or corrupted\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+// Benchmarks AudioResampler on the host for the ratios of the audio paths, in the 30 ms chunks they use.
+// The host OpusResampler interpolates linearly instead of running the SILK resampler of the component,
+// so its figures only bound the cost of the fallback from below. Reports ns per output sample.
+//
+// usage: resampler_bench [CHUNKS]
+
+#include "audio_resampler.h"
+
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+#define CHUNK_MS 30
+
+template <typename Resampler>
+static double Measure(Resampler& resampler, const std::vector<int16_t>& input, int chunks, int64_t& checksum) {
+    std::vector<int16_t> output(resampler.GetOutputSamples(input.size()) + 1);
+    // One chunk first, so the buffers of the resampler are sized
+    resampler.Process(input.data(), input.size(), output.data());
+    int64_t samples = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < chunks; i++) {
+        int count = resampler.GetOutputSamples(input.size());
+        resampler.Process(input.data(), input.size(), output.data());
+        samples += count;
+        checksum += output[count / 2];
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return ns / samples;
+}
+
+int main(int argc, char** argv) {
+    int chunks = argc > 1 ? atoi(argv[1]) : 5000;
+    if (chunks <= 0) {
+        fprintf(stderr, "usage: %s [CHUNKS]\n", argv[0]);
+        return 2;
+    }
+    const int ratios[][2] = {{24000, 16000}, {48000, 16000}, {16000, 24000}, {24000, 48000}, {8000, 16000}};
+    int64_t checksum = 0;
+    printf("%-16s %8s %14s %14s\n", "ratio", "taps", "polyphase ns", "fallback ns");
+    for (auto& ratio : ratios) {
+        std::vector<int16_t> input(ratio[0] * CHUNK_MS / 1000);
+        for (size_t i = 0; i < input.size(); i++) {
+            input[i] = (int16_t)(8000 * std::sin(i * 0.13) + 2000 * std::sin(i * 1.7));
+        }
+        AudioResampler polyphase;
+        polyphase.Configure(ratio[0], ratio[1]);
+        OpusResampler fallback;
+        fallback.Configure(ratio[0], ratio[1]);
+        double polyphase_ns = Measure(polyphase, input, chunks, checksum);
+        double fallback_ns = Measure(fallback, input, chunks, checksum);
+        char name[32];
+        snprintf(name, sizeof(name), "%d -> %d", ratio[0], ratio[1]);
+        printf("%-16s %8d %14.2f %14.2f\n", name, polyphase.taps(), polyphase_ns, fallback_ns);
+    }
+    // Keeps the outputs alive
+    fprintf(stderr, "checksum %lld\n", (long long)checksum);
+    return 0;
+}
@@ -0,0 +1,166 @@
+// Compares the queues of Application::Schedule: the std::list of std::function behind a mutex that the main
+// loop used to swap out, and the TaskRing. Producer threads schedule small lambdas like the network, audio
+// and timer callbacks do, while a consumer thread drains them like MainEventLoop. Reports the push latency
+// percentiles, the throughput and the heap allocations per task, and checks that every task ran once and
+// in the order of its producer.
+//
+//   paced   each producer has at most PACED_OUTSTANDING tasks waiting, the main loop keeps up as it does
+//           on the device
+//   burst   the producers push as fast as they can, the ring fills up and the tasks take the overflow list
+//
+// usage: task_ring_bench [TASKS [PRODUCERS]]
+
+#include "task_ring.h"
+#include "allocation_counter.h"
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+#define RING_SIZE 32
+#define MAX_PRODUCERS 8
+#define PACED_OUTSTANDING 4
+
+class ListScheduler {
+public:
+    template <typename F>
+    void Push(F&& callable) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::function<void()>(std::forward<F>(callable)));
+    }
+    void Drain() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        std::list<std::function<void()>> tasks = std::move(tasks_);
+        lock.unlock();
+        for (auto& task : tasks) {
+            task();
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::list<std::function<void()>> tasks_;
+};
+
+class RingScheduler {
+public:
+    template <typename F>
+    void Push(F&& callable) { ring_.Push(std::forward<F>(callable)); }
+    void Drain() { ring_.Drain(); }
+    TaskRing::Statistics GetStatistics() const { return ring_.GetStatistics(); }
+
+private:
+    TaskRing ring_{RING_SIZE};
+};
+
+// What the tasks touch, only the consumer writes it, the paced producers read how far it got
+struct Consumer {
+    std::atomic<uint32_t> next[MAX_PRODUCERS] = {};
+    uint64_t ran = 0;
+    uint64_t out_of_order = 0;
+
+    void Run(int producer, uint32_t sequence) {
+        if (next[producer].load(std::memory_order_relaxed) != sequence) {
+            out_of_order++;
+        }
+        next[producer].store(sequence + 1, std::memory_order_release);
+        ran++;
+    }
+};
+
+template <typename Scheduler>
+static bool Run(const char* name, int tasks, int producers, bool paced, Scheduler& scheduler) {
+    Consumer consumer;
+    std::atomic<int> pending{0};
+    std::atomic<bool> done{false};
+    int per_producer = tasks / producers;
+    std::vector<std::vector<uint32_t>> push_ns(producers, std::vector<uint32_t>(per_producer));
+
+    uint64_t start_allocations = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    // The event group of the main loop, reduced to a counter the consumer polls
+    std::thread drainer([&]() {
+        while (!done.load(std::memory_order_acquire) || pending.load(std::memory_order_acquire) > 0) {
+            if (pending.exchange(0, std::memory_order_acq_rel) > 0) {
+                scheduler.Drain();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        scheduler.Drain();
+    });
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&, p]() {
+            for (int i = 0; i < per_producer; i++) {
+                while (paced && i - consumer.next[p].load(std::memory_order_acquire) >= PACED_OUTSTANDING) {
+                    std::this_thread::yield();
+                }
+                auto t0 = std::chrono::steady_clock::now();
+                // A pointer and two ints, like Schedule([this, ...]) in the application
+                scheduler.Push([&consumer, p, i]() {
+                    consumer.Run(p, i);
+                });
+                auto t1 = std::chrono::steady_clock::now();
+                pending.fetch_add(1, std::memory_order_release);
+                push_ns[p][i] = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    done.store(true, std::memory_order_release);
+    drainer.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocated = allocations.load() - start_allocations;
+
+    std::vector<uint32_t> all;
+    for (auto& latencies : push_ns) {
+        all.insert(all.end(), latencies.begin(), latencies.end());
+    }
+    std::sort(all.begin(), all.end());
+    size_t total = all.size();
+    printf("%-18s push p50 %5u ns p99 %6u ns max %8u ns, %6.2f allocs/task, %9.0f tasks/s\n",
+        name, all[total / 2], all[total * 99 / 100], all[total - 1],
+        (double)allocated / total, total / seconds);
+    return consumer.ran == total && consumer.out_of_order == 0;
+}
+
+int main(int argc, char** argv) {
+    int tasks = argc > 1 ? atoi(argv[1]) : 100000;
+    int producers = argc > 2 ? atoi(argv[2]) : 3;
+    if (tasks <= 0 || producers <= 0 || producers > MAX_PRODUCERS || tasks < producers) {
+        fprintf(stderr, "usage: %s [TASKS [PRODUCERS]], at most %d producers\n", argv[0], MAX_PRODUCERS);
+        return 2;
+    }
+
+    bool ok = true;
+    for (bool paced : {true, false}) {
+        const char* mode = paced ? "paced" : "burst";
+        char name[32];
+        ListScheduler list_scheduler;
+        snprintf(name, sizeof(name), "%s list+mutex", mode);
+        ok = Run(name, tasks, producers, paced, list_scheduler) && ok;
+        RingScheduler ring_scheduler;
+        snprintf(name, sizeof(name), "%s task ring", mode);
+        ok = Run(name, tasks, producers, paced, ring_scheduler) && ok;
+        auto stats = ring_scheduler.GetStatistics();
+        printf("%-18s %lu in the ring, %lu overflowed to the list\n", "",
+            (unsigned long)stats.pushed, (unsigned long)stats.overflowed);
+    }
+    if (!ok) {
+        fprintf(stderr, "Tasks were lost or ran out of order\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,493 @@
+// Replays an audio trace recorded with CONFIG_USE_AUDIO_TRACE through the firmware's audio code.
+// The encoder input is encoded again with the traced encoder settings and compared with the traced packets,
+// the received packets go through the JitterBuffer at their arrival times, are decoded and resampled to the
+// output rate the way the decode task does it. Prints the time spent per stage and hashes of the outputs,
+// equal hashes across two builds mean bit exact audio. The playout hash covers what the jitter buffer released
+// and when, it does not depend on the libopus build.
+//
+// usage: trace_replay [--mic FILE.wav] [--uplink FILE.wav] [--speaker FILE.wav] [--strict] trace.xzt
+// A console capture is turned into a trace file with scripts/audio_trace.py first.
+
+#include "audio_trace_format.h"
+#include "jitter_buffer.h"
+#include "audio_resampler.h"
+
+#include <esp_timer.h>
+#include <opus_encoder.h>
+#include <opus_decoder.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+// Mirror application.h, the replay plays out the way the decode task does
+#define AUDIO_PACKET_MAX_SIZE 1024
+#define AUDIO_JITTER_BUFFER_SLOTS 16
+#define AUDIO_DECODE_LOOKAHEAD_FRAMES 3
+#define AUDIO_OUTPUT_CHUNK_MS 20
+// DeviceState values of the state records
+#define TRACE_STATE_LISTENING 5
+
+class Stopwatch {
+public:
+    void Start() { start_ = std::chrono::steady_clock::now(); }
+    void Stop() {
+        total_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+        count_++;
+    }
+    double average_us() const { return count_ > 0 ? total_ns_ / 1000.0 / count_ : 0; }
+    uint64_t count() const { return count_; }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+    uint64_t total_ns_ = 0;
+    uint64_t count_ = 0;
+};
+
+// FNV-1a, stable across platforms and runs
+class Hash {
+public:
+    void Add(const void* data, size_t size) {
+        auto bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < size; i++) {
+            value_ = (value_ ^ bytes[i]) * 0x100000001b3ULL;
+        }
+    }
+    uint64_t value() const { return value_; }
+
+private:
+    uint64_t value_ = 0xcbf29ce484222325ULL;
+};
+
+class WavWriter {
+public:
+    ~WavWriter() { Close(); }
+
+    bool Open(const std::string& path, int sample_rate, int channels) {
+        file_ = fopen(path.c_str(), "wb");
+        if (file_ == nullptr) {
+            fprintf(stderr, "Cannot write %s\n", path.c_str());
+            return false;
+        }
+        sample_rate_ = sample_rate;
+        channels_ = channels;
+        WriteHeader();
+        return true;
+    }
+
+    void Write(const int16_t* samples, size_t count) {
+        if (file_ != nullptr) {
+            fwrite(samples, sizeof(int16_t), count, file_);
+            data_size_ += count * sizeof(int16_t);
+        }
+    }
+
+    void Close() {
+        if (file_ != nullptr) {
+            fseek(file_, 0, SEEK_SET);
+            WriteHeader();
+            fclose(file_);
+            file_ = nullptr;
+        }
+    }
+
+private:
+    FILE* file_ = nullptr;
+    int sample_rate_ = 0;
+    int channels_ = 0;
+    uint32_t data_size_ = 0;
+
+    void WriteHeader() {
+        struct __attribute__((packed)) {
+            char riff[4] = {'R', 'I', 'F', 'F'};
+            uint32_t riff_size;
+            char wave[4] = {'W', 'A', 'V', 'E'};
+            char fmt[4] = {'f', 'm', 't', ' '};
+            uint32_t fmt_size = 16;
+            uint16_t format = 1;
+            uint16_t channels;
+            uint32_t sample_rate;
+            uint32_t byte_rate;
+            uint16_t block_align;
+            uint16_t bits = 16;
+            char data[4] = {'d', 'a', 't', 'a'};
+            uint32_t data_size;
+        } header;
+        header.riff_size = 36 + data_size_;
+        header.channels = channels_;
+        header.sample_rate = sample_rate_;
+        header.byte_rate = sample_rate_ * channels_ * 2;
+        header.block_align = channels_ * 2;
+        header.data_size = data_size_;
+        fwrite(&header, sizeof(header), 1, file_);
+    }
+};
+
+class TraceReplay {
+public:
+    std::string mic_path;
+    std::string uplink_path;
+    std::string speaker_path;
+
+    bool Run(const std::vector<uint8_t>& trace);
+    void Report();
+    uint32_t mismatches() const { return uplink_mismatches_; }
+
+private:
+    int64_t time_us_ = 0;
+    WavWriter mic_wav_;
+    WavWriter uplink_wav_;
+    WavWriter speaker_wav_;
+    uint32_t dropped_bytes_ = 0;
+    uint32_t gaps_ = 0;
+
+    // Uplink
+    std::unique_ptr<OpusEncoderWrapper> encoder_;
+    int encoder_frame_duration_ = 0;
+    std::deque<std::vector<uint8_t>> encoded_;
+    bool uplink_synced_ = true;
+    uint32_t uplink_packets_ = 0;
+    uint32_t uplink_compared_ = 0;
+    uint32_t uplink_mismatches_ = 0;
+    uint32_t uplink_silent_packets_ = 0;
+    uint64_t uplink_bytes_ = 0;
+    Stopwatch encode_time_;
+    Hash uplink_hash_;
+
+    // Downlink
+    JitterBuffer jitter_buffer_{AUDIO_JITTER_BUFFER_SLOTS, AUDIO_PACKET_MAX_SIZE};
+    std::unique_ptr<OpusDecoderWrapper> decoder_;
+    AudioResampler output_resampler_;
+    int output_sample_rate_ = 0;
+    int downlink_frame_duration_ = 60;
+    std::vector<uint8_t> packet_;
+    std::vector<int16_t> pcm_;
+    std::vector<int16_t> resampled_;
+    int64_t next_tick_us_ = -1;
+    size_t buffered_ = 0;       // output samples decoded and not yet played
+    bool playing_ = false;
+    uint32_t downlink_packets_ = 0;
+    uint32_t underruns_ = 0;
+    int64_t latency_sum_us_ = 0;
+    int64_t latency_max_us_ = 0;
+    uint32_t latency_count_ = 0;
+    Stopwatch decode_time_;
+    Stopwatch resample_time_;
+    Hash speaker_hash_;
+    Hash playout_hash_;
+
+    void OnRecord(const AudioTraceRecordHeader& header, const uint8_t* payload);
+    void OnUplinkPcm(const int16_t* samples, size_t count);
+    void OnUplinkOpus(const uint8_t* data, size_t size);
+    void OnDecoderConfig(const AudioTraceDecoderConfig& config);
+    void AdvancePlayout(int64_t until_us);
+    void DecodeAhead();
+};
+
+bool TraceReplay::Run(const std::vector<uint8_t>& trace) {
+    if (trace.size() < sizeof(AudioTraceHeader) || memcmp(trace.data(), AUDIO_TRACE_MAGIC, 4) != 0) {
+        fprintf(stderr, "Not an audio trace\n");
+        return false;
+    }
+    AudioTraceHeader header;
+    memcpy(&header, trace.data(), sizeof(header));
+    if (header.version != AUDIO_TRACE_VERSION) {
+        fprintf(stderr, "Trace version %u, expected %u\n", header.version, AUDIO_TRACE_VERSION);
+        return false;
+    }
+
+    size_t offset = sizeof(header);
+    while (offset + sizeof(AudioTraceRecordHeader) <= trace.size()) {
+        AudioTraceRecordHeader record;
+        memcpy(&record, trace.data() + offset, sizeof(record));
+        offset += sizeof(record);
+        if (offset + record.size > trace.size()) {
+            fprintf(stderr, "Trace truncated in a record of type %u\n", record.type);
+            break;
+        }
+        // Times are 32 bit, extend them relative to the previous record, which is never far away
+        time_us_ += (int32_t)(record.time_us - (uint32_t)time_us_);
+        OnRecord(record, trace.data() + offset);
+        offset += record.size;
+    }
+
+    // Play out whatever is still buffered
+    AdvancePlayout(time_us_ + 10 * 1000 * 1000);
+    return true;
+}
+
+void TraceReplay::OnRecord(const AudioTraceRecordHeader& header, const uint8_t* payload) {
+    AdvancePlayout(time_us_);
+    host_timer_set_time(time_us_);
+
+    switch (header.type) {
+    case kTraceInputFormat: {
+        AudioTraceInputFormat format;
+        memcpy(&format, payload, sizeof(format));
+        if (!mic_path.empty()) {
+            mic_wav_.Open(mic_path, format.sample_rate, format.channels);
+        }
+        printf("Input: %u Hz, %u channels%s\n", format.sample_rate, format.channels,
+            format.reference ? " (last one is the reference)" : "");
+        break;
+    }
+    case kTraceMicPcm:
+        mic_wav_.Write((const int16_t*)payload, header.size / sizeof(int16_t));
+        break;
+    case kTraceUplinkPcm:
+        OnUplinkPcm((const int16_t*)payload, header.size / sizeof(int16_t));
+        break;
+    case kTraceEncoderConfig: {
+        AudioTraceEncoderConfig config;
+        memcpy(&config, payload, sizeof(config));
+        // ConfigureEncoder creates a new encoder, the controller only changes the complexity
+        if (encoder_ == nullptr || config.frame_duration != encoder_frame_duration_) {
+            encoder_ = std::make_unique<OpusEncoderWrapper>((int)config.sample_rate, 1, (int)config.frame_duration);
+            encoder_frame_duration_ = config.frame_duration;
+            encoded_.clear();
+            if (!uplink_path.empty()) {
+                uplink_wav_.Open(uplink_path, config.sample_rate, 1);
+            }
+        }
+        encoder_->SetComplexity(config.complexity);
+        break;
+    }
+    case kTraceUplinkOpus:
+        OnUplinkOpus(payload, header.size);
+        break;
+    case kTraceDecoderConfig: {
+        AudioTraceDecoderConfig config;
+        memcpy(&config, payload, sizeof(config));
+        OnDecoderConfig(config);
+        break;
+    }
+    case kTraceDownlinkOpus: {
+        AudioTraceDownlink downlink;
+        memcpy(&downlink, payload, sizeof(downlink));
+        jitter_buffer_.Put(downlink.sequence, payload + sizeof(downlink), header.size - sizeof(downlink), time_us_);
+        downlink_packets_++;
+        // The network task wakes the decode task up after every packet
+        DecodeAhead();
+        break;
+    }
+    case kTraceDeviceState:
+        if (payload[0] == TRACE_STATE_LISTENING) {
+            // The decode task drops the speech when listening starts
+            jitter_buffer_.Clear();
+            buffered_ = 0;
+            playing_ = false;
+        }
+        break;
+    case kTraceDropped: {
+        uint32_t dropped;
+        memcpy(&dropped, payload, sizeof(dropped));
+        dropped_bytes_ += dropped;
+        gaps_++;
+        // The encoder state no longer matches the one on the device
+        uplink_synced_ = false;
+        encoded_.clear();
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void TraceReplay::OnUplinkPcm(const int16_t* samples, size_t count) {
+    uplink_wav_.Write(samples, count);
+    if (encoder_ == nullptr) {
+        return;
+    }
+    std::vector<int16_t> data(samples, samples + count);
+    encode_time_.Start();
+    encoder_->Encode(std::move(data), [this](std::vector<uint8_t>&& opus) {
+        uplink_hash_.Add(opus.data(), opus.size());
+        encoded_.push_back(std::move(opus));
+    });
+    encode_time_.Stop();
+}
+
+void TraceReplay::OnUplinkOpus(const uint8_t* data, size_t size) {
+    uplink_packets_++;
+    uplink_bytes_ += size;
+    // The packets of an encoder call follow its input, a packet with nothing encoded for it is simple VAD silence
+    if (encoded_.empty()) {
+        if (size == 1) {
+            uplink_silent_packets_++;
+        }
+        return;
+    }
+    auto packet = std::move(encoded_.front());
+    encoded_.pop_front();
+    if (!uplink_synced_) {
+        return;
+    }
+    uplink_compared_++;
+    if (packet.size() != size || memcmp(packet.data(), data, size) != 0) {
+        if (uplink_mismatches_ == 0) {
+            printf("First uplink mismatch at %.3f s, packet %u: %zu bytes replayed, %zu traced\n",
+                time_us_ / 1e6, uplink_packets_, packet.size(), size);
+        }
+        uplink_mismatches_++;
+    }
+}
+
+void TraceReplay::OnDecoderConfig(const AudioTraceDecoderConfig& config) {
+    printf("Downlink: %u Hz, %u ms frames, output %u Hz\n", config.sample_rate, config.frame_duration,
+        config.output_sample_rate);
+    jitter_buffer_.Reset(config.frame_duration);
+    downlink_frame_duration_ = config.frame_duration;
+    if (decoder_ == nullptr || decoder_->sample_rate() != (int)config.sample_rate ||
+        decoder_->duration_ms() != config.frame_duration) {
+        decoder_ = std::make_unique<OpusDecoderWrapper>((int)config.sample_rate, 1, (int)config.frame_duration);
+    }
+    if (config.sample_rate != config.output_sample_rate) {
+        output_resampler_.Configure(config.sample_rate, config.output_sample_rate);
+    }
+    if (output_sample_rate_ == 0 && !speaker_path.empty()) {
+        speaker_wav_.Open(speaker_path, config.output_sample_rate, 1);
+    }
+    output_sample_rate_ = config.output_sample_rate;
+}
+
+// The codec consumes one output chunk per tick, the decode task refills the look-ahead after each chunk
+void TraceReplay::AdvancePlayout(int64_t until_us) {
+    if (output_sample_rate_ == 0) {
+        return;
+    }
+    if (next_tick_us_ < 0) {
+        next_tick_us_ = until_us;
+    }
+    size_t chunk = output_sample_rate_ * AUDIO_OUTPUT_CHUNK_MS / 1000;
+    while (next_tick_us_ <= until_us) {
+        host_timer_set_time(next_tick_us_);
+        if (buffered_ > 0) {
+            buffered_ -= std::min(buffered_, chunk);
+            playing_ = true;
+        } else if (playing_) {
+            playing_ = false;
+            underruns_++;
+        }
+        DecodeAhead();
+        next_tick_us_ += AUDIO_OUTPUT_CHUNK_MS * 1000;
+    }
+}
+
+void TraceReplay::DecodeAhead() {
+    if (decoder_ == nullptr) {
+        return;
+    }
+    size_t frame_samples = output_sample_rate_ * downlink_frame_duration_ / 1000;
+    while (buffered_ < frame_samples * AUDIO_DECODE_LOOKAHEAD_FRAMES) {
+        int64_t arrival_time = 0;
+        if (!jitter_buffer_.Get(packet_, &arrival_time)) {
+            break;
+        }
+        int64_t playout[] = {esp_timer_get_time(), arrival_time, (int64_t)packet_.size()};
+        playout_hash_.Add(playout, sizeof(playout));
+        decode_time_.Start();
+        bool decoded = decoder_->Decode(std::move(packet_), pcm_);
+        decode_time_.Stop();
+        if (!decoded) {
+            continue;
+        }
+        const std::vector<int16_t>* output = &pcm_;
+        if (decoder_->sample_rate() != output_sample_rate_) {
+            resample_time_.Start();
+            resampled_.resize(output_resampler_.GetOutputSamples(pcm_.size()));
+            output_resampler_.Process(pcm_.data(), pcm_.size(), resampled_.data());
+            resample_time_.Stop();
+            output = &resampled_;
+        }
+        if (arrival_time != 0) {
+            int64_t latency = esp_timer_get_time() + (int64_t)buffered_ * 1000000 / output_sample_rate_ - arrival_time;
+            latency_sum_us_ += latency;
+            latency_max_us_ = std::max(latency_max_us_, latency);
+            latency_count_++;
+        }
+        speaker_hash_.Add(output->data(), output->size() * sizeof(int16_t));
+        speaker_wav_.Write(output->data(), output->size());
+        buffered_ += output->size();
+    }
+}
+
+void TraceReplay::Report() {
+    printf("Trace: %.3f s", time_us_ / 1e6);
+    if (gaps_ > 0) {
+        printf(", %u gaps with %u bytes dropped on the device", gaps_, dropped_bytes_);
+    }
+    printf("\n");
+
+    printf("Uplink: %u packets %llu bytes, %u silent\n", uplink_packets_, (unsigned long long)uplink_bytes_,
+        uplink_silent_packets_);
+    if (uplink_compared_ > 0) {
+        printf("  re-encoded %u packets, %u differ%s, encode %.1f us per call, hash %016llx\n", uplink_compared_,
+            uplink_mismatches_, uplink_synced_ ? "" : " (compared up to the first gap)", encode_time_.average_us(),
+            (unsigned long long)uplink_hash_.value());
+    } else {
+        printf("  no encoder input in the trace, nothing re-encoded\n");
+    }
+
+    auto stats = jitter_buffer_.GetStatistics();
+    printf("Downlink: %u packets, %u played, %u concealed, %u late, %u duplicated, %u overflowed, jitter %d ms\n",
+        downlink_packets_, stats.played, stats.concealed, stats.late, stats.duplicated, stats.overflowed,
+        stats.jitter_ms);
+    printf("  %u underruns, wire to speaker avg %lld ms max %lld ms, playout hash %016llx, hash %016llx\n",
+        underruns_, latency_count_ > 0 ? (long long)(latency_sum_us_ / latency_count_ / 1000) : 0LL,
+        (long long)(latency_max_us_ / 1000), (unsigned long long)playout_hash_.value(),
+        (unsigned long long)speaker_hash_.value());
+    printf("  decode %.1f us per frame, resample %.1f us per frame\n", decode_time_.average_us(),
+        resample_time_.average_us());
+}
+
+int main(int argc, char** argv) {
+    TraceReplay replay;
+    std::string trace_path;
+    bool strict = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--mic" && i + 1 < argc) {
+            replay.mic_path = argv[++i];
+        } else if (arg == "--uplink" && i + 1 < argc) {
+            replay.uplink_path = argv[++i];
+        } else if (arg == "--speaker" && i + 1 < argc) {
+            replay.speaker_path = argv[++i];
+        } else if (arg == "--strict") {
+            strict = true;
+        } else if (trace_path.empty() && arg[0] != '-') {
+            trace_path = arg;
+        } else {
+            trace_path.clear();
+            break;
+        }
+    }
+    if (trace_path.empty()) {
+        fprintf(stderr, "usage: %s [--mic FILE.wav] [--uplink FILE.wav] [--speaker FILE.wav] [--strict] trace.xzt\n",
+            argv[0]);
+        return 2;
+    }
+
+    FILE* file = fopen(trace_path.c_str(), "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "Cannot open %s\n", trace_path.c_str());
+        return 2;
+    }
+    std::vector<uint8_t> trace;
+    uint8_t buffer[65536];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        trace.insert(trace.end(), buffer, buffer + size);
+    }
+    fclose(file);
+
+    if (!replay.Run(trace)) {
+        return 2;
+    }
+    replay.Report();
+    return strict && replay.mismatches() > 0 ? 1 : 0;
+}
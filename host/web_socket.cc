@@ -0,0 +1,277 @@
+#include <web_socket.h>
+
+#include <esp_log.h>
+#include <esp_random.h>
+#include <mbedtls/base64.h>
+
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <cstring>
+
+#define TAG "WebSocket"
+
+#define OPCODE_CONTINUATION 0x0
+#define OPCODE_TEXT 0x1
+#define OPCODE_BINARY 0x2
+#define OPCODE_CLOSE 0x8
+#define OPCODE_PING 0x9
+#define OPCODE_PONG 0xA
+
+WebSocket::WebSocket() {
+}
+
+WebSocket::~WebSocket() {
+    if (fd_ >= 0) {
+        shutdown(fd_, SHUT_RDWR);
+    }
+    if (receive_thread_.joinable()) {
+        // Deleted from its own callback, the thread ends on the closed socket
+        if (receive_thread_.get_id() == std::this_thread::get_id()) {
+            receive_thread_.detach();
+        } else {
+            receive_thread_.join();
+        }
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+void WebSocket::SetHeader(const char* key, const char* value) {
+    headers_[key] = value;
+}
+
+bool WebSocket::Connect(const char* uri) {
+    // ws://host[:port][/path]
+    std::string url = uri;
+    if (url.rfind("ws://", 0) != 0) {
+        ESP_LOGE(TAG, "Only ws:// is supported on the host: %s", uri);
+        return false;
+    }
+    std::string rest = url.substr(5);
+    size_t slash = rest.find('/');
+    std::string authority = rest.substr(0, slash);
+    std::string path = slash == std::string::npos ? "/" : rest.substr(slash);
+    std::string host = authority;
+    std::string port = "80";
+    size_t colon = authority.rfind(':');
+    if (colon != std::string::npos) {
+        host = authority.substr(0, colon);
+        port = authority.substr(colon + 1);
+    }
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) {
+        ESP_LOGE(TAG, "Failed to resolve %s", host.c_str());
+        return false;
+    }
+    for (auto ai = result; ai != nullptr; ai = ai->ai_next) {
+        fd_ = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd_ < 0) {
+            continue;
+        }
+        if (connect(fd_, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd_);
+        fd_ = -1;
+    }
+    freeaddrinfo(result);
+    if (fd_ < 0) {
+        ESP_LOGE(TAG, "Failed to connect to %s:%s", host.c_str(), port.c_str());
+        return false;
+    }
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    uint8_t key[16];
+    esp_fill_random(key, sizeof(key));
+    unsigned char key_base64[32];
+    size_t key_length = 0;
+    mbedtls_base64_encode(key_base64, sizeof(key_base64), &key_length, key, sizeof(key));
+
+    std::string request = "GET " + path + " HTTP/1.1\r\n";
+    request += "Host: " + authority + "\r\n";
+    request += "Upgrade: websocket\r\n";
+    request += "Connection: Upgrade\r\n";
+    request += "Sec-WebSocket-Key: " + std::string((char*)key_base64, key_length) + "\r\n";
+    request += "Sec-WebSocket-Version: 13\r\n";
+    for (const auto& header : headers_) {
+        request += header.first + ": " + header.second + "\r\n";
+    }
+    request += "\r\n";
+    if (send(fd_, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size()) {
+        ESP_LOGE(TAG, "Failed to send the handshake");
+        return false;
+    }
+
+    // Byte by byte up to the end of the headers, the first frame may follow right after them
+    std::string response;
+    char c;
+    while (response.size() < 4 || response.compare(response.size() - 4, 4, "\r\n\r\n") != 0) {
+        if (!ReadExactly(&c, 1) || response.size() > 8192) {
+            ESP_LOGE(TAG, "Failed to read the handshake response");
+            return false;
+        }
+        response += c;
+    }
+    // The accept key is not checked, the host has no SHA-1
+    if (response.compare(0, 12, "HTTP/1.1 101") != 0) {
+        ESP_LOGE(TAG, "Handshake rejected: %s", response.substr(0, response.find('\r')).c_str());
+        return false;
+    }
+
+    connected_ = true;
+    receive_thread_ = std::thread([this]() {
+        ReceiveLoop();
+    });
+    if (on_connected_) {
+        on_connected_();
+    }
+    return true;
+}
+
+bool WebSocket::Send(const std::string& data) {
+    return Send(data.data(), data.size(), false, true);
+}
+
+bool WebSocket::Send(const void* data, size_t len, bool binary, bool fin) {
+    return SendFrame(binary ? OPCODE_BINARY : OPCODE_TEXT, data, len, fin);
+}
+
+bool WebSocket::IsConnected() const {
+    return connected_;
+}
+
+bool WebSocket::SendFrame(int opcode, const void* data, size_t len, bool fin) {
+    if (!connected_) {
+        return false;
+    }
+    // Client frames are masked
+    std::vector<uint8_t> frame;
+    frame.reserve(len + 14);
+    frame.push_back((fin ? 0x80 : 0) | opcode);
+    if (len < 126) {
+        frame.push_back(0x80 | len);
+    } else if (len < 65536) {
+        frame.push_back(0x80 | 126);
+        frame.push_back(len >> 8);
+        frame.push_back(len & 0xFF);
+    } else {
+        frame.push_back(0x80 | 127);
+        for (int i = 7; i >= 0; i--) {
+            frame.push_back(((uint64_t)len >> (i * 8)) & 0xFF);
+        }
+    }
+    uint8_t mask[4];
+    esp_fill_random(mask, sizeof(mask));
+    frame.insert(frame.end(), mask, mask + 4);
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < len; i++) {
+        frame.push_back(bytes[i] ^ mask[i % 4]);
+    }
+
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    size_t sent = 0;
+    while (sent < frame.size()) {
+        ssize_t ret = send(fd_, frame.data() + sent, frame.size() - sent, MSG_NOSIGNAL);
+        if (ret <= 0) {
+            ESP_LOGE(TAG, "Failed to send %u bytes", (unsigned)frame.size());
+            return false;
+        }
+        sent += ret;
+    }
+    return true;
+}
+
+bool WebSocket::ReadExactly(void* buffer, size_t size) {
+    size_t received = 0;
+    while (received < size) {
+        ssize_t ret = recv(fd_, (uint8_t*)buffer + received, size - received, 0);
+        if (ret <= 0) {
+            return false;
+        }
+        received += ret;
+    }
+    return true;
+}
+
+void WebSocket::ReceiveLoop() {
+    std::vector<char> message;
+    bool message_binary = false;
+    while (true) {
+        uint8_t header[2];
+        if (!ReadExactly(header, sizeof(header))) {
+            break;
+        }
+        bool fin = header[0] & 0x80;
+        int opcode = header[0] & 0x0F;
+        bool masked = header[1] & 0x80;
+        uint64_t len = header[1] & 0x7F;
+        if (len == 126) {
+            uint8_t ext[2];
+            if (!ReadExactly(ext, sizeof(ext))) {
+                break;
+            }
+            len = (ext[0] << 8) | ext[1];
+        } else if (len == 127) {
+            uint8_t ext[8];
+            if (!ReadExactly(ext, sizeof(ext))) {
+                break;
+            }
+            len = 0;
+            for (int i = 0; i < 8; i++) {
+                len = (len << 8) | ext[i];
+            }
+        }
+        uint8_t mask[4] = {};
+        if (masked && !ReadExactly(mask, sizeof(mask))) {
+            break;
+        }
+        std::vector<char> payload(len);
+        if (len > 0 && !ReadExactly(payload.data(), len)) {
+            break;
+        }
+        if (masked) {
+            for (size_t i = 0; i < len; i++) {
+                payload[i] ^= mask[i % 4];
+            }
+        }
+
+        if (opcode == OPCODE_PING) {
+            SendFrame(OPCODE_PONG, payload.data(), payload.size(), true);
+            continue;
+        } else if (opcode == OPCODE_PONG) {
+            continue;
+        } else if (opcode == OPCODE_CLOSE) {
+            SendFrame(OPCODE_CLOSE, payload.data(), std::min<size_t>(payload.size(), 2), true);
+            break;
+        }
+
+        if (opcode != OPCODE_CONTINUATION) {
+            message.clear();
+            message_binary = opcode == OPCODE_BINARY;
+        }
+        message.insert(message.end(), payload.begin(), payload.end());
+        if (fin) {
+            size_t size = message.size();
+            message.push_back('\0');
+            if (on_data_) {
+                on_data_(message.data(), size, message_binary);
+            }
+            message.clear();
+        }
+    }
+
+    connected_ = false;
+    if (on_disconnected_) {
+        on_disconnected_();
+    }
+}
@@ -4,6 +4,9 @@
 #include "system_info.h"
 #include "ml307_ssl_transport.h"
 #include "audio_codec.h"
+#include "audio_kernels.h"
+#include "audio_trace.h"
+#include "opus_benchmark.h"
 #include "mqtt_protocol.h"
 #include "websocket_protocol.h"
 #include "font_awesome_symbols.h"
@@ -11,6 +14,8 @@
 #include "assets/lang_config.h"
 
 #include <cstring>
+#include <cassert>
+#include <algorithm>
 #include <esp_log.h>
 #include <cJSON.h>
 #include <driver/gpio.h>
@@ -18,6 +23,13 @@
 
 #define TAG "Application"
 
+// Initial opus encoder complexity of the uplink: the defaults the boards used before the encoder controller,
+// not measured yet. To be replaced by the opus_bench results on the target chips, the encoder controller
+// lowers them at runtime if the encoder is over its load budget
+#define OPUS_INITIAL_COMPLEXITY_REALTIME 0
+#define OPUS_INITIAL_COMPLEXITY_ML307 5
+#define OPUS_INITIAL_COMPLEXITY_WIFI 3
+
 
 static const char* const STATE_STRINGS[] = {
     "unknown",
@@ -35,7 +47,7 @@ static const char* const STATE_STRINGS[] = {
 
 Application::Application() {
     event_group_ = xEventGroupCreate();
-    background_task_ = new BackgroundTask(4096 * 8);
+    background_task_ = new BackgroundTask(BACKGROUND_TASK_STACK_SIZE, BACKGROUND_TASK_WORKERS);
 
     esp_timer_create_args_t clock_timer_args = {
         .callback = [](void* arg) {
@@ -116,10 +128,8 @@ void Application::CheckNewVersion() {
             auto codec = board.GetAudioCodec();
             codec->EnableInput(false);
             codec->EnableOutput(false);
-            {
-                std::lock_guard<std::mutex> lock(mutex_);
-                audio_decode_queue_.clear();
-            }
+            ClearIncomingAudio();
+            sound_queue_.Clear();
             background_task_->WaitForCompletion();
             delete background_task_;
             background_task_ = nullptr;
@@ -193,7 +203,7 @@ void Application::ShowActivationCode() {
         digit_sound{'9', Lang::Sounds::P3_9}
     }};
 
-    // This sentence uses 9KB of SRAM, so we need to wait for it to finish
+    // The digits are queued behind the activation sentence and played from flash one after another
     Alert(Lang::Strings::ACTIVATION, message.c_str(), "happy", Lang::Sounds::P3_ACTIVATION);
 
     for (const auto& digit : code) {
@@ -212,7 +222,8 @@ void Application::Alert(const char* status, const char* message, const char* emo
     display->SetEmotion(emotion);
     display->SetChatMessage("system", message);
     if (!sound.empty()) {
-        ResetDecoder();
+        // Replace pending UI sounds, the mixer plays the alert over the speech stream
+        sound_queue_.Clear();
         PlaySound(sound);
     }
 }
@@ -226,32 +237,40 @@ void Application::DismissAlert() {
     }
 }
 
-void Application::PlaySound(const std::string_view& sound) {
-    // Wait for the previous sound to finish
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        audio_decode_cv_.wait(lock, [this]() {
-            return audio_decode_queue_.empty();
-        });
+void Application::PlaySound(const std::string_view& sound, std::function<void()> on_complete) {
+    // Only a view of the asset is queued, the frames are read from flash by the decode task,
+    // on_complete runs on the decode task after the last frame has been handed to the mixer.
+    // Sounds played before are served from the PCM cache and skip the decoder and the resampler.
+    auto codec = Board::GetInstance().GetAudioCodec();
+    auto pcm = sound_cache_.Lookup(sound.data(), codec->output_sample_rate());
+    if (sound_queue_.Push(sound, std::move(pcm), std::move(on_complete)) && audio_decode_task_handle_ != nullptr) {
+        xTaskNotifyGive(audio_decode_task_handle_);
     }
-    background_task_->WaitForCompletion();
-
-    // The assets are encoded at 16000Hz, 60ms frame duration
-    SetDecodeSampleRate(16000, 60);
-    const char* data = sound.data();
-    size_t size = sound.size();
-    for (const char* p = data; p < data + size; ) {
-        auto p3 = (BinaryProtocol3*)p;
-        p += sizeof(BinaryProtocol3);
+}
 
-        auto payload_size = ntohs(p3->payload_size);
-        std::vector<uint8_t> opus;
-        opus.resize(payload_size);
-        memcpy(opus.data(), p3->payload, payload_size);
-        p += payload_size;
+// Collect the PCM of a sound decoded from opus frames, so later plays can be served from the cache
+void Application::RecordSound(const SoundFrame& frame, const std::vector<int16_t>& pcm, int64_t decode_us) {
+    if (frame.first) {
+        recording_sound_ = frame.sound;
+        recording_pcm_.clear();
+        recording_decode_us_ = 0;
+    }
+    // Started before the queue was cleared, or too large to be cached
+    if (recording_sound_ != frame.sound) {
+        return;
+    }
+    if ((recording_pcm_.size() + pcm.size()) * sizeof(int16_t) > sound_cache_.max_clip_bytes()) {
+        recording_sound_ = nullptr;
+        return;
+    }
 
-        std::lock_guard<std::mutex> lock(mutex_);
-        audio_decode_queue_.emplace_back(std::move(opus));
+    recording_pcm_.insert(recording_pcm_.end(), pcm.begin(), pcm.end());
+    recording_decode_us_ += decode_us;
+    if (frame.last) {
+        auto codec = Board::GetInstance().GetAudioCodec();
+        sound_cache_.Insert(frame.sound, codec->output_sample_rate(), recording_pcm_.data(), recording_pcm_.size(),
+            recording_decode_us_);
+        recording_sound_ = nullptr;
     }
 }
 
@@ -344,22 +363,52 @@ void Application::Start() {
 
     /* Setup the audio codec */
     auto codec = board.GetAudioCodec();
+#if CONFIG_USE_SOFTWARE_AEC_REFERENCE
+    // Adds the output as a reference channel, before anything sizes its buffers by the input channels
+    codec->EnableSoftwareReference(CONFIG_SOFTWARE_AEC_REFERENCE_DELAY_MS);
+#endif
+#if CONFIG_USE_OPUS_BENCHMARK
+    // After the board, which may have started its own console
+    RegisterOpusBenchmarkCommand();
+#endif
+#if CONFIG_USE_AUDIO_TRACE
+    // Started before the encoder is configured and the audio tasks run, so the formats come first
+    AudioTrace::GetInstance().Start(CONFIG_AUDIO_TRACE_PATH, CONFIG_AUDIO_TRACE_BUFFER_SIZE * 1024, CONFIG_AUDIO_TRACE_PCM);
+    AudioTraceInputFormat input_format = {};
+    input_format.sample_rate = 16000;
+    input_format.channels = codec->input_channels();
+    input_format.reference = codec->input_reference();
+    AudioTrace::GetInstance().Record(kTraceInputFormat, &input_format, sizeof(input_format));
+#endif
     opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
+    sound_decoder_ = std::make_unique<OpusDecoderWrapper>(SOUND_SAMPLE_RATE, 1, SOUND_FRAME_DURATION_MS);
+    if (codec->output_sample_rate() != SOUND_SAMPLE_RATE) {
+        sound_resampler_.Configure(SOUND_SAMPLE_RATE, codec->output_sample_rate());
+    }
+    // Room for the look-ahead plus the frame being decoded
+    size_t frame_samples = codec->output_sample_rate() * OPUS_FRAME_DURATION_MS / 1000;
+    audio_mixer_.Initialize(frame_samples * (AUDIO_DECODE_LOOKAHEAD_FRAMES + 1));
+    audio_mixer_.SetDucking(AUDIO_MIXER_DUCKING_GAIN);
+    mix_buffer_.resize(codec->output_sample_rate() * AUDIO_OUTPUT_CHUNK_MS / 1000);
+    // Initial complexity, adjusted at runtime by the encoder controller within the configured bounds
     if (realtime_chat_enabled_) {
-        ESP_LOGI(TAG, "Realtime chat enabled, setting opus encoder complexity to 0");
-        opus_encoder_->SetComplexity(0);
+        ESP_LOGI(TAG, "Realtime chat enabled, setting opus encoder complexity to %d", OPUS_INITIAL_COMPLEXITY_REALTIME);
+        encoder_controller_.Reset(OPUS_INITIAL_COMPLEXITY_REALTIME);
     } else if (board.GetBoardType() == "ml307") {
-        ESP_LOGI(TAG, "ML307 board detected, setting opus encoder complexity to 5");
-        opus_encoder_->SetComplexity(5);
+        ESP_LOGI(TAG, "ML307 board detected, setting opus encoder complexity to %d", OPUS_INITIAL_COMPLEXITY_ML307);
+        encoder_controller_.Reset(OPUS_INITIAL_COMPLEXITY_ML307);
     } else {
-        ESP_LOGI(TAG, "WiFi board detected, setting opus encoder complexity to 3");
-        opus_encoder_->SetComplexity(3);
+        ESP_LOGI(TAG, "WiFi board detected, setting opus encoder complexity to %d", OPUS_INITIAL_COMPLEXITY_WIFI);
+        encoder_controller_.Reset(OPUS_INITIAL_COMPLEXITY_WIFI);
     }
+    uplink_frame_duration_ = realtime_chat_enabled_ ? OPUS_REALTIME_FRAME_DURATION_MS : OPUS_FRAME_DURATION_MS;
+    ConfigureEncoder(uplink_frame_duration_);
 
     if (codec->input_sample_rate() != 16000) {
-        input_resampler_.Configure(codec->input_sample_rate(), 16000);
-        reference_resampler_.Configure(codec->input_sample_rate(), 16000);
+        assert(codec->input_channels() <= AUDIO_INPUT_MAX_CHANNELS);
+        for (int i = 0; i < codec->input_channels(); i++) {
+            input_resamplers_[i].Configure(codec->input_sample_rate(), 16000);
+        }
     }
     codec->Start();
 
@@ -369,6 +418,12 @@ void Application::Start() {
         vTaskDelete(NULL);
     }, "audio_loop", 4096 * 2, this, 8, &audio_loop_task_handle_, realtime_chat_enabled_ ? 1 : 0);
 
+    xTaskCreatePinnedToCore([](void* arg) {
+        Application* app = (Application*)arg;
+        app->AudioDecodeLoop();
+        vTaskDelete(NULL);
+    }, "audio_decode", AUDIO_DECODE_TASK_STACK_SIZE, this, AUDIO_DECODE_TASK_PRIORITY, &audio_decode_task_handle_, AUDIO_DECODE_TASK_CORE);
+
     /* Wait for the network to be ready */
     board.StartNetwork();
 
@@ -387,16 +442,26 @@ void Application::Start() {
         protocol_ = std::make_unique<MqttProtocol>();
     }
 
+    protocol_->SetUplinkFrameDuration(uplink_frame_duration_);
+    audio_sender_.Start([this](const std::vector<uint8_t>& packet, int64_t capture_time) {
+        protocol_->SendAudio(packet);
+        LatencyMetrics::GetInstance().Record(kLatencyMicToWire, capture_time);
+    }, [this]() {
+        protocol_->FlushAudio();
+    }, AUDIO_SENDER_TASK_STACK_SIZE, AUDIO_SENDER_TASK_PRIORITY, AUDIO_SENDER_TASK_CORE);
     protocol_->OnNetworkError([this](const std::string& message) {
         SetDeviceState(kDeviceStateIdle);
         Alert(Lang::Strings::ERROR, message.c_str(), "sad", Lang::Sounds::P3_EXCLAMATION);
     });
-    protocol_->OnIncomingAudio([this](std::vector<uint8_t>&& data) {
-        const int max_packets_in_queue = 300 / OPUS_FRAME_DURATION_MS;
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (audio_decode_queue_.size() < max_packets_in_queue) {
-            audio_decode_queue_.emplace_back(std::move(data));
+    protocol_->OnIncomingAudio([this](AudioStreamPacket&& packet) {
+        AudioTraceDownlink downlink = {packet.sequence};
+        AudioTrace::GetInstance().Record(kTraceDownlinkOpus, packet.payload.data(), packet.payload.size(),
+            packet.timestamp, &downlink, sizeof(downlink));
+        if (!incoming_queue_.Push(packet.payload.data(), packet.payload.size(), packet.sequence, packet.timestamp)) {
+            // The decode task is behind by a whole queue, or the packet is oversized
+            incoming_dropped_.fetch_add(1, std::memory_order_relaxed);
         }
+        xTaskNotifyGive(audio_decode_task_handle_);
     });
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
         board.SetPowerSaveMode(false);
@@ -404,7 +469,24 @@ void Application::Start() {
             ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
                 protocol_->server_sample_rate(), codec->output_sample_rate());
         }
-        SetDecodeSampleRate(protocol_->server_sample_rate(), protocol_->server_frame_duration());
+        incoming_queue_.Clear();
+        incoming_dropped_ = 0;
+        jitter_buffer_reset_ = protocol_->server_frame_duration();
+        if (audio_decode_task_handle_ != nullptr) {
+            xTaskNotifyGive(audio_decode_task_handle_);
+        }
+        AudioTraceDecoderConfig decoder_config = {};
+        decoder_config.sample_rate = protocol_->server_sample_rate();
+        decoder_config.frame_duration = protocol_->server_frame_duration();
+        decoder_config.output_sample_rate = codec->output_sample_rate();
+        AudioTrace::GetInstance().Record(kTraceDecoderConfig, &decoder_config, sizeof(decoder_config));
+        // Nothing is encoded before listening starts, switch the encoder in order with the encode jobs
+        int frame_duration = protocol_->uplink_frame_duration();
+        background_task_->Schedule([this, frame_duration]() {
+            if (frame_duration != encoder_frame_duration_) {
+                ConfigureEncoder(frame_duration);
+            }
+        });
         auto& thing_manager = iot::ThingManager::GetInstance();
         protocol_->SendIotDescriptors(thing_manager.GetDescriptorsJson());
         std::string states;
@@ -426,6 +508,7 @@ void Application::Start() {
         if (strcmp(type->valuestring, "tts") == 0) {
             auto state = cJSON_GetObjectItem(root, "state");
             if (strcmp(state->valuestring, "start") == 0) {
+                speech_ending_ = false;
                 Schedule([this]() {
                     aborted_ = false;
                     if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
@@ -433,16 +516,11 @@ void Application::Start() {
                     }
                 });
             } else if (strcmp(state->valuestring, "stop") == 0) {
-                Schedule([this]() {
-                    background_task_->WaitForCompletion();
-                    if (device_state_ == kDeviceStateSpeaking) {
-                        if (listening_mode_ == kListeningModeManualStop) {
-                            SetDeviceState(kDeviceStateIdle);
-                        } else {
-                            SetDeviceState(kDeviceStateListening);
-                        }
-                    }
-                });
+                // The decode task plays out the buffered speech, then schedules OnSpeechDrained
+                speech_ending_ = true;
+                if (audio_decode_task_handle_ != nullptr) {
+                    xTaskNotifyGive(audio_decode_task_handle_);
+                }
             } else if (strcmp(state->valuestring, "sentence_start") == 0) {
                 auto text = cJSON_GetObjectItem(root, "text");
                 if (text != NULL) {
@@ -504,17 +582,12 @@ void Application::Start() {
 
 #if CONFIG_USE_AUDIO_PROCESSOR
     audio_processor_.Initialize(codec, realtime_chat_enabled_);
-    audio_processor_.OnOutput([this](std::vector<int16_t>&& data) {
-        background_task_->Schedule([this, data = std::move(data)]() mutable {
-            if (protocol_->IsAudioChannelBusy()) {
-                return;
-            }
-            opus_encoder_->Encode(std::move(data), [this](std::vector<uint8_t>&& opus) {
-                Schedule([this, opus = std::move(opus)]() {
-                    protocol_->SendAudio(opus);
-                });
-            });
-        });
+    audio_processor_.OnOutput([this](std::vector<int16_t>&& data, int64_t capture_time) {
+        auto& metrics = LatencyMetrics::GetInstance();
+        metrics.Record(kLatencyMicToProcessed, capture_time);
+        background_task_->Schedule([this, data = std::move(data), capture_time]() mutable {
+            EncodeUplink(data, capture_time);
+        }, kBackgroundRealtime, uplink_cancellation_.GetToken());
     });
     audio_processor_.OnVadStateChange([this](bool speaking) {
         if (device_state_ == kDeviceStateListening) {
@@ -530,13 +603,26 @@ void Application::Start() {
         }
     });
 #endif
+#if CONFIG_USE_SIMPLE_VAD
+    voice_detector_.OnStateChange([this](bool speaking) {
+        if (device_state_ == kDeviceStateListening) {
+            Schedule([this, speaking]() {
+                voice_detected_ = speaking;
+                auto led = Board::GetInstance().GetLed();
+                led->OnStateChanged();
+            });
+        }
+    });
+#endif
 
 #if CONFIG_USE_WAKE_WORD_DETECT
-    wake_word_detect_.Initialize(codec);
+    // The pre-roll is encoded with the frame duration this device proposes for the uplink
+    wake_word_detect_.Initialize(codec, background_task_, uplink_frame_duration_);
     wake_word_detect_.OnWakeWordDetected([this](const std::string& wake_word) {
         Schedule([this, &wake_word]() {
             if (device_state_ == kDeviceStateIdle) {
                 SetDeviceState(kDeviceStateConnecting);
+                // Most of the pre-roll is already encoded, only the last frames are left
                 wake_word_detect_.EncodeWakeWordData();
 
                 if (!protocol_ || !protocol_->OpenAudioChannel()) {
@@ -545,7 +631,7 @@ void Application::Start() {
                 }
                 
                 std::vector<uint8_t> opus;
-                // Encode and send the wake word data to the server
+                // Send the wake word data to the server
                 while (wake_word_detect_.GetWakeWordOpus(opus)) {
                     protocol_->SendAudio(opus);
                 }
@@ -589,7 +675,72 @@ void Application::OnClockTimer() {
 
         int free_sram = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
         int min_free_sram = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
-        ESP_LOGI(TAG, "Free internal: %u minimal internal: %u", free_sram, min_free_sram);
+        // The largest block shows how fragmented the free memory is
+        int largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+        ESP_LOGI(TAG, "Free internal: %u minimal internal: %u largest block: %u", free_sram, min_free_sram, largest_free_block);
+
+        static const char* const priority_names[] = {"realtime", "bulk"};
+        for (int i = 0; i < kBackgroundPriorityCount && background_task_ != nullptr; i++) {
+            auto stats = background_task_->GetStatistics((BackgroundPriority)i);
+            if (stats.completed + stats.cancelled > 0) {
+                ESP_LOGI(TAG, "Background %s: completed %lu cancelled %lu, depth %d max %d, wait avg %lld max %lld ms",
+                    priority_names[i], (unsigned long)stats.completed, (unsigned long)stats.cancelled, stats.depth,
+                    stats.max_depth, (long long)(stats.wait_avg_us / 1000), (long long)(stats.wait_max_us / 1000));
+            }
+        }
+
+        if (device_state_ == kDeviceStateListening) {
+            auto stats = audio_sender_.GetStatistics();
+            ESP_LOGI(TAG, "Audio sender: queued %lu sent %lu dropped %lu coalesced %lu, depth %d max %d, stack free %d",
+                (unsigned long)stats.queued, (unsigned long)stats.sent, (unsigned long)stats.dropped,
+                (unsigned long)stats.coalesced, stats.depth, stats.max_depth, stats.stack_free);
+        }
+        if (device_state_ == kDeviceStateSpeaking) {
+            JitterBuffer::Statistics stats;
+            {
+                std::lock_guard<std::mutex> lock(output_stats_mutex_);
+                stats = jitter_statistics_;
+            }
+            ESP_LOGI(TAG, "Jitter buffer: received %lu played %lu concealed %lu late %lu underruns %lu dropped %lu, jitter %d ms, depth %d/%d frames",
+                (unsigned long)stats.received, (unsigned long)stats.played, (unsigned long)stats.concealed,
+                (unsigned long)stats.late, (unsigned long)stats.underruns,
+                (unsigned long)incoming_dropped_.load(std::memory_order_relaxed), stats.jitter_ms, stats.buffered,
+                stats.target_depth);
+            // Take the figures of the decode task and start a new period
+            uint32_t underruns, slack_count;
+            int64_t slack_sum_us, slack_min_us;
+            {
+                std::lock_guard<std::mutex> lock(output_stats_mutex_);
+                underruns = output_underruns_;
+                slack_count = output_slack_count_;
+                slack_sum_us = output_slack_sum_us_;
+                slack_min_us = output_slack_min_us_;
+                output_slack_sum_us_ = 0;
+                output_slack_count_ = 0;
+                output_slack_min_us_ = INT64_MAX;
+            }
+            if (slack_count > 0) {
+                // The least stack the decode task had left so far, in bytes on ESP-IDF
+                ESP_LOGI(TAG, "Audio output: underruns %lu, decode slack avg %lld ms min %lld ms, decode stack free %u",
+                    (unsigned long)underruns, (long long)(slack_sum_us / slack_count / 1000),
+                    (long long)(slack_min_us / 1000), (unsigned)uxTaskGetStackHighWaterMark(audio_decode_task_handle_));
+            }
+        }
+
+        // Print the latency histograms every minute if there was audio traffic, they cover the turn in progress
+        auto& metrics = LatencyMetrics::GetInstance();
+        if (clock_ticks_ % 60 == 0 && metrics.total_count() > 0 && metrics.total_count() != latency_dump_count_) {
+            latency_dump_count_ = metrics.total_count();
+            metrics.Dump();
+        }
+
+        auto cache_stats = sound_cache_.GetStatistics();
+        if (cache_stats.hits + cache_stats.misses > 0) {
+            ESP_LOGI(TAG, "Sound cache: hit rate %lu%% (%lu/%lu), %u clips %u KB, decode time saved %lld ms",
+                (unsigned long)(cache_stats.hits * 100 / (cache_stats.hits + cache_stats.misses)),
+                (unsigned long)cache_stats.hits, (unsigned long)(cache_stats.hits + cache_stats.misses),
+                (unsigned)cache_stats.clips, (unsigned)(cache_stats.bytes / 1024), (long long)(cache_stats.saved_us / 1000));
+        }
 
         // If we have synchronized server time, set the status to clock "HH:MM" if the device is idle
         if (ota_.HasServerTime()) {
@@ -606,15 +757,6 @@ void Application::OnClockTimer() {
     }
 }
 
-// Add a async task to MainLoop
-void Application::Schedule(std::function<void()> callback) {
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        main_tasks_.push_back(std::move(callback));
-    }
-    xEventGroupSetBits(event_group_, SCHEDULE_EVENT);
-}
-
 // The Main Event Loop controls the chat state and websocket connection
 // If other tasks need to access the websocket or chat state,
 // they should use Schedule to call this function
@@ -623,166 +765,517 @@ void Application::MainEventLoop() {
         auto bits = xEventGroupWaitBits(event_group_, SCHEDULE_EVENT, pdTRUE, pdFALSE, portMAX_DELAY);
 
         if (bits & SCHEDULE_EVENT) {
-            std::unique_lock<std::mutex> lock(mutex_);
-            std::list<std::function<void()>> tasks = std::move(main_tasks_);
-            lock.unlock();
-            for (auto& task : tasks) {
-                task();
-            }
+            main_tasks_.Drain();
         }
     }
 }
 
 // The Audio Loop is used to input and output audio data
 void Application::AudioLoop() {
-    auto codec = Board::GetInstance().GetAudioCodec();
     while (true) {
         OnAudioInput();
-        if (codec->output_enabled()) {
-            OnAudioOutput();
-        }
     }
 }
 
-void Application::OnAudioOutput() {
-    if (busy_decoding_audio_) {
-        return;
-    }
-
-    auto now = std::chrono::steady_clock::now();
+// Decodes speech and sounds ahead of playback into the mixer and writes the mixed audio to the codec
+void Application::AudioDecodeLoop() {
     auto codec = Board::GetInstance().GetAudioCodec();
     const int max_silence_seconds = 10;
+    size_t chunk_samples = codec->output_sample_rate() * AUDIO_OUTPUT_CHUNK_MS / 1000;
+    bool playing = false;
+
+    while (true) {
+        if (reset_decoder_.exchange(false)) {
+            opus_decoder_->ResetState();
+            sound_decoder_->ResetState();
+        }
+        if (flush_output_.exchange(false)) {
+            FlushSpeechOutput();
+            playing = false;
+        }
+        ApplyJitterBufferReset();
 
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (audio_decode_queue_.empty()) {
-        // Disable the output if there is no audio data for a long time
-        if (device_state_ == kDeviceStateIdle) {
-            auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - last_output_time_).count();
-            if (duration > max_silence_seconds) {
-                codec->EnableOutput(false);
+        // The speech of the turn has been written to the codec, the main loop may change the state now
+        if (speech_ending_ && incoming_queue_.Empty() && jitter_buffer_.Empty() && audio_mixer_.Available(kMixerVoiceSpeech) == 0
+                && speech_ending_.exchange(false)) {
+            Schedule([this]() {
+                OnSpeechDrained();
+            });
+        }
+
+        if (device_state_ == kDeviceStateListening) {
+            if (!incoming_queue_.Empty() || !jitter_buffer_.Empty() || !sound_queue_.Empty() || !audio_mixer_.Empty()) {
+                ClearIncomingAudio();
+                ApplyJitterBufferReset();
+                sound_queue_.Clear();
+                audio_mixer_.Clear();
             }
+            playing = false;
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+            continue;
         }
-        return;
-    }
 
-    if (device_state_ == kDeviceStateListening) {
-        audio_decode_queue_.clear();
-        audio_decode_cv_.notify_all();
-        return;
+        DecodeAhead();
+
+        if (audio_mixer_.Empty()) {
+            if (playing && device_state_ == kDeviceStateSpeaking && !aborted_) {
+                std::lock_guard<std::mutex> lock(output_stats_mutex_);
+                output_underruns_++;
+            }
+            playing = false;
+
+            if (incoming_queue_.Empty() && jitter_buffer_.Empty() && sound_queue_.Empty()) {
+                // Disable the output if there is no audio data for a long time
+                if (device_state_ == kDeviceStateIdle && codec->output_enabled()) {
+                    auto now = std::chrono::steady_clock::now();
+                    auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - last_output_time_).count();
+                    if (duration > max_silence_seconds) {
+                        codec->EnableOutput(false);
+                    }
+                }
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+            } else {
+                // The jitter buffer is still filling up
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+            }
+            continue;
+        }
+
+        if (!codec->output_enabled()) {
+            codec->EnableOutput(true);
+        }
+        playing = true;
+
+        size_t samples = audio_mixer_.Mix(mix_buffer_.data(), chunk_samples);
+        mix_buffer_.resize(samples);
+        // Decoded audio still waiting behind this chunk, the margin against decode and network hiccups
+        int64_t slack_us = (int64_t)audio_mixer_.Available(kMixerVoiceSpeech) * 1000000 / codec->output_sample_rate();
+        {
+            std::lock_guard<std::mutex> lock(output_stats_mutex_);
+            if (slack_us < output_slack_min_us_) {
+                output_slack_min_us_ = slack_us;
+            }
+            output_slack_sum_us_ += slack_us;
+            output_slack_count_++;
+        }
+
+        WriteOutput();
+        mix_buffer_.resize(chunk_samples);
+        last_output_time_ = std::chrono::steady_clock::now();
     }
+}
 
-    auto opus = std::move(audio_decode_queue_.front());
-    audio_decode_queue_.pop_front();
-    lock.unlock();
-    audio_decode_cv_.notify_all();
+// Decode until each mixer voice holds AUDIO_DECODE_LOOKAHEAD_FRAMES frames or its source runs dry
+void Application::DecodeAhead() {
+    auto codec = Board::GetInstance().GetAudioCodec();
+    auto& metrics = LatencyMetrics::GetInstance();
+    size_t capacity = audio_mixer_.capacity();
+
+    DrainIncomingAudio();
+    if (protocol_) {
+        int sample_rate = protocol_->server_sample_rate();
+        int frame_duration = protocol_->server_frame_duration();
+        size_t frame_samples = codec->output_sample_rate() * frame_duration / 1000;
+        while (true) {
+            size_t buffered = audio_mixer_.Available(kMixerVoiceSpeech);
+            if (buffered >= frame_samples * AUDIO_DECODE_LOOKAHEAD_FRAMES || buffered + frame_samples > capacity) {
+                break;
+            }
+            // An empty packet from the jitter buffer makes the decoder conceal a lost frame
+            int64_t arrival_time = 0;
+            if (!jitter_buffer_.Get(decode_packet_, &arrival_time)) {
+                break;
+            }
+            if (aborted_) {
+                continue;
+            }
 
-    busy_decoding_audio_ = true;
-    background_task_->Schedule([this, codec, opus = std::move(opus)]() mutable {
-        busy_decoding_audio_ = false;
-        if (aborted_) {
-            return;
+            metrics.Record(kLatencyWireToDequeue, arrival_time);
+            int64_t dequeue_time = arrival_time != 0 ? esp_timer_get_time() : 0;
+            DecodeSpeech(sample_rate, frame_duration);
+            metrics.Record(kLatencyDequeueToDecoded, dequeue_time);
+            // The frame reaches the codec once the audio buffered ahead of it has been written
+            if (arrival_time != 0) {
+                metrics.Record(kLatencyWireToSpeaker, arrival_time - (int64_t)buffered * 1000000 / codec->output_sample_rate());
+            }
         }
+        std::lock_guard<std::mutex> lock(output_stats_mutex_);
+        jitter_statistics_ = jitter_buffer_.GetStatistics();
+    }
 
-        std::vector<int16_t> pcm;
-        if (!opus_decoder_->Decode(std::move(opus), pcm)) {
-            return;
+    size_t frame_samples = codec->output_sample_rate() * SOUND_FRAME_DURATION_MS / 1000;
+    while (true) {
+        size_t buffered = audio_mixer_.Available(kMixerVoiceUi);
+        if (buffered >= frame_samples * AUDIO_DECODE_LOOKAHEAD_FRAMES || buffered + frame_samples > capacity) {
+            break;
         }
-        // Resample if the sample rate is different
-        if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
-            int target_size = output_resampler_.GetOutputSamples(pcm.size());
-            std::vector<int16_t> resampled(target_size);
-            output_resampler_.Process(pcm.data(), pcm.size(), resampled.data());
-            pcm = std::move(resampled);
+        SoundFrame frame;
+        if (!sound_queue_.NextFrame(frame, frame_samples)) {
+            break;
         }
-        codec->OutputData(pcm);
-        last_output_time_ = std::chrono::steady_clock::now();
-    });
+        if (frame.opus != nullptr) {
+            sound_packet_.assign(frame.opus, frame.opus + frame.opus_size);
+        }
+        DecodeSound(frame);
+        if (frame.on_complete) {
+            frame.on_complete();
+        }
+    }
+}
+
+// Runs on the decode task, the only one using the jitter buffer
+void Application::DrainIncomingAudio() {
+    ApplyJitterBufferReset();
+    uint32_t sequence;
+    int64_t arrival_time;
+    while (incoming_queue_.Pop(incoming_packet_, &sequence, &arrival_time)) {
+        jitter_buffer_.Put(sequence, incoming_packet_.data(), incoming_packet_.size(), arrival_time);
+    }
+}
+
+// Drops the incoming speech from any task, the decode task clears the jitter buffer
+void Application::ClearIncomingAudio() {
+    incoming_queue_.Clear();
+    // A reset still pending clears it as well
+    int none = 0;
+    jitter_buffer_reset_.compare_exchange_strong(none, -1);
+    if (audio_decode_task_handle_ != nullptr) {
+        xTaskNotifyGive(audio_decode_task_handle_);
+    }
+}
+
+// Runs on the decode task, applies the reset or clear asked for by ClearIncomingAudio or the audio channel
+void Application::ApplyJitterBufferReset() {
+    int reset = jitter_buffer_reset_.exchange(0);
+    if (reset > 0) {
+        jitter_buffer_.Reset(reset);
+    } else if (reset < 0) {
+        jitter_buffer_.Clear();
+    }
+}
+
+// Decode decode_packet_ into the speech voice of the mixer
+void Application::DecodeSpeech(int sample_rate, int frame_duration) {
+    SetDecodeSampleRate(sample_rate, frame_duration);
+    if (!opus_decoder_->Decode(std::move(decode_packet_), speech_pcm_)) {
+        return;
+    }
+    auto codec = Board::GetInstance().GetAudioCodec();
+    if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
+        resampled_pcm_.resize(output_resampler_.GetOutputSamples(speech_pcm_.size()));
+        output_resampler_.Process(speech_pcm_.data(), speech_pcm_.size(), resampled_pcm_.data());
+        audio_mixer_.Push(kMixerVoiceSpeech, resampled_pcm_.data(), resampled_pcm_.size());
+    } else {
+        audio_mixer_.Push(kMixerVoiceSpeech, speech_pcm_.data(), speech_pcm_.size());
+    }
+}
+
+// Decode a sound frame (or take a chunk of its cached PCM) into the UI voice of the mixer
+void Application::DecodeSound(const SoundFrame& frame) {
+    if (frame.pcm) {
+        // Cached sound, already at the output sample rate
+        audio_mixer_.Push(kMixerVoiceUi, frame.samples, frame.sample_count);
+        return;
+    }
+
+    int64_t start_time = esp_timer_get_time();
+    if (!sound_decoder_->Decode(std::move(sound_packet_), sound_pcm_)) {
+        recording_sound_ = nullptr;
+        return;
+    }
+    auto codec = Board::GetInstance().GetAudioCodec();
+    const std::vector<int16_t>* pcm = &sound_pcm_;
+    if (sound_decoder_->sample_rate() != codec->output_sample_rate()) {
+        resampled_pcm_.resize(sound_resampler_.GetOutputSamples(sound_pcm_.size()));
+        sound_resampler_.Process(sound_pcm_.data(), sound_pcm_.size(), resampled_pcm_.data());
+        pcm = &resampled_pcm_;
+    }
+    RecordSound(frame, *pcm, esp_timer_get_time() - start_time);
+    audio_mixer_.Push(kMixerVoiceUi, pcm->data(), pcm->size());
 }
 
 void Application::OnAudioInput() {
 #if CONFIG_USE_WAKE_WORD_DETECT
     if (wake_word_detect_.IsDetectionRunning()) {
-        std::vector<int16_t> data;
         int samples = wake_word_detect_.GetFeedSize();
         if (samples > 0) {
-            ReadAudio(data, 16000, samples);
-            wake_word_detect_.Feed(data);
+            ReadAudio(input_data_, 16000, samples);
+            wake_word_detect_.Feed(input_data_);
             return;
         }
     }
 #endif
 #if CONFIG_USE_AUDIO_PROCESSOR
     if (audio_processor_.IsRunning()) {
-        std::vector<int16_t> data;
         int samples = audio_processor_.GetFeedSize();
         if (samples > 0) {
-            ReadAudio(data, 16000, samples);
-            audio_processor_.Feed(data);
+            ReadAudio(input_data_, 16000, samples);
+            AudioTrace::GetInstance().RecordPcm(kTraceMicPcm, input_data_.data(), input_data_.size());
+            audio_processor_.Feed(input_data_, Board::GetInstance().GetAudioCodec()->input_capture_time());
             return;
         }
     }
 #else
     if (device_state_ == kDeviceStateListening) {
-        std::vector<int16_t> data;
-        ReadAudio(data, 16000, 30 * 16000 / 1000);
-        background_task_->Schedule([this, data = std::move(data)]() mutable {
-            if (protocol_->IsAudioChannelBusy()) {
-                return;
-            }
-            opus_encoder_->Encode(std::move(data), [this](std::vector<uint8_t>&& opus) {
-                Schedule([this, opus = std::move(opus)]() {
-                    protocol_->SendAudio(opus);
-                });
-            });
-        });
+        // Read no more than one uplink frame so short frames are not held back
+        int read_ms = std::min(AUDIO_INPUT_READ_MS, protocol_->uplink_frame_duration());
+        ReadAudio(input_data_, 16000, read_ms * 16000 / 1000);
+        int64_t capture_time = Board::GetInstance().GetAudioCodec()->input_capture_time();
+        AudioTrace::GetInstance().RecordPcm(kTraceMicPcm, input_data_.data(), input_data_.size(), capture_time);
+        // The encode job gets its own copy, in a buffer it hands back when done
+        auto data = TakeUplinkChunk();
+        data.assign(input_data_.begin(), input_data_.end());
+#if CONFIG_USE_SIMPLE_VAD
+        if (!voice_detector_running_) {
+            voice_detector_.Reset();
+            voice_detector_running_ = true;
+        }
+        bool voice = voice_detector_.Process(data.data(), data.size());
+        background_task_->Schedule([this, data = std::move(data), capture_time, voice]() mutable {
+            EncodeUplinkChunk(data, capture_time, voice);
+            RecycleUplinkChunk(std::move(data));
+        }, kBackgroundRealtime, uplink_cancellation_.GetToken());
+#else
+        background_task_->Schedule([this, data = std::move(data), capture_time]() mutable {
+            EncodeUplink(data, capture_time);
+            RecycleUplinkChunk(std::move(data));
+        }, kBackgroundRealtime, uplink_cancellation_.GetToken());
+#endif
         return;
     }
+#if CONFIG_USE_SIMPLE_VAD
+    voice_detector_running_ = false;
+#endif
 #endif
     vTaskDelay(pdMS_TO_TICKS(30));
 }
 
-void Application::ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples) {
-    auto codec = Board::GetInstance().GetAudioCodec();
-    if (codec->input_sample_rate() != sample_rate) {
-        data.resize(samples * codec->input_sample_rate() / sample_rate);
-        if (!codec->InputData(data)) {
-            return;
-        }
-        if (codec->input_channels() == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
-            for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
-            }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
-            input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
-            reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
-            data.resize(resampled_mic.size() + resampled_reference.size());
-            for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
-                data[j] = resampled_mic[i];
-                data[j + 1] = resampled_reference[i];
-            }
-        } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
-            input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
+void Application::ConfigureEncoder(int frame_duration) {
+    ESP_LOGI(TAG, "Uplink opus frame duration: %d ms", frame_duration);
+    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration);
+    opus_encoder_->SetComplexity(encoder_controller_.complexity());
+    encoder_frame_duration_ = frame_duration;
+    TraceEncoderConfig();
+}
+
+void Application::TraceEncoderConfig() {
+    AudioTraceEncoderConfig config = {};
+    config.sample_rate = 16000;
+    config.frame_duration = encoder_frame_duration_;
+    config.complexity = encoder_controller_.complexity();
+    AudioTrace::GetInstance().Record(kTraceEncoderConfig, &config, sizeof(config));
+}
+
+// Runs on the background task, the packets go straight to the audio sender. Returns the opus bytes produced
+size_t Application::EncodeUplink(std::vector<int16_t>& data, int64_t capture_time) {
+    size_t samples = data.size();
+    size_t opus_bytes = 0;
+    AudioTrace::GetInstance().RecordPcm(kTraceUplinkPcm, data.data(), data.size(), capture_time);
+    int64_t start_time = esp_timer_get_time();
+    opus_encoder_->Encode(std::move(data), [this, capture_time, &opus_bytes](std::vector<uint8_t>&& opus) {
+        LatencyMetrics::GetInstance().Record(kLatencyMicToEncoded, capture_time);
+        AudioTrace::GetInstance().Record(kTraceUplinkOpus, opus.data(), opus.size());
+        opus_bytes += opus.size();
+        if (!audio_sender_.Push(opus.data(), opus.size(), capture_time)) {
+            encoder_controller_.OnDropped();
         }
-    } else {
+    });
+    encoder_controller_.OnEncoded(esp_timer_get_time() - start_time, samples, opus_bytes);
+    if (encoder_controller_.Update()) {
+        opus_encoder_->SetComplexity(encoder_controller_.complexity());
+        TraceEncoderConfig();
+    }
+    return opus_bytes;
+}
+
+#if CONFIG_USE_SIMPLE_VAD
+// Runs on the background task. Voice is encoded as usual, silence skips the encoder and every frame of it
+// goes out as a packet holding only the TOC byte, which decoders play as concealment (the way opus DTX does),
+// so the server still gets one packet per frame and its own end-of-speech timing keeps working.
+void Application::EncodeUplinkChunk(std::vector<int16_t>& data, int64_t capture_time, bool voice) {
+    size_t frame_samples = 16000 * encoder_frame_duration_ / 1000;
+    if (voice) {
+        // The silence left over is shorter than a frame, dropping it keeps the frames aligned
+        uplink_silence_samples_ = 0;
+        uplink_frame_fill_ = (uplink_frame_fill_ + data.size()) % frame_samples;
+        uplink_voice_samples_ += data.size();
+        uplink_voice_bytes_ += EncodeUplink(data, capture_time);
+        return;
+    }
+
+    size_t silent_samples = data.size();
+    if (uplink_frame_fill_ > 0) {
+        // Complete the frame the encoder has started, its packet holds the end of the voice
+        size_t samples = std::min(data.size(), frame_samples - uplink_frame_fill_);
         data.resize(samples);
-        if (!codec->InputData(data)) {
-            return;
+        uplink_frame_fill_ = (uplink_frame_fill_ + samples) % frame_samples;
+        uplink_voice_samples_ += samples;
+        uplink_voice_bytes_ += EncodeUplink(data, capture_time);
+        silent_samples -= samples;
+    }
+
+    // SILK wideband, mono, one frame: configs 8 to 11 are 10, 20, 40 and 60 ms
+    static const int durations[] = {10, 20, 40, 60};
+    int config = 8 + (std::find(std::begin(durations), std::end(durations), encoder_frame_duration_) - std::begin(durations));
+    uint8_t toc = config << 3;
+    uplink_silence_samples_ += silent_samples;
+    while (uplink_silence_samples_ >= frame_samples) {
+        uplink_silence_samples_ -= frame_samples;
+        uplink_silent_frames_++;
+        AudioTrace::GetInstance().Record(kTraceUplinkOpus, &toc, 1);
+        if (!audio_sender_.Push(&toc, 1, capture_time)) {
+            encoder_controller_.OnDropped();
         }
     }
 }
 
+// Runs on the background task at the end of a listening turn
+void Application::ReportSilenceSuppression() {
+    size_t frame_samples = 16000 * encoder_frame_duration_ / 1000;
+    size_t voice_frames = uplink_voice_samples_ / frame_samples;
+    if (voice_frames + uplink_silent_frames_ > 0) {
+        // The silence would have cost about as much as the voice frames of the same turn
+        size_t bytes_per_frame = voice_frames > 0 ? uplink_voice_bytes_ / voice_frames : 0;
+        size_t saved = uplink_silent_frames_ * (bytes_per_frame > 1 ? bytes_per_frame - 1 : 0);
+        ESP_LOGI(TAG, "Uplink: %zu voice frames %zu bytes, %lu silent frames, about %zu bytes saved (%zu%%)",
+            voice_frames, uplink_voice_bytes_, (unsigned long)uplink_silent_frames_, saved,
+            saved * 100 / (uplink_voice_bytes_ + uplink_silent_frames_ + saved));
+    }
+    uplink_frame_fill_ = 0;
+    uplink_silence_samples_ = 0;
+    uplink_voice_samples_ = 0;
+    uplink_voice_bytes_ = 0;
+    uplink_silent_frames_ = 0;
+}
+#endif
+
+#if !CONFIG_USE_AUDIO_PROCESSOR
+// A buffer for the next encode job, with the capacity of an earlier chunk when one has been handed back
+std::vector<int16_t> Application::TakeUplinkChunk() {
+    std::lock_guard<std::mutex> lock(uplink_chunks_mutex_);
+    if (uplink_chunks_.empty()) {
+        return std::vector<int16_t>();
+    }
+    auto chunk = std::move(uplink_chunks_.back());
+    uplink_chunks_.pop_back();
+    return chunk;
+}
+
+// Runs on the background task, chunks of cancelled jobs are freed instead
+void Application::RecycleUplinkChunk(std::vector<int16_t>&& chunk) {
+    std::lock_guard<std::mutex> lock(uplink_chunks_mutex_);
+    if (uplink_chunks_.size() < AUDIO_UPLINK_CHUNK_POOL) {
+        uplink_chunks_.push_back(std::move(chunk));
+    }
+}
+#endif
+
+void Application::ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples) {
+    auto codec = Board::GetInstance().GetAudioCodec();
+    if (codec->input_sample_rate() == sample_rate) {
+        data.resize(samples);
+        codec->InputData(data);
+        return;
+    }
+
+    // samples counts all interleaved channels at the target sample rate
+    int channels = codec->input_channels();
+    int frames = samples * codec->input_sample_rate() / sample_rate / channels;
+    input_buffer_.resize(frames * channels);
+    if (!codec->InputData(input_buffer_)) {
+        return;
+    }
+
+    int resampled_frames = input_resamplers_[0].GetOutputSamples(frames);
+    data.resize(resampled_frames * channels);
+    if (channels == 1) {
+        input_resamplers_[0].Process(input_buffer_.data(), frames, data.data());
+        return;
+    }
+
+    // Resample every channel separately, then interleave them again into the output
+    planar_buffer_.resize(frames * channels);
+    planar_resampled_buffer_.resize(resampled_frames * channels);
+    DeinterleavePcm(input_buffer_.data(), planar_buffer_.data(), channels, frames);
+    for (int c = 0; c < channels; c++) {
+        input_resamplers_[c].Process(planar_buffer_.data() + c * frames, frames,
+            planar_resampled_buffer_.data() + c * resampled_frames);
+    }
+    InterleavePcm(planar_resampled_buffer_.data(), data.data(), channels, resampled_frames);
+}
+
 void Application::AbortSpeaking(AbortReason reason) {
     ESP_LOGI(TAG, "Abort speaking");
     aborted_ = true;
+    // The uplink queued before the abort is kept, in realtime mode it is the speech that interrupted
+    // The decode task drops the speech buffered on the device instead of playing it out
+    abort_time_ = esp_timer_get_time();
+    flush_output_ = true;
+    if (audio_decode_task_handle_ != nullptr) {
+        xTaskNotifyGive(audio_decode_task_handle_);
+    }
     protocol_->SendAbortSpeaking(reason);
 }
 
+// Runs on the decode task, writes mix_buffer_ to the codec
+void Application::WriteOutput() {
+    auto codec = Board::GetInstance().GetAudioCodec();
+    if (mix_buffer_.empty()) {
+        return;
+    }
+    codec->OutputData(mix_buffer_);
+    // OutputData returns once the samples fit into the DMA ring, the ring is full at that point
+    output_last_sample_ = mix_buffer_.back();
+    output_end_time_ = esp_timer_get_time()
+        + (int64_t)AUDIO_CODEC_DMA_DESC_NUM * AUDIO_CODEC_DMA_FRAME_NUM * 1000000 / codec->output_sample_rate();
+}
+
+// Runs on the decode task when speaking is aborted
+void Application::FlushSpeechOutput() {
+    auto codec = Board::GetInstance().GetAudioCodec();
+    // The DMA ring plays out, the I2S driver does not tell where it is reading and a cut there clicks.
+    // Behind it goes a few ms of the speech faded to silence, the rest of the speech is dropped
+    size_t fade_samples = codec->output_sample_rate() * AUDIO_OUTPUT_FADE_MS / 1000;
+    size_t queued = audio_mixer_.Available(kMixerVoiceSpeech);
+    ClearIncomingAudio();
+    ApplyJitterBufferReset();
+    size_t faded = audio_mixer_.FadeOut(kMixerVoiceSpeech, fade_samples);
+    size_t dropped = queued - faded;
+    if (faded == 0 && esp_timer_get_time() < output_end_time_) {
+        // The decoder has not got ahead of the ring, which ends in the middle of the speech: fade from its last sample
+        std::fill(mix_buffer_.begin(), mix_buffer_.begin() + fade_samples, output_last_sample_);
+        audio_mixer_.Push(kMixerVoiceSpeech, mix_buffer_.data(), fade_samples);
+        faded = audio_mixer_.FadeOut(kMixerVoiceSpeech, fade_samples);
+    }
+    // Written at once, the state may turn to listening and clear the mixer before the next round of the loop
+    while (codec->output_enabled() && audio_mixer_.Available(kMixerVoiceSpeech) > 0) {
+        mix_buffer_.resize(audio_mixer_.Mix(mix_buffer_.data(), faded));
+        WriteOutput();
+        mix_buffer_.resize(codec->output_sample_rate() * AUDIO_OUTPUT_CHUNK_MS / 1000);
+    }
+    audio_mixer_.Clear(kMixerVoiceSpeech);
+    ESP_LOGI(TAG, "Barge-in: silent %lld ms after the abort, %u ms of queued speech dropped",
+        (long long)((std::max(esp_timer_get_time(), output_end_time_) - abort_time_) / 1000),
+        (unsigned)(dropped * 1000 / codec->output_sample_rate()));
+}
+
+// Runs on the main loop once the decode task has played out the speech of a turn
+void Application::OnSpeechDrained() {
+    // Report the latency of the audio path once per turn, each report covers one turn
+    auto& metrics = LatencyMetrics::GetInstance();
+    if (protocol_ && metrics.total_count() > 0) {
+        protocol_->SendMetrics(metrics.ToJson(), encoder_controller_.ToJson());
+        metrics.Reset();
+    }
+    if (device_state_ == kDeviceStateSpeaking) {
+        if (listening_mode_ == kListeningModeManualStop) {
+            SetDeviceState(kDeviceStateIdle);
+        } else {
+            SetDeviceState(kDeviceStateListening);
+        }
+    }
+}
+
 void Application::SetListeningMode(ListeningMode mode) {
     listening_mode_ = mode;
     SetDeviceState(kDeviceStateListening);
@@ -797,8 +1290,22 @@ void Application::SetDeviceState(DeviceState state) {
     auto previous_state = device_state_;
     device_state_ = state;
     ESP_LOGI(TAG, "STATE: %s", STATE_STRINGS[device_state_]);
-    // The state is changed, wait for all background tasks to finish
-    background_task_->WaitForCompletion();
+    uint8_t trace_state = state;
+    AudioTrace::GetInstance().Record(kTraceDeviceState, &trace_state, sizeof(trace_state));
+    if (state == kDeviceStateIdle) {
+        // The session is over, the queued encode jobs are stale now
+        uplink_cancellation_.Cancel();
+    } else if (previous_state == kDeviceStateListening) {
+        // The end of the turn is still sent, let the queued encode jobs finish first
+        background_task_->WaitForCompletion(kBackgroundRealtime);
+    }
+#if CONFIG_USE_SIMPLE_VAD
+    if (previous_state == kDeviceStateListening) {
+        background_task_->Schedule([this]() {
+            ReportSilenceSuppression();
+        }, kBackgroundRealtime);
+    }
+#endif
 
     auto& board = Board::GetInstance();
     auto display = board.GetDisplay();
@@ -840,7 +1347,15 @@ void Application::SetDeviceState(DeviceState state) {
                     // FIXME: Wait for the speaker to empty the buffer
                     vTaskDelay(pdMS_TO_TICKS(120));
                 }
-                opus_encoder_->ResetState();
+                // Runs after the encode job in progress, if any, and before the first one of this turn
+                background_task_->Schedule([this]() {
+                    opus_encoder_->ResetState();
+                    audio_sender_.Clear();
+#if CONFIG_USE_SIMPLE_VAD
+                    uplink_frame_fill_ = 0;
+                    uplink_silence_samples_ = 0;
+#endif
+                }, kBackgroundRealtime);
 #if CONFIG_USE_WAKE_WORD_DETECT
                 wake_word_detect_.StopDetection();
 #endif
@@ -869,10 +1384,11 @@ void Application::SetDeviceState(DeviceState state) {
 }
 
 void Application::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    opus_decoder_->ResetState();
-    audio_decode_queue_.clear();
-    audio_decode_cv_.notify_all();
+    // The decoders are reset by the decode task, which is the only one using them
+    reset_decoder_ = true;
+    ClearIncomingAudio();
+    sound_queue_.Clear();
+    audio_mixer_.Clear();
     last_output_time_ = std::chrono::steady_clock::now();
     
     auto codec = Board::GetInstance().GetAudioCodec();
@@ -8,17 +8,27 @@
 
 #include <string>
 #include <mutex>
+#include <atomic>
 #include <list>
 #include <vector>
 #include <condition_variable>
 
 #include <opus_encoder.h>
 #include <opus_decoder.h>
-#include <opus_resampler.h>
 
 #include "protocol.h"
 #include "ota.h"
 #include "background_task.h"
+#include "sound_queue.h"
+#include "sound_cache.h"
+#include "latency_metrics.h"
+#include "audio_mixer.h"
+#include "jitter_buffer.h"
+#include "audio_packet_queue.h"
+#include "encoder_controller.h"
+#include "audio_sender.h"
+#include "audio_resampler.h"
+#include "task_ring.h"
 
 #if CONFIG_USE_WAKE_WORD_DETECT
 #include "wake_word_detect.h"
@@ -26,12 +36,22 @@
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "audio_processor.h"
 #endif
+#if CONFIG_USE_SIMPLE_VAD
+#include "voice_detector.h"
+#endif
 
 #define SCHEDULE_EVENT (1 << 0)
 #define AUDIO_INPUT_READY_EVENT (1 << 1)
 #define AUDIO_OUTPUT_READY_EVENT (1 << 2)
 #define CHECK_NEW_VERSION_DONE_EVENT (1 << 3)
 
+// Background workers, the second one needs PSRAM for its stack
+#define BACKGROUND_TASK_WORKERS portNUM_PROCESSORS
+#define BACKGROUND_TASK_STACK_SIZE (4096 * 8)
+
+// Tasks that can wait for the main loop without a heap allocation, more go to a list
+#define MAIN_TASK_RING_SIZE 32
+
 enum DeviceState {
     kDeviceStateUnknown,
     kDeviceStateStarting,
@@ -46,6 +66,49 @@ enum DeviceState {
 };
 
 #define OPUS_FRAME_DURATION_MS 60
+// Uplink frame duration proposed in realtime chat mode, shorter frames cut the capture latency
+#define OPUS_REALTIME_FRAME_DURATION_MS 20
+// Longest chunk read from the microphone per loop without the audio processor
+#define AUDIO_INPUT_READ_MS 30
+// Chunk buffers kept for reuse between the audio loop and the encode jobs
+#define AUDIO_UPLINK_CHUNK_POOL 4
+
+// Sounds that can be queued for playback at the same time
+#define SOUND_QUEUE_SIZE 8
+// Format of the p3 sound assets
+#define SOUND_SAMPLE_RATE 16000
+#define SOUND_FRAME_DURATION_MS 60
+// Frames decoded ahead of playback per mixer voice
+#define AUDIO_DECODE_LOOKAHEAD_FRAMES 3
+#define AUDIO_DECODE_TASK_PRIORITY 8
+// Opus decode, resampling, mixing and the sound callbacks, as much as the background task had
+#define AUDIO_DECODE_TASK_STACK_SIZE (4096 * 8)
+#define AUDIO_DECODE_TASK_CORE (portNUM_PROCESSORS > 1 ? 1 : 0)
+// Mixed audio written to the codec per call
+#define AUDIO_OUTPUT_CHUNK_MS 20
+// Speech faded out after the DMA ring when speaking is aborted
+#define AUDIO_OUTPUT_FADE_MS 10
+// Gain of the speech while a UI sound plays over it
+#define AUDIO_MIXER_DUCKING_GAIN 0.3f
+// Largest opus packet accepted from the server
+#define AUDIO_PACKET_MAX_SIZE 1024
+// Reorder window of the jitter buffer for the incoming TTS stream, in packets
+#define AUDIO_JITTER_BUFFER_SLOTS 16
+// Packets handed from the network task to the decode task, a power of 2
+#define AUDIO_INCOMING_QUEUE_SLOTS 32
+// Encoded uplink packets waiting for the network, and what happens when they don't fit
+#define AUDIO_SENDER_QUEUE_SLOTS 8
+#define AUDIO_SENDER_TASK_PRIORITY 6
+// The sender task runs SendAudio, sized like the main task that used to run it
+#define AUDIO_SENDER_TASK_STACK_SIZE 8192
+#define AUDIO_SENDER_TASK_CORE 0
+#if CONFIG_AUDIO_SENDER_COALESCE
+#define AUDIO_SENDER_POLICY kAudioSenderCoalesce
+#else
+#define AUDIO_SENDER_POLICY kAudioSenderDropOldest
+#endif
+// Maximum interleaved channels delivered by AudioCodec::InputData (microphones + reference)
+#define AUDIO_INPUT_MAX_CHANNELS 4
 
 class Application {
 public:
@@ -60,7 +123,12 @@ public:
     void Start();
     DeviceState GetDeviceState() const { return device_state_; }
     bool IsVoiceDetected() const { return voice_detected_; }
-    void Schedule(std::function<void()> callback);
+    // Add a async task to MainLoop
+    template <typename F>
+    void Schedule(F&& callback) {
+        main_tasks_.Push(std::forward<F>(callback));
+        xEventGroupSetBits(event_group_, SCHEDULE_EVENT);
+    }
     void SetDeviceState(DeviceState state);
     void Alert(const char* status, const char* message, const char* emotion = "", const std::string_view& sound = "");
     void DismissAlert();
@@ -71,7 +139,8 @@ public:
     void UpdateIotStates();
     void Reboot();
     void WakeWordInvoke(const std::string& wake_word);
-    void PlaySound(const std::string_view& sound);
+    // on_complete runs on the audio_decode task and must not block, Schedule() anything longer to the main loop
+    void PlaySound(const std::string_view& sound, std::function<void()> on_complete = nullptr);
     bool CanEnterSleepMode();
 
 private:
@@ -83,10 +152,21 @@ private:
 #endif
 #if CONFIG_USE_AUDIO_PROCESSOR
     AudioProcessor audio_processor_;
+#endif
+#if CONFIG_USE_SIMPLE_VAD
+    // Without the AFE, silent chunks go out as one byte opus packets instead of being encoded
+    VoiceDetector voice_detector_;
+    bool voice_detector_running_ = false;  // only touched by the audio loop
+    // Position in the current encoder frame and the silence not yet sent, only touched by the background task
+    size_t uplink_frame_fill_ = 0;
+    size_t uplink_silence_samples_ = 0;
+    // Uplink of the current listening turn, for the bytes saved by the suppression
+    size_t uplink_voice_samples_ = 0;
+    size_t uplink_voice_bytes_ = 0;
+    uint32_t uplink_silent_frames_ = 0;
 #endif
     Ota ota_;
-    std::mutex mutex_;
-    std::list<std::function<void()>> main_tasks_;
+    TaskRing main_tasks_{MAIN_TASK_RING_SIZE};
     std::unique_ptr<Protocol> protocol_;
     EventGroupHandle_t event_group_ = nullptr;
     esp_timer_handle_t clock_timer_handle_ = nullptr;
@@ -99,35 +179,114 @@ private:
 #endif
     bool aborted_ = false;
     bool voice_detected_ = false;
-    bool busy_decoding_audio_ = false;
+    std::atomic<bool> reset_decoder_{false};
+    // Set by AbortSpeaking for the decode task, abort_time_ is when it was set
+    std::atomic<bool> flush_output_{false};
+    int64_t abort_time_ = 0;
+    // Last sample written to the codec and when the DMA ring will have played it, owned by the decode task
+    int16_t output_last_sample_ = 0;
+    int64_t output_end_time_ = 0;
     int clock_ticks_ = 0;
+    uint32_t latency_dump_count_ = 0;
     TaskHandle_t check_new_version_task_handle_ = nullptr;
 
     // Audio encode / decode
     TaskHandle_t audio_loop_task_handle_ = nullptr;
+    TaskHandle_t audio_decode_task_handle_ = nullptr;
+    // Set when the server ends its speech, cleared by the decode task once the speech has played out
+    std::atomic<bool> speech_ending_{false};
+    // Output statistics of the decode task, reported and reset by the clock timer
+    std::mutex output_stats_mutex_;
+    uint32_t output_underruns_ = 0;
+    int64_t output_slack_sum_us_ = 0;
+    int64_t output_slack_min_us_ = INT64_MAX;
+    uint32_t output_slack_count_ = 0;
+    JitterBuffer::Statistics jitter_statistics_;
     BackgroundTask* background_task_ = nullptr;
+    // Cancelled when the device goes idle, so the encode jobs queued before are skipped. Not on aborts, the
+    // barge-in that caused one is being encoded
+    CancellationSource uplink_cancellation_;
     std::chrono::steady_clock::time_point last_output_time_;
-    std::list<std::vector<uint8_t>> audio_decode_queue_;
-    std::condition_variable audio_decode_cv_;
+    // The server stream goes through the jitter buffer, local sounds are played from flash through the sound queue.
+    // The network task hands packets over through the lock-free incoming queue, the jitter buffer belongs to the
+    // decode task. Other tasks ask for a reset or a clear through jitter_buffer_reset_: a frame duration to reset
+    // to, or -1 to clear it.
+    AudioPacketQueue incoming_queue_{AUDIO_INCOMING_QUEUE_SLOTS, AUDIO_PACKET_MAX_SIZE};
+    std::atomic<uint32_t> incoming_dropped_{0};
+    std::vector<uint8_t> incoming_packet_;
+    JitterBuffer jitter_buffer_{AUDIO_JITTER_BUFFER_SLOTS, AUDIO_PACKET_MAX_SIZE};
+    std::atomic<int> jitter_buffer_reset_{0};
+    SoundQueue sound_queue_{SOUND_QUEUE_SIZE};
+    SoundCache sound_cache_{CONFIG_SOUND_CACHE_SIZE * 1024};
+    // Sound being decoded for the cache, only touched by the background task
+    const char* recording_sound_ = nullptr;
+    std::vector<int16_t> recording_pcm_;
+    int64_t recording_decode_us_ = 0;
+    std::vector<uint8_t> decode_packet_;
+    std::vector<uint8_t> sound_packet_;
+    // Speech and UI sounds are decoded separately and mixed in front of the codec
+    AudioMixer audio_mixer_;
+    std::vector<int16_t> speech_pcm_;
+    std::vector<int16_t> sound_pcm_;
+    std::vector<int16_t> resampled_pcm_;
+    std::vector<int16_t> mix_buffer_;
 
     std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
+    // Uplink frame duration proposed in each hello, the server may pick another one per session
+    int uplink_frame_duration_ = OPUS_FRAME_DURATION_MS;
+    // Settings of the current encoder, only touched by the background task after Start()
+    int encoder_frame_duration_ = OPUS_FRAME_DURATION_MS;
+    EncoderController encoder_controller_{CONFIG_OPUS_ENCODER_COMPLEXITY_MIN, CONFIG_OPUS_ENCODER_COMPLEXITY_MAX};
+    AudioSender audio_sender_{AUDIO_SENDER_QUEUE_SLOTS, AUDIO_PACKET_MAX_SIZE, AUDIO_SENDER_POLICY};
     std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
+    std::unique_ptr<OpusDecoderWrapper> sound_decoder_;
 
-    OpusResampler input_resampler_;
-    OpusResampler reference_resampler_;
-    OpusResampler output_resampler_;
+    // One resampler per input channel (microphones and reference), configured in Start()
+    AudioResampler input_resamplers_[AUDIO_INPUT_MAX_CHANNELS];
+    AudioResampler output_resampler_;
+    AudioResampler sound_resampler_;
+    // Scratch buffers of ReadAudio, kept across calls so steady state reads do not allocate
+    std::vector<int16_t> input_buffer_;
+    std::vector<int16_t> planar_buffer_;
+    std::vector<int16_t> planar_resampled_buffer_;
+    std::vector<int16_t> input_data_;
+#if !CONFIG_USE_AUDIO_PROCESSOR
+    std::mutex uplink_chunks_mutex_;
+    std::vector<std::vector<int16_t>> uplink_chunks_;
+#endif
 
     void MainEventLoop();
     void OnAudioInput();
-    void OnAudioOutput();
     void ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
+    void FlushSpeechOutput();
+    void WriteOutput();
+    void OnSpeechDrained();
+    void ConfigureEncoder(int frame_duration);
+    void TraceEncoderConfig();
+    size_t EncodeUplink(std::vector<int16_t>& data, int64_t capture_time);
+#if !CONFIG_USE_AUDIO_PROCESSOR
+    std::vector<int16_t> TakeUplinkChunk();
+    void RecycleUplinkChunk(std::vector<int16_t>&& chunk);
+#endif
+#if CONFIG_USE_SIMPLE_VAD
+    void EncodeUplinkChunk(std::vector<int16_t>& data, int64_t capture_time, bool voice);
+    void ReportSilenceSuppression();
+#endif
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
+    void DecodeSpeech(int sample_rate, int frame_duration);
+    void DecodeSound(const SoundFrame& frame);
+    void RecordSound(const SoundFrame& frame, const std::vector<int16_t>& pcm, int64_t decode_us);
     void CheckNewVersion();
     void ShowActivationCode();
     void OnClockTimer();
     void SetListeningMode(ListeningMode mode);
     void AudioLoop();
+    void AudioDecodeLoop();
+    void DecodeAhead();
+    void DrainIncomingAudio();
+    void ApplyJitterBufferReset();
+    void ClearIncomingAudio();
 };
 
 #endif // _APPLICATION_H_
@@ -3,7 +3,10 @@
 #include "settings.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
 #include <cstring>
+#include <algorithm>
 #include <driver/i2s_common.h>
 
 #define TAG "AudioCodec"
@@ -12,18 +15,109 @@ AudioCodec::AudioCodec() {
 }
 
 AudioCodec::~AudioCodec() {
+    if (reference_ring_ != nullptr) {
+        heap_caps_free(reference_ring_);
+    }
 }
 
 void AudioCodec::OutputData(std::vector<int16_t>& data) {
+    if (software_reference_) {
+        StoreReference(data.data(), data.size());
+    }
     Write(data.data(), data.size());
 }
 
+void AudioCodec::EnableSoftwareReference(int delay_ms) {
+    if (input_reference_ || software_reference_) {
+        return;
+    }
+    reference_size_ = input_sample_rate_ * AUDIO_CODEC_REFERENCE_RING_MS / 1000;
+    reference_ring_ = (int16_t*)heap_caps_malloc(reference_size_ * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+    if (reference_ring_ == nullptr) {
+        reference_ring_ = (int16_t*)heap_caps_malloc(reference_size_ * sizeof(int16_t), MALLOC_CAP_8BIT);
+    }
+    if (reference_ring_ == nullptr) {
+        ESP_LOGE(TAG, "No memory for the software reference");
+        return;
+    }
+    if (output_sample_rate_ != input_sample_rate_) {
+        reference_resampler_.Configure(output_sample_rate_, input_sample_rate_);
+    }
+    // A write reaches the speaker after the samples already queued in the DMA ring, which stays full while playing.
+    // The delay covers the rest: the input DMA, the converters and the air
+    reference_latency_ = (int64_t)AUDIO_CODEC_DMA_DESC_NUM * AUDIO_CODEC_DMA_FRAME_NUM * input_sample_rate_ / output_sample_rate_;
+    reference_delay_ = input_sample_rate_ * delay_ms / 1000;
+    software_reference_ = true;
+    ESP_LOGI(TAG, "Software reference enabled, output latency %d samples, delay %d ms", reference_latency_, delay_ms);
+}
+
+// The sample clock at this moment, extrapolated from the last read. Requires reference_mutex_
+int64_t AudioCodec::CurrentInputPosition() {
+    if (input_time_ == 0) {
+        return input_position_;
+    }
+    return input_position_ + (esp_timer_get_time() - input_time_) * input_sample_rate_ / 1000000;
+}
+
+void AudioCodec::StoreReference(const int16_t* data, size_t samples) {
+    const int16_t* pcm = data;
+    if (output_sample_rate_ != input_sample_rate_) {
+        reference_pcm_.resize(reference_resampler_.GetOutputSamples(samples));
+        reference_resampler_.Process(data, samples, reference_pcm_.data());
+        pcm = reference_pcm_.data();
+        samples = reference_pcm_.size();
+    }
+
+    std::lock_guard<std::mutex> lock(reference_mutex_);
+    // After a pause the output starts again behind the latency of the ring, the gap is silence
+    int64_t start = std::max(reference_end_, CurrentInputPosition() + reference_latency_);
+    int64_t gap = std::min<int64_t>(start - reference_end_, reference_size_);
+    for (int64_t position = start - gap; position < start; position++) {
+        reference_ring_[position % reference_size_] = 0;
+    }
+    for (size_t i = 0; i < samples; i++) {
+        reference_ring_[(start + i) % reference_size_] = pcm[i];
+    }
+    reference_end_ = start + samples;
+}
+
+bool AudioCodec::InputDataWithReference(std::vector<int16_t>& data) {
+    int channels = input_channels_ + 1;
+    size_t frames = data.size() / channels;
+    mic_buffer_.resize(frames * input_channels_);
+    if (Read(mic_buffer_.data(), mic_buffer_.size()) <= 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(reference_mutex_);
+    // The echo of the output played at a position is captured reference_delay_ samples later
+    int64_t position = input_position_ - reference_delay_;
+    int64_t oldest = reference_end_ - (int64_t)reference_size_;
+    for (size_t i = 0; i < frames; i++, position++) {
+        for (int c = 0; c < input_channels_; c++) {
+            data[i * channels + c] = mic_buffer_[i * input_channels_ + c];
+        }
+        bool stored = position >= 0 && position >= oldest && position < reference_end_;
+        data[i * channels + input_channels_] = stored ? reference_ring_[position % reference_size_] : 0;
+    }
+    input_position_ += frames;
+    input_time_ = esp_timer_get_time();
+    return true;
+}
+
 bool AudioCodec::InputData(std::vector<int16_t>& data) {
-    int samples = Read(data.data(), data.size());
-    if (samples > 0) {
-        return true;
+    bool read;
+    if (software_reference_) {
+        read = InputDataWithReference(data);
+    } else {
+        read = Read(data.data(), data.size()) > 0;
+    }
+    if (read) {
+        // The read returns when the last sample has been captured, the first one came a chunk earlier
+        size_t frames = data.size() / input_channels();
+        input_capture_time_ = esp_timer_get_time() - (int64_t)frames * 1000000 / input_sample_rate_;
     }
-    return false;
+    return read;
 }
 
 void AudioCodec::Start() {
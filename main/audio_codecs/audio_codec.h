@@ -8,11 +8,15 @@
 #include <vector>
 #include <string>
 #include <functional>
+#include <mutex>
 
 #include "board.h"
+#include "audio_resampler.h"
 
 #define AUDIO_CODEC_DMA_DESC_NUM 6
 #define AUDIO_CODEC_DMA_FRAME_NUM 240
+// Output kept for the software echo reference, enough for the DMA ring, the delay and a few reads
+#define AUDIO_CODEC_REFERENCE_RING_MS 500
 
 class AudioCodec {
 public:
@@ -26,12 +30,18 @@ public:
     void Start();
     void OutputData(std::vector<int16_t>& data);
     bool InputData(std::vector<int16_t>& data);
+    // esp_timer time at which the first sample returned by the last InputData was captured
+    inline int64_t input_capture_time() const { return input_capture_time_; }
+    // For codecs without a reference channel: the PCM written to the output is kept and returned by InputData
+    // as an extra last channel, delayed to line up with the echo in the microphones. Call before Start()
+    void EnableSoftwareReference(int delay_ms);
 
     inline bool duplex() const { return duplex_; }
-    inline bool input_reference() const { return input_reference_; }
+    inline bool input_reference() const { return input_reference_ || software_reference_; }
+    inline bool software_reference() const { return software_reference_; }
     inline int input_sample_rate() const { return input_sample_rate_; }
     inline int output_sample_rate() const { return output_sample_rate_; }
-    inline int input_channels() const { return input_channels_; }
+    inline int input_channels() const { return input_channels_ + (software_reference_ ? 1 : 0); }
     inline int output_channels() const { return output_channels_; }
     inline int output_volume() const { return output_volume_; }
     inline bool input_enabled() const { return input_enabled_; }
@@ -50,9 +60,31 @@ protected:
     int input_channels_ = 1;
     int output_channels_ = 1;
     int output_volume_ = 70;
+    int64_t input_capture_time_ = 0;
 
+    // Read and Write only see the channels of the hardware, input_channels_ does not count the software reference
     virtual int Read(int16_t* dest, int samples) = 0;
     virtual int Write(const int16_t* data, int samples) = 0;
+
+private:
+    // Software reference: a ring of the output at the input sample rate, indexed by a sample clock that counts
+    // the input frames read. reference_end_ is where the written output ends on that clock
+    bool software_reference_ = false;
+    std::mutex reference_mutex_;
+    int16_t* reference_ring_ = nullptr;
+    size_t reference_size_ = 0;
+    int64_t reference_end_ = 0;
+    int64_t input_position_ = 0;
+    int64_t input_time_ = 0;
+    int reference_delay_ = 0;
+    int reference_latency_ = 0;
+    AudioResampler reference_resampler_;
+    std::vector<int16_t> reference_pcm_;
+    std::vector<int16_t> mic_buffer_;
+
+    int64_t CurrentInputPosition();
+    void StoreReference(const int16_t* data, size_t samples);
+    bool InputDataWithReference(std::vector<int16_t>& data);
 };
 
 #endif // _AUDIO_CODEC_H
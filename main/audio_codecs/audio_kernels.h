@@ -0,0 +1,89 @@
+#ifndef _AUDIO_KERNELS_H
+#define _AUDIO_KERNELS_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Small PCM kernels used on the audio hot paths.
+// The loops are written with restrict pointers and fixed strides so the compiler can unroll and vectorize them.
+
+// Samples per inner loop of the element-wise kernels. A fixed trip count is what the cheap vectorizer cost
+// model of -O2 accepts, the remainder runs one sample at a time
+#define AUDIO_KERNEL_BLOCK 8
+
+// Split interleaved frames into planar channels, channel c is written to planar + c * frames
+inline void DeinterleavePcm(const int16_t* __restrict src, int16_t* __restrict planar, int channels, size_t frames) {
+    if (channels == 2) {
+        int16_t* __restrict ch0 = planar;
+        int16_t* __restrict ch1 = planar + frames;
+        for (size_t i = 0; i < frames; i++) {
+            ch0[i] = src[2 * i];
+            ch1[i] = src[2 * i + 1];
+        }
+        return;
+    }
+    for (int c = 0; c < channels; c++) {
+        int16_t* __restrict dst = planar + c * frames;
+        const int16_t* __restrict s = src + c;
+        for (size_t i = 0; i < frames; i++) {
+            dst[i] = s[i * channels];
+        }
+    }
+}
+
+// Merge planar channels (channel c at planar + c * frames) into interleaved frames
+inline void InterleavePcm(const int16_t* __restrict planar, int16_t* __restrict dst, int channels, size_t frames) {
+    if (channels == 2) {
+        const int16_t* __restrict ch0 = planar;
+        const int16_t* __restrict ch1 = planar + frames;
+        for (size_t i = 0; i < frames; i++) {
+            dst[2 * i] = ch0[i];
+            dst[2 * i + 1] = ch1[i];
+        }
+        return;
+    }
+    for (int c = 0; c < channels; c++) {
+        const int16_t* __restrict s = planar + c * frames;
+        int16_t* __restrict d = dst + c;
+        for (size_t i = 0; i < frames; i++) {
+            d[i * channels] = s[i];
+        }
+    }
+}
+
+// Scale 16-bit samples into 32-bit I2S slots, gain_q16 is in [0, 65536] (Q16, unity at most).
+// With the gain capped at unity the product always fits in 32 bits, so no clamping is needed.
+inline void ScalePcm16To32(const int16_t* __restrict src, int32_t* __restrict dst, int32_t gain_q16, size_t samples) {
+    size_t blocked = samples - samples % AUDIO_KERNEL_BLOCK;
+    for (size_t i = 0; i < blocked; i += AUDIO_KERNEL_BLOCK) {
+        for (size_t j = 0; j < AUDIO_KERNEL_BLOCK; j++) {
+            dst[i + j] = (int32_t)src[i + j] * gain_q16;
+        }
+    }
+    for (size_t i = blocked; i < samples; i++) {
+        dst[i] = (int32_t)src[i] * gain_q16;
+    }
+}
+
+// One sample of ShiftSaturatePcm32To16
+inline int16_t ShiftSaturateSample(int32_t sample, int shift) {
+    int32_t value = sample >> shift;
+    value = value > INT16_MAX ? INT16_MAX : value;
+    value = value < -INT16_MAX ? -INT16_MAX : value;
+    return (int16_t)value;
+}
+
+// Convert 32-bit I2S microphone slots to 16-bit samples, shifting right and saturating to [-32767, 32767]
+inline void ShiftSaturatePcm32To16(const int32_t* __restrict src, int16_t* __restrict dst, int shift, size_t samples) {
+    size_t blocked = samples - samples % AUDIO_KERNEL_BLOCK;
+    for (size_t i = 0; i < blocked; i += AUDIO_KERNEL_BLOCK) {
+        for (size_t j = 0; j < AUDIO_KERNEL_BLOCK; j++) {
+            dst[i + j] = ShiftSaturateSample(src[i + j], shift);
+        }
+    }
+    for (size_t i = blocked; i < samples; i++) {
+        dst[i] = ShiftSaturateSample(src[i], shift);
+    }
+}
+
+#endif // _AUDIO_KERNELS_H
@@ -1,11 +1,25 @@
 #include "no_audio_codec.h"
+#include "audio_kernels.h"
 
 #include <esp_log.h>
+#include <esp_heap_caps.h>
 #include <cmath>
 #include <cstring>
+#include <cassert>
 
 #define TAG "NoAudioCodec"
 
+NoAudioCodec::NoAudioCodec() {
+    output_buffer_ = (int32_t*)heap_caps_malloc(NO_AUDIO_CODEC_CHUNK_SAMPLES * sizeof(int32_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    assert(output_buffer_ != nullptr);
+}
+
+// For the codecs whose microphone is read through NoAudioCodec::Read, the PDM one reads 16-bit samples in place
+void NoAudioCodec::CreateInputBuffer() {
+    input_buffer_ = (int32_t*)heap_caps_malloc(NO_AUDIO_CODEC_CHUNK_SAMPLES * sizeof(int32_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    assert(input_buffer_ != nullptr);
+}
+
 NoAudioCodec::~NoAudioCodec() {
     if (rx_handle_ != nullptr) {
         ESP_ERROR_CHECK(i2s_channel_disable(rx_handle_));
@@ -13,10 +27,13 @@ NoAudioCodec::~NoAudioCodec() {
     if (tx_handle_ != nullptr) {
         ESP_ERROR_CHECK(i2s_channel_disable(tx_handle_));
     }
+    heap_caps_free(output_buffer_);
+    heap_caps_free(input_buffer_);
 }
 
 NoAudioCodecDuplex::NoAudioCodecDuplex(int input_sample_rate, int output_sample_rate, gpio_num_t bclk, gpio_num_t ws, gpio_num_t dout, gpio_num_t din) {
     duplex_ = true;
+    CreateInputBuffer();
     input_sample_rate_ = input_sample_rate;
     output_sample_rate_ = output_sample_rate;
 
@@ -76,6 +93,7 @@ NoAudioCodecDuplex::NoAudioCodecDuplex(int input_sample_rate, int output_sample_
 
 ATK_NoAudioCodecDuplex::ATK_NoAudioCodecDuplex(int input_sample_rate, int output_sample_rate, gpio_num_t bclk, gpio_num_t ws, gpio_num_t dout, gpio_num_t din) {
     duplex_ = true;
+    CreateInputBuffer();
     input_sample_rate_ = input_sample_rate;
     output_sample_rate_ = output_sample_rate;
 
@@ -134,6 +152,7 @@ ATK_NoAudioCodecDuplex::ATK_NoAudioCodecDuplex(int input_sample_rate, int output
 
 NoAudioCodecSimplex::NoAudioCodecSimplex(int input_sample_rate, int output_sample_rate, gpio_num_t spk_bclk, gpio_num_t spk_ws, gpio_num_t spk_dout, gpio_num_t mic_sck, gpio_num_t mic_ws, gpio_num_t mic_din) {
     duplex_ = false;
+    CreateInputBuffer();
     input_sample_rate_ = input_sample_rate;
     output_sample_rate_ = output_sample_rate;
 
@@ -203,6 +222,7 @@ NoAudioCodecSimplex::NoAudioCodecSimplex(int input_sample_rate, int output_sampl
 
 NoAudioCodecSimplex::NoAudioCodecSimplex(int input_sample_rate, int output_sample_rate, gpio_num_t spk_bclk, gpio_num_t spk_ws, gpio_num_t spk_dout, i2s_std_slot_mask_t spk_slot_mask, gpio_num_t mic_sck, gpio_num_t mic_ws, gpio_num_t mic_din, i2s_std_slot_mask_t mic_slot_mask){
     duplex_ = false;
+    CreateInputBuffer();
     input_sample_rate_ = input_sample_rate;
     output_sample_rate_ = output_sample_rate;
 
@@ -336,59 +356,62 @@ NoAudioCodecSimplexPdm::NoAudioCodecSimplexPdm(int input_sample_rate, int output
 }
 
 int NoAudioCodec::Write(const int16_t* data, int samples) {
-    std::vector<int32_t> buffer(samples);
-
-    // output_volume_: 0-100
-    // volume_factor_: 0-65536
-    int32_t volume_factor = pow(double(output_volume_) / 100.0, 2) * 65536;
-    for (int i = 0; i < samples; i++) {
-        int64_t temp = int64_t(data[i]) * volume_factor; // 使用 int64_t 进行乘法运算
-        if (temp > INT32_MAX) {
-            buffer[i] = INT32_MAX;
-        } else if (temp < INT32_MIN) {
-            buffer[i] = INT32_MIN;
-        } else {
-            buffer[i] = static_cast<int32_t>(temp);
-        }
+    // The volume is also restored from the settings in Start(), so the gain follows output_volume_ here
+    if (output_gain_volume_ != output_volume_) {
+        // output_volume_: 0-100
+        // output_gain_: 0-65536
+        int volume = output_volume_ < 0 ? 0 : (output_volume_ > 100 ? 100 : output_volume_);
+        output_gain_ = pow(double(volume) / 100.0, 2) * 65536;
+        output_gain_volume_ = output_volume_;
     }
 
-    size_t bytes_written;
-    ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, buffer.data(), samples * sizeof(int32_t), &bytes_written, portMAX_DELAY));
-    return bytes_written / sizeof(int32_t);
+    size_t total_written = 0;
+    for (int offset = 0; offset < samples; offset += NO_AUDIO_CODEC_CHUNK_SAMPLES) {
+        int count = samples - offset;
+        if (count > NO_AUDIO_CODEC_CHUNK_SAMPLES) {
+            count = NO_AUDIO_CODEC_CHUNK_SAMPLES;
+        }
+        ScalePcm16To32(data + offset, output_buffer_, output_gain_, count);
+
+        size_t bytes_written;
+        ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, output_buffer_, count * sizeof(int32_t), &bytes_written, portMAX_DELAY));
+        total_written += bytes_written;
+    }
+    return total_written / sizeof(int32_t);
 }
 
 int NoAudioCodec::Read(int16_t* dest, int samples) {
-    size_t bytes_read;
-
-    std::vector<int32_t> bit32_buffer(samples);
-    if (i2s_channel_read(rx_handle_, bit32_buffer.data(), samples * sizeof(int32_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
-        ESP_LOGE(TAG, "Read Failed!");
-        return 0;
-    }
+    int total_read = 0;
+    while (total_read < samples) {
+        int count = samples - total_read;
+        if (count > NO_AUDIO_CODEC_CHUNK_SAMPLES) {
+            count = NO_AUDIO_CODEC_CHUNK_SAMPLES;
+        }
 
-    samples = bytes_read / sizeof(int32_t);
-    for (int i = 0; i < samples; i++) {
-        int32_t value = bit32_buffer[i] >> 12;
-        dest[i] = (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
+        size_t bytes_read;
+        if (i2s_channel_read(rx_handle_, input_buffer_, count * sizeof(int32_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
+            ESP_LOGE(TAG, "Read Failed!");
+            return total_read;
+        }
+        count = bytes_read / sizeof(int32_t);
+        ShiftSaturatePcm32To16(input_buffer_, dest + total_read, 12, count);
+        total_read += count;
+        if (count == 0) {
+            break;
+        }
     }
-    return samples;
+    return total_read;
 }
 
 int NoAudioCodecSimplexPdm::Read(int16_t* dest, int samples) {
     size_t bytes_read;
 
-    // PDM 解调后的数据位宽为 16 位
-    std::vector<int16_t> bit16_buffer(samples);
-    if (i2s_channel_read(rx_handle_, bit16_buffer.data(), samples * sizeof(int16_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
+    // PDM 解调后的数据位宽为 16 位，直接读入目标缓冲区
+    if (i2s_channel_read(rx_handle_, dest, samples * sizeof(int16_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
         ESP_LOGE(TAG, "Read Failed!");
         return 0;
     }
 
     // 计算实际读取的样本数
-    samples = bytes_read / sizeof(int16_t);
-
-    // 将 16 位数据直接复制到目标缓冲区
-    memcpy(dest, bit16_buffer.data(), samples * sizeof(int16_t));
-
-    return samples;
+    return bytes_read / sizeof(int16_t);
 }
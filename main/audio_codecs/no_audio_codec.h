@@ -6,12 +6,27 @@
 #include <driver/gpio.h>
 #include <driver/i2s_pdm.h>
 
+// Samples converted per i2s_channel_write / i2s_channel_read call
+#define NO_AUDIO_CODEC_CHUNK_SAMPLES (AUDIO_CODEC_DMA_FRAME_NUM * 2)
+
 class NoAudioCodec : public AudioCodec {
 private:
+    // DMA capable 32-bit staging buffers, reused by every Write / Read.
+    // The input one is only allocated by the codecs reading 32-bit I2S slots, see CreateInputBuffer
+    int32_t* output_buffer_ = nullptr;
+    int32_t* input_buffer_ = nullptr;
+    // Q16 output gain and the volume it was computed for
+    int32_t output_gain_ = 0;
+    int output_gain_volume_ = -1;
+
     virtual int Write(const int16_t* data, int samples) override;
     virtual int Read(int16_t* dest, int samples) override;
 
+protected:
+    void CreateInputBuffer();
+
 public:
+    NoAudioCodec();
     virtual ~NoAudioCodec();
 };
 
@@ -34,7 +49,7 @@ public:
 class NoAudioCodecSimplexPdm : public NoAudioCodec {
 public:
     NoAudioCodecSimplexPdm(int input_sample_rate, int output_sample_rate, gpio_num_t spk_bclk, gpio_num_t spk_ws, gpio_num_t spk_dout, gpio_num_t mic_sck,  gpio_num_t mic_din);
-    int Read(int16_t* dest, int samples);
+    int Read(int16_t* dest, int samples) override;
 };
 
 #endif // _NO_AUDIO_CODEC_H
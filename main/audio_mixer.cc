@@ -0,0 +1,167 @@
+#include "audio_mixer.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+#include <cassert>
+
+#define TAG "AudioMixer"
+
+AudioMixer::AudioMixer() {
+}
+
+AudioMixer::~AudioMixer() {
+    for (auto& voice : voices_) {
+        heap_caps_free(voice.buffer);
+    }
+}
+
+void AudioMixer::Initialize(size_t voice_capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = voice_capacity;
+    for (auto& voice : voices_) {
+        heap_caps_free(voice.buffer);
+        voice.buffer = (int16_t*)heap_caps_malloc(capacity_ * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+        if (voice.buffer == nullptr) {
+            voice.buffer = (int16_t*)heap_caps_malloc(capacity_ * sizeof(int16_t), MALLOC_CAP_8BIT);
+        }
+        assert(voice.buffer != nullptr);
+        voice.read = 0;
+        voice.count = 0;
+    }
+}
+
+int32_t AudioMixer::ToQ15(float gain) {
+    if (gain < 0) {
+        gain = 0;
+    } else if (gain > 2) {
+        gain = 2;
+    }
+    return (int32_t)(gain * 32768 + 0.5f);
+}
+
+void AudioMixer::SetGain(MixerVoice voice, float gain) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    voices_[voice].gain = ToQ15(gain);
+}
+
+void AudioMixer::SetDucking(float gain) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ducking_gain_ = ToQ15(gain);
+}
+
+size_t AudioMixer::Push(MixerVoice voice, const int16_t* samples, size_t count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& v = voices_[voice];
+    size_t space = capacity_ - v.count;
+    if (count > space) {
+        ESP_LOGW(TAG, "Voice %d overflow, %u samples dropped", voice, (unsigned)(count - space));
+        count = space;
+    }
+
+    size_t write = (v.read + v.count) % capacity_;
+    size_t first = capacity_ - write;
+    if (first > count) {
+        first = count;
+    }
+    memcpy(v.buffer + write, samples, first * sizeof(int16_t));
+    memcpy(v.buffer, samples + first, (count - first) * sizeof(int16_t));
+    v.count += count;
+    return count;
+}
+
+size_t AudioMixer::Available(MixerVoice voice) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return voices_[voice].count;
+}
+
+bool AudioMixer::Empty() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return voices_[kMixerVoiceSpeech].count == 0 && voices_[kMixerVoiceUi].count == 0;
+}
+
+void AudioMixer::Clear(MixerVoice voice) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    voices_[voice].read = 0;
+    voices_[voice].count = 0;
+}
+
+void AudioMixer::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& voice : voices_) {
+        voice.read = 0;
+        voice.count = 0;
+    }
+    speech_duck_ = 32768;
+}
+
+size_t AudioMixer::FadeOut(MixerVoice voice, size_t samples) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& v = voices_[voice];
+    size_t n = v.count < samples ? v.count : samples;
+    // The gain steps from (n - 1) / n down to 0, the sample after the last one is silence
+    size_t index = v.read;
+    for (size_t i = 0; i < n; i++) {
+        v.buffer[index] = (int16_t)((int32_t)v.buffer[index] * (int32_t)(n - 1 - i) / (int32_t)n);
+        if (++index == capacity_) {
+            index = 0;
+        }
+    }
+    v.count = n;
+    return n;
+}
+
+size_t AudioMixer::Mix(int16_t* out, size_t max_samples) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& speech = voices_[kMixerVoiceSpeech];
+    auto& ui = voices_[kMixerVoiceUi];
+
+    size_t n;
+    if (speech.count > 0 && ui.count > 0) {
+        n = speech.count < ui.count ? speech.count : ui.count;
+    } else {
+        n = speech.count + ui.count;
+    }
+    if (n > max_samples) {
+        n = max_samples;
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    // Ramp the ducking linearly over the chunk
+    int32_t duck_from = speech_duck_;
+    int32_t duck_to = ui.count > 0 ? ducking_gain_ : 32768;
+    size_t speech_n = speech.count < n ? speech.count : n;
+    size_t ui_n = ui.count < n ? ui.count : n;
+    int32_t duck_step = (duck_to - duck_from) / (int32_t)n;
+    size_t speech_index = speech.read;
+    size_t ui_index = ui.read;
+    for (size_t i = 0; i < n; i++) {
+        int32_t sum = 0;
+        if (i < speech_n) {
+            int32_t duck = duck_from + duck_step * (int32_t)i;
+            int32_t gain = (int32_t)(((int64_t)speech.gain * duck) >> 15);
+            sum += (speech.buffer[speech_index] * gain) >> 15;
+            if (++speech_index == capacity_) {
+                speech_index = 0;
+            }
+        }
+        if (i < ui_n) {
+            sum += (ui.buffer[ui_index] * ui.gain) >> 15;
+            if (++ui_index == capacity_) {
+                ui_index = 0;
+            }
+        }
+        sum = sum > INT16_MAX ? INT16_MAX : sum;
+        sum = sum < INT16_MIN ? INT16_MIN : sum;
+        out[i] = (int16_t)sum;
+    }
+    speech_duck_ = duck_to;
+
+    speech.read = speech_index;
+    speech.count -= speech_n;
+    ui.read = ui_index;
+    ui.count -= ui_n;
+    return n;
+}
@@ -0,0 +1,61 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+enum MixerVoice {
+    kMixerVoiceSpeech,  // TTS stream from the server
+    kMixerVoiceUi,      // local sounds and alerts
+    kMixerVoiceCount
+};
+
+// Mixes the PCM of the speech and UI voices in front of AudioCodec::OutputData.
+// Each voice buffers PCM at the codec output sample rate in a preallocated FIFO, the speech voice is
+// ducked while a UI sound plays. Gains are Q15 and the sum saturates to 16 bits.
+class AudioMixer {
+public:
+    AudioMixer();
+    ~AudioMixer();
+    AudioMixer(const AudioMixer&) = delete;
+    AudioMixer& operator=(const AudioMixer&) = delete;
+
+    void Initialize(size_t voice_capacity);
+    size_t capacity() const { return capacity_; }
+    void SetGain(MixerVoice voice, float gain);
+    // Gain applied to the speech voice while the UI voice has audio
+    void SetDucking(float gain);
+
+    // Returns the number of samples accepted
+    size_t Push(MixerVoice voice, const int16_t* samples, size_t count);
+    size_t Available(MixerVoice voice);
+    bool Empty();
+    void Clear(MixerVoice voice);
+    void Clear();
+    // Keeps the first samples of the voice ramped linearly down to silence and drops the rest,
+    // returns the number of samples kept
+    size_t FadeOut(MixerVoice voice, size_t samples);
+
+    // Mixes up to max_samples into out and returns the number of samples written.
+    // While both voices have audio only the overlapping part is mixed, the rest waits for the other voice.
+    size_t Mix(int16_t* out, size_t max_samples);
+
+private:
+    struct Voice {
+        int16_t* buffer = nullptr;
+        size_t read = 0;
+        size_t count = 0;
+        int32_t gain = 32768;
+    };
+
+    std::mutex mutex_;
+    size_t capacity_ = 0;
+    Voice voices_[kMixerVoiceCount];
+    int32_t ducking_gain_ = 32768;
+    int32_t speech_duck_ = 32768;   // current ducking level, ramped to avoid clicks
+
+    static int32_t ToQ15(float gain);
+};
+
+#endif // AUDIO_MIXER_H
@@ -0,0 +1,99 @@
+#include "audio_packet_queue.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cassert>
+#include <cstring>
+
+#define TAG "AudioPacketQueue"
+
+AudioPacketQueue::AudioPacketQueue(size_t slot_count, size_t slot_size)
+    : slot_count_(slot_count), slot_size_(slot_size) {
+    // The counters wrap at 2^32, so the slot count must divide it evenly
+    assert(slot_count_ > 0 && (slot_count_ & (slot_count_ - 1)) == 0);
+    assert(slot_size_ <= UINT16_MAX);
+
+    // Prefer PSRAM for the packet storage, fall back to internal RAM on boards without it
+    slots_ = (uint8_t*)heap_caps_malloc(slot_count_ * slot_size_, MALLOC_CAP_SPIRAM);
+    if (slots_ == nullptr) {
+        slots_ = (uint8_t*)heap_caps_malloc(slot_count_ * slot_size_, MALLOC_CAP_8BIT);
+    }
+    sizes_ = (uint16_t*)heap_caps_calloc(slot_count_, sizeof(uint16_t), MALLOC_CAP_8BIT);
+    sequences_ = (uint32_t*)heap_caps_calloc(slot_count_, sizeof(uint32_t), MALLOC_CAP_8BIT);
+    arrivals_ = (int64_t*)heap_caps_calloc(slot_count_, sizeof(int64_t), MALLOC_CAP_8BIT);
+    assert(slots_ != nullptr && sizes_ != nullptr && sequences_ != nullptr && arrivals_ != nullptr);
+}
+
+AudioPacketQueue::~AudioPacketQueue() {
+    heap_caps_free(slots_);
+    heap_caps_free(sizes_);
+    heap_caps_free(sequences_);
+    heap_caps_free(arrivals_);
+}
+
+bool AudioPacketQueue::Push(const uint8_t* data, size_t size, uint32_t sequence, int64_t arrival_us) {
+    if (size > slot_size_) {
+        ESP_LOGW(TAG, "Packet of %u bytes exceeds slot size %u, dropped", (unsigned)size, (unsigned)slot_size_);
+        return false;
+    }
+
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    uint32_t tail = tail_.load(std::memory_order_acquire);
+    if (head - tail >= slot_count_) {
+        return false;
+    }
+
+    size_t index = head & (slot_count_ - 1);
+    memcpy(slots_ + index * slot_size_, data, size);
+    sizes_[index] = size;
+    sequences_[index] = sequence;
+    arrivals_[index] = arrival_us;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool AudioPacketQueue::Pop(std::vector<uint8_t>& packet, uint32_t* sequence, int64_t* arrival_us) {
+    uint32_t tail = ConsumerTail();
+    uint32_t head = head_.load(std::memory_order_acquire);
+    if (tail == head) {
+        return false;
+    }
+
+    size_t index = tail & (slot_count_ - 1);
+    auto data = slots_ + index * slot_size_;
+    // assign() reuses the capacity of the caller's vector, so steady state decoding does not allocate
+    packet.assign(data, data + sizes_[index]);
+    if (sequence != nullptr) {
+        *sequence = sequences_[index];
+    }
+    if (arrival_us != nullptr) {
+        *arrival_us = arrivals_[index];
+    }
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+void AudioPacketQueue::Clear() {
+    clear_to_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+size_t AudioPacketQueue::Size() const {
+    uint32_t head = head_.load(std::memory_order_acquire);
+    uint32_t tail = tail_.load(std::memory_order_acquire);
+    uint32_t clear_to = clear_to_.load(std::memory_order_acquire);
+    if ((int32_t)(clear_to - tail) > 0) {
+        tail = clear_to;
+    }
+    return head - tail;
+}
+
+uint32_t AudioPacketQueue::ConsumerTail() {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    uint32_t clear_to = clear_to_.load(std::memory_order_acquire);
+    if ((int32_t)(clear_to - tail) > 0) {
+        // Release the cleared slots back to the producer
+        tail = clear_to;
+        tail_.store(tail, std::memory_order_release);
+    }
+    return tail;
+}
@@ -0,0 +1,46 @@
+#ifndef AUDIO_PACKET_QUEUE_H
+#define AUDIO_PACKET_QUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Fixed capacity single-producer / single-consumer ring of encoded audio packets.
+// All slots are allocated once in the constructor, Push() and Pop() never allocate and never block.
+// Only one task may call Push() and only one task may call Pop() at a time,
+// Clear() can be called from any task and takes effect on the consumer's next Pop().
+// Each packet carries its stream sequence number and arrival time for the jitter buffer behind it.
+class AudioPacketQueue {
+public:
+    AudioPacketQueue(size_t slot_count, size_t slot_size);
+    ~AudioPacketQueue();
+    AudioPacketQueue(const AudioPacketQueue&) = delete;
+    AudioPacketQueue& operator=(const AudioPacketQueue&) = delete;
+
+    // Returns false if the packet is too large or the ring is full, the packet is then dropped
+    bool Push(const uint8_t* data, size_t size, uint32_t sequence = 0, int64_t arrival_us = 0);
+    bool Pop(std::vector<uint8_t>& packet, uint32_t* sequence = nullptr, int64_t* arrival_us = nullptr);
+    void Clear();
+    size_t Size() const;
+    inline bool Empty() const { return Size() == 0; }
+    inline size_t capacity() const { return slot_count_; }
+    inline size_t slot_size() const { return slot_size_; }
+
+private:
+    size_t slot_count_;
+    size_t slot_size_;
+    uint8_t* slots_ = nullptr;
+    uint16_t* sizes_ = nullptr;
+    uint32_t* sequences_ = nullptr;
+    int64_t* arrivals_ = nullptr;
+
+    // Monotonic counters, the slot index is counter & (slot_count_ - 1)
+    std::atomic<uint32_t> head_{0};     // written by the producer
+    std::atomic<uint32_t> tail_{0};     // written by the consumer
+    std::atomic<uint32_t> clear_to_{0}; // packets before this counter are discarded by the consumer
+
+    uint32_t ConsumerTail();
+};
+
+#endif // AUDIO_PACKET_QUEUE_H
@@ -71,10 +71,15 @@ size_t AudioProcessor::GetFeedSize() {
     return afe_iface_->get_feed_chunksize(afe_data_) * codec_->input_channels();
 }
 
-void AudioProcessor::Feed(const std::vector<int16_t>& data) {
+void AudioProcessor::Feed(const std::vector<int16_t>& data, int64_t capture_time) {
     if (afe_data_ == nullptr) {
         return;
     }
+    {
+        std::lock_guard<std::mutex> lock(feed_marks_mutex_);
+        feed_marks_[feed_mark_index_++ % kFeedMarkCount] = {fed_samples_, capture_time};
+        fed_samples_ += data.size() / codec_->input_channels();
+    }
     afe_iface_->feed(afe_data_, data.data());
 }
 
@@ -87,13 +92,15 @@ void AudioProcessor::Stop() {
     if (afe_data_ != nullptr) {
         afe_iface_->reset_buffer(afe_data_);
     }
+    std::lock_guard<std::mutex> lock(feed_marks_mutex_);
+    fetched_samples_ = fed_samples_;
 }
 
 bool AudioProcessor::IsRunning() {
     return xEventGroupGetBits(event_group_) & PROCESSOR_RUNNING;
 }
 
-void AudioProcessor::OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) {
+void AudioProcessor::OnOutput(std::function<void(std::vector<int16_t>&& data, int64_t capture_time)> callback) {
     output_callback_ = callback;
 }
 
@@ -132,8 +139,27 @@ void AudioProcessor::AudioProcessorTask() {
             }
         }
 
+        size_t samples = res->data_size / sizeof(int16_t);
+        int64_t capture_time = GetCaptureTime(samples);
         if (output_callback_) {
-            output_callback_(std::vector<int16_t>(res->data, res->data + res->data_size / sizeof(int16_t)));
+            output_callback_(std::vector<int16_t>(res->data, res->data + samples), capture_time);
+        }
+    }
+}
+
+// The AFE outputs one sample per fed sample, so the output position maps back to the chunk it was fed with
+int64_t AudioProcessor::GetCaptureTime(size_t samples) {
+    std::lock_guard<std::mutex> lock(feed_marks_mutex_);
+    uint64_t position = fetched_samples_;
+    fetched_samples_ += samples;
+
+    int64_t time = 0;
+    uint64_t latest = 0;
+    for (auto& mark : feed_marks_) {
+        if (mark.time != 0 && mark.sample <= position && mark.sample >= latest) {
+            latest = mark.sample;
+            time = mark.time;
         }
     }
+    return time;
 }
@@ -9,6 +9,7 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <mutex>
 
 #include "audio_codec.h"
 
@@ -18,11 +19,13 @@ public:
     ~AudioProcessor();
 
     void Initialize(AudioCodec* codec, bool realtime_chat);
-    void Feed(const std::vector<int16_t>& data);
+    // capture_time is the esp_timer time at which the first sample of data was captured
+    void Feed(const std::vector<int16_t>& data, int64_t capture_time);
     void Start();
     void Stop();
     bool IsRunning();
-    void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback);
+    // capture_time is the capture time of the first sample of the output, from the times passed to Feed
+    void OnOutput(std::function<void(std::vector<int16_t>&& data, int64_t capture_time)> callback);
     void OnVadStateChange(std::function<void(bool speaking)> callback);
     size_t GetFeedSize();
 
@@ -30,11 +33,25 @@ private:
     EventGroupHandle_t event_group_ = nullptr;
     esp_afe_sr_iface_t* afe_iface_ = nullptr;
     esp_afe_sr_data_t* afe_data_ = nullptr;
-    std::function<void(std::vector<int16_t>&& data)> output_callback_;
+    std::function<void(std::vector<int16_t>&& data, int64_t capture_time)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
     AudioCodec* codec_ = nullptr;
     bool is_speaking_ = false;
 
+    // Capture time of the most recent input chunks, used to timestamp the processed output
+    struct FeedMark {
+        uint64_t sample;
+        int64_t time;
+    };
+    static constexpr int kFeedMarkCount = 16;
+    std::mutex feed_marks_mutex_;
+    FeedMark feed_marks_[kFeedMarkCount] = {};
+    uint32_t feed_mark_index_ = 0;
+    uint64_t fed_samples_ = 0;
+    uint64_t fetched_samples_ = 0;
+
+    int64_t GetCaptureTime(size_t samples);
+
     void AudioProcessorTask();
 };
 
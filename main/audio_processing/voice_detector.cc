@@ -0,0 +1,111 @@
+#include "voice_detector.h"
+
+#include <esp_log.h>
+
+#include <cmath>
+#include <algorithm>
+
+#define TAG "VoiceDetector"
+
+// Chunks quieter than this (dBFS) are never voice
+#define VAD_MIN_LEVEL_DB -60.0f
+// Above the noise floor by this much is voice, by the weaker margin only with a low zero-crossing rate
+#define VAD_SPEECH_SNR_DB 12.0f
+#define VAD_WEAK_SNR_DB 6.0f
+// Crossings per sample, voiced speech stays well below, hiss and fans sit above
+#define VAD_MAX_ZERO_CROSSING_RATE 0.3f
+#define VAD_ONSET_MS 60
+#define VAD_HANGOVER_MS 500
+// The floor drops to quieter chunks at once and rises slowly, slower still while there is voice,
+// so a noise that starts and stays is taken as the new floor after a while
+#define VAD_FLOOR_RISE_DB_PER_S 3.0f
+#define VAD_FLOOR_RISE_VOICE_DB_PER_S 1.0f
+#define VAD_FLOOR_MIN_DB -90.0f
+
+VoiceDetector::VoiceDetector(int sample_rate) : sample_rate_(sample_rate) {
+}
+
+void VoiceDetector::OnStateChange(std::function<void(bool speaking)> callback) {
+    state_change_callback_ = callback;
+}
+
+void VoiceDetector::Reset() {
+    initialized_ = false;
+    onset_ms_ = 0;
+    hangover_ms_ = 0;
+    statistics_ = Statistics();
+    SetSpeaking(false);
+}
+
+void VoiceDetector::SetSpeaking(bool speaking) {
+    if (speaking_ == speaking) {
+        return;
+    }
+    speaking_ = speaking;
+    if (state_change_callback_) {
+        state_change_callback_(speaking);
+    }
+}
+
+bool VoiceDetector::Process(const int16_t* samples, size_t count) {
+    if (count == 0) {
+        return speaking_;
+    }
+
+    // Cheap microphones often carry a DC offset, it is taken out of the level and the crossings
+    int64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+    int32_t mean = sum / (int64_t)count;
+    int64_t energy = 0;
+    int crossings = 0;
+    bool positive = samples[0] >= mean;
+    for (size_t i = 0; i < count; i++) {
+        int32_t value = samples[i] - mean;
+        energy += (int64_t)value * value;
+        bool now_positive = value >= 0;
+        crossings += now_positive != positive;
+        positive = now_positive;
+    }
+    float level_db = 10.0f * log10f((float)energy / count / (32768.0f * 32768.0f) + 1e-10f);
+    float zero_crossing_rate = (float)crossings / count;
+    int duration_ms = count * 1000 / sample_rate_;
+
+    if (!initialized_) {
+        noise_floor_db_ = std::max(level_db, VAD_FLOOR_MIN_DB);
+        initialized_ = true;
+    }
+    float snr = level_db - noise_floor_db_;
+    bool voice = level_db > VAD_MIN_LEVEL_DB &&
+        (snr > VAD_SPEECH_SNR_DB || (snr > VAD_WEAK_SNR_DB && zero_crossing_rate < VAD_MAX_ZERO_CROSSING_RATE));
+
+    if (level_db < noise_floor_db_) {
+        noise_floor_db_ = std::max(level_db, VAD_FLOOR_MIN_DB);
+    } else {
+        float rise = (voice ? VAD_FLOOR_RISE_VOICE_DB_PER_S : VAD_FLOOR_RISE_DB_PER_S) * duration_ms / 1000.0f;
+        noise_floor_db_ += std::min(level_db - noise_floor_db_, rise);
+    }
+
+    statistics_.chunks++;
+    if (voice) {
+        statistics_.voice_chunks++;
+        onset_ms_ += duration_ms;
+        hangover_ms_ = VAD_HANGOVER_MS;
+        if (!speaking_ && onset_ms_ >= VAD_ONSET_MS) {
+            ESP_LOGD(TAG, "Voice at %.1f dB, floor %.1f dB, zcr %.2f", level_db, noise_floor_db_, zero_crossing_rate);
+            SetSpeaking(true);
+        }
+        return true;
+    }
+
+    onset_ms_ = 0;
+    if (speaking_) {
+        hangover_ms_ -= duration_ms;
+        if (hangover_ms_ > 0) {
+            return true;
+        }
+        SetSpeaking(false);
+    }
+    return false;
+}
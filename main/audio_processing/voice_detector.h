@@ -0,0 +1,44 @@
+#ifndef VOICE_DETECTOR_H
+#define VOICE_DETECTOR_H
+
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+// Energy and zero-crossing voice activity detection for boards without the AFE.
+// The level of each chunk is compared with a noise floor that follows quiet chunks, hiss that is only a little
+// louder than the floor is told apart from voice by its zero-crossing rate. Speech is reported after a short
+// onset and held for a hangover, so word gaps do not toggle the state.
+// Process and Reset are called from one task, the callback runs on that task.
+class VoiceDetector {
+public:
+    struct Statistics {
+        uint32_t chunks = 0;
+        uint32_t voice_chunks = 0;
+    };
+
+    explicit VoiceDetector(int sample_rate = 16000);
+
+    void OnStateChange(std::function<void(bool speaking)> callback);
+    void Reset();
+    // Classifies one chunk of mono PCM. Returns true if the chunk should be sent: it sounds like voice,
+    // including an onset not yet confirmed, or the hangover is still running
+    bool Process(const int16_t* samples, size_t count);
+    bool speaking() const { return speaking_; }
+    float noise_floor_db() const { return noise_floor_db_; }
+    Statistics GetStatistics() const { return statistics_; }
+
+private:
+    int sample_rate_;
+    std::function<void(bool speaking)> state_change_callback_;
+    bool initialized_ = false;  // the floor starts at the level of the first chunk
+    float noise_floor_db_ = 0;
+    int onset_ms_ = 0;
+    int hangover_ms_ = 0;
+    bool speaking_ = false;
+    Statistics statistics_;
+
+    void SetSpeaking(bool speaking);
+};
+
+#endif // VOICE_DETECTOR_H
@@ -5,15 +5,24 @@
 #include <model_path.h>
 #include <arpa/inet.h>
 #include <sstream>
+#include <cstring>
+#include <cassert>
+#include <chrono>
+#include <algorithm>
+#include <esp_heap_caps.h>
 
 #define DETECTION_RUNNING_EVENT 1
+// Audio kept before the wake word, sent to the server for voice recognition
+#define WAKE_WORD_PREROLL_MS 2000
+// Room for the encoded pre-roll, about 17 kbps at complexity 0 plus the length of each packet
+#define WAKE_WORD_OPUS_RING_SIZE (6 * 1024)
+// Longest wait for the next pre-roll packet, the main loop is blocked meanwhile
+#define WAKE_WORD_OPUS_TIMEOUT_MS 1000
 
 static const char* TAG = "WakeWordDetect";
 
 WakeWordDetect::WakeWordDetect()
-    : afe_data_(nullptr),
-      wake_word_pcm_(),
-      wake_word_opus_() {
+    : afe_data_(nullptr) {
 
     event_group_ = xEventGroupCreate();
 }
@@ -23,15 +32,20 @@ WakeWordDetect::~WakeWordDetect() {
         afe_iface_->destroy(afe_data_);
     }
 
-    if (wake_word_encode_task_stack_ != nullptr) {
-        heap_caps_free(wake_word_encode_task_stack_);
+    if (wake_word_pcm_ != nullptr) {
+        heap_caps_free(wake_word_pcm_);
+    }
+    if (wake_word_opus_ != nullptr) {
+        heap_caps_free(wake_word_opus_);
     }
 
     vEventGroupDelete(event_group_);
 }
 
-void WakeWordDetect::Initialize(AudioCodec* codec) {
+void WakeWordDetect::Initialize(AudioCodec* codec, BackgroundTask* background_task, int frame_duration) {
     codec_ = codec;
+    background_task_ = background_task;
+    wake_word_frame_duration_ = frame_duration;
     int ref_num = codec_->input_reference() ? 1 : 0;
 
     srmodel_list_t *models = esp_srmodel_init("model");
@@ -62,10 +76,28 @@ void WakeWordDetect::Initialize(AudioCodec* codec) {
     afe_config->afe_perferred_core = 1;
     afe_config->afe_perferred_priority = 1;
     afe_config->memory_alloc_mode = AFE_MEMORY_ALLOC_MORE_PSRAM;
-    
+
     afe_iface_ = esp_afe_handle_from_config(afe_config);
     afe_data_ = afe_iface_->create_from_config(afe_config);
 
+    // Only the audio not yet encoded is kept as PCM, a frame and two fetches leave room for a late encode job.
+    // Both rings are allocated once, detection runs all day and must not churn the heap
+    wake_word_pcm_size_ = 16000 * frame_duration / 1000 + 2 * afe_iface_->get_fetch_chunksize(afe_data_);
+    wake_word_pcm_ = (int16_t*)heap_caps_malloc(wake_word_pcm_size_ * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+    if (wake_word_pcm_ == nullptr) {
+        wake_word_pcm_ = (int16_t*)heap_caps_malloc(wake_word_pcm_size_ * sizeof(int16_t), MALLOC_CAP_8BIT);
+    }
+    wake_word_opus_size_ = WAKE_WORD_OPUS_RING_SIZE;
+    wake_word_opus_ = (uint8_t*)heap_caps_malloc(wake_word_opus_size_, MALLOC_CAP_SPIRAM);
+    if (wake_word_opus_ == nullptr) {
+        wake_word_opus_ = (uint8_t*)heap_caps_malloc(wake_word_opus_size_, MALLOC_CAP_8BIT);
+    }
+    assert(wake_word_pcm_ != nullptr && wake_word_opus_ != nullptr);
+    wake_word_opus_max_packets_ = WAKE_WORD_PREROLL_MS / frame_duration;
+
+    wake_word_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration);
+    wake_word_encoder_->SetComplexity(0); // 0 is the fastest, it runs all the time
+
     xTaskCreate([](void* arg) {
         auto this_ = (WakeWordDetect*)arg;
         this_->AudioDetectionTask();
@@ -78,6 +110,21 @@ void WakeWordDetect::OnWakeWordDetected(std::function<void(const std::string& wa
 }
 
 void WakeWordDetect::StartDetection() {
+    if (IsDetectionRunning()) {
+        return;
+    }
+    {
+        // The pre-roll starts over, audio from before the pause does not belong to the next wake word
+        std::lock_guard<std::mutex> lock(wake_word_mutex_);
+        wake_word_pcm_write_ = 0;
+        wake_word_pcm_read_ = 0;
+        wake_word_opus_head_ = 0;
+        wake_word_opus_tail_ = 0;
+        wake_word_opus_packets_ = 0;
+        wake_word_reset_ = true;
+        wake_word_sealed_ = false;
+        wake_word_encoded_ = false;
+    }
     xEventGroupSetBits(event_group_, DETECTION_RUNNING_EVENT);
 }
 
@@ -135,53 +182,164 @@ void WakeWordDetect::AudioDetectionTask() {
 }
 
 void WakeWordDetect::StoreWakeWordData(uint16_t* data, size_t samples) {
-    // store audio data to wake_word_pcm_
-    wake_word_pcm_.emplace_back(std::vector<int16_t>(data, data + samples));
-    // keep about 2 seconds of data, detect duration is 32ms (sample_rate == 16000, chunksize == 512)
-    while (wake_word_pcm_.size() > 2000 / 32) {
-        wake_word_pcm_.pop_front();
+    size_t frame_samples = 16000 * wake_word_frame_duration_ / 1000;
+    {
+        std::lock_guard<std::mutex> lock(wake_word_mutex_);
+        // Only the newest samples survive if one fetch is longer than the ring
+        if (samples > wake_word_pcm_size_) {
+            data += samples - wake_word_pcm_size_;
+            wake_word_pcm_write_ += samples - wake_word_pcm_size_;
+            samples = wake_word_pcm_size_;
+        }
+        size_t offset = wake_word_pcm_write_ % wake_word_pcm_size_;
+        size_t first = std::min(samples, wake_word_pcm_size_ - offset);
+        memcpy(wake_word_pcm_ + offset, data, first * sizeof(int16_t));
+        memcpy(wake_word_pcm_, data + first, (samples - first) * sizeof(int16_t));
+        wake_word_pcm_write_ += samples;
+        // The encoder fell behind, the oldest audio is overwritten
+        if (wake_word_pcm_write_ - wake_word_pcm_read_ > wake_word_pcm_size_) {
+            wake_word_pcm_read_ = wake_word_pcm_write_ - wake_word_pcm_size_;
+        }
+
+        if (wake_word_encoding_ || wake_word_pcm_write_ - wake_word_pcm_read_ < frame_samples) {
+            return;
+        }
+        wake_word_encoding_ = true;
     }
+    background_task_->Schedule([this]() {
+        EncodeWakeWordFrames();
+    }, kBackgroundBulk);
 }
 
-void WakeWordDetect::EncodeWakeWordData() {
-    wake_word_opus_.clear();
-    if (wake_word_encode_task_stack_ == nullptr) {
-        wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(4096 * 8, MALLOC_CAP_SPIRAM);
-    }
-    wake_word_encode_task_ = xTaskCreateStatic([](void* arg) {
-        auto this_ = (WakeWordDetect*)arg;
+// Copies samples out of the ring starting at the given position, requires wake_word_mutex_
+void WakeWordDetect::ReadWakeWordData(size_t position, int16_t* data, size_t samples) {
+    size_t offset = position % wake_word_pcm_size_;
+    size_t first = std::min(samples, wake_word_pcm_size_ - offset);
+    memcpy(data, wake_word_pcm_ + offset, first * sizeof(int16_t));
+    memcpy(data + first, wake_word_pcm_, (samples - first) * sizeof(int16_t));
+}
+
+// Runs on the background task until the PCM ring holds less than a frame, one job at a time
+void WakeWordDetect::EncodeWakeWordFrames() {
+    size_t frame_samples = 16000 * wake_word_frame_duration_ / 1000;
+    std::vector<int16_t> pcm;
+    while (true) {
+        bool reset;
         {
-            auto start_time = esp_timer_get_time();
-            auto encoder = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-            encoder->SetComplexity(0); // 0 is the fastest
-
-            for (auto& pcm: this_->wake_word_pcm_) {
-                encoder->Encode(std::move(pcm), [this_](std::vector<uint8_t>&& opus) {
-                    std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-                    this_->wake_word_opus_.emplace_back(std::move(opus));
-                    this_->wake_word_cv_.notify_all();
-                });
+            std::lock_guard<std::mutex> lock(wake_word_mutex_);
+            if (wake_word_pcm_write_ - wake_word_pcm_read_ < frame_samples) {
+                // Less than a frame is left when the pre-roll is sealed, it is dropped
+                wake_word_encoding_ = false;
+                if (wake_word_sealed_) {
+                    wake_word_encoded_ = true;
+                    wake_word_cv_.notify_all();
+                }
+                break;
+            }
+            reset = wake_word_reset_;
+            wake_word_reset_ = false;
+            pcm.resize(frame_samples);
+            ReadWakeWordData(wake_word_pcm_read_, pcm.data(), frame_samples);
+            wake_word_pcm_read_ += frame_samples;
+        }
+        if (reset) {
+            wake_word_encoder_->ResetState();
+        }
+        wake_word_encoder_->Encode(std::move(pcm), [this](std::vector<uint8_t>&& opus) {
+            std::lock_guard<std::mutex> lock(wake_word_mutex_);
+            // Detection restarted while this frame was encoded, the packet belongs to the old pre-roll
+            if (wake_word_reset_) {
+                return;
             }
-            this_->wake_word_pcm_.clear();
+            PushWakeWordOpus(opus.data(), opus.size());
+            wake_word_cv_.notify_all();
+        });
+    }
+}
+
+// Byte copies that wrap around the end of the opus ring, require wake_word_mutex_
+void WakeWordDetect::CopyToOpusRing(size_t position, const uint8_t* data, size_t size) {
+    size_t offset = position % wake_word_opus_size_;
+    size_t first = std::min(size, wake_word_opus_size_ - offset);
+    memcpy(wake_word_opus_ + offset, data, first);
+    memcpy(wake_word_opus_, data + first, size - first);
+}
+
+void WakeWordDetect::CopyFromOpusRing(size_t position, uint8_t* data, size_t size) {
+    size_t offset = position % wake_word_opus_size_;
+    size_t first = std::min(size, wake_word_opus_size_ - offset);
+    memcpy(data, wake_word_opus_ + offset, first);
+    memcpy(data + first, wake_word_opus_, size - first);
+}
+
+// Appends a packet and drops the oldest ones beyond the pre-roll duration or the ring size, requires wake_word_mutex_
+void WakeWordDetect::PushWakeWordOpus(const uint8_t* data, size_t size) {
+    size_t entry_size = 2 + size;
+    if (entry_size > wake_word_opus_size_) {
+        return;
+    }
+    while (wake_word_opus_packets_ > 0 && (wake_word_opus_packets_ >= wake_word_opus_max_packets_ ||
+            wake_word_opus_tail_ - wake_word_opus_head_ + entry_size > wake_word_opus_size_)) {
+        uint8_t length[2];
+        CopyFromOpusRing(wake_word_opus_head_, length, 2);
+        wake_word_opus_head_ += 2 + ((length[0] << 8) | length[1]);
+        wake_word_opus_packets_--;
+    }
+    uint8_t length[2] = { (uint8_t)(size >> 8), (uint8_t)size };
+    CopyToOpusRing(wake_word_opus_tail_, length, 2);
+    CopyToOpusRing(wake_word_opus_tail_ + 2, data, size);
+    wake_word_opus_tail_ += entry_size;
+    wake_word_opus_packets_++;
+}
 
-            auto end_time = esp_timer_get_time();
-            ESP_LOGI(TAG, "Encode wake word opus %zu packets in %lld ms",
-                this_->wake_word_opus_.size(), (end_time - start_time) / 1000);
+// Takes the oldest packet, requires wake_word_mutex_ and a packet in the ring
+void WakeWordDetect::PopWakeWordOpus(std::vector<uint8_t>& opus) {
+    uint8_t length[2];
+    CopyFromOpusRing(wake_word_opus_head_, length, 2);
+    size_t size = (length[0] << 8) | length[1];
+    opus.resize(size);
+    CopyFromOpusRing(wake_word_opus_head_ + 2, opus.data(), size);
+    wake_word_opus_head_ += 2 + size;
+    wake_word_opus_packets_--;
+}
 
-            std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-            this_->wake_word_opus_.push_back(std::vector<uint8_t>());
-            this_->wake_word_cv_.notify_all();
+void WakeWordDetect::EncodeWakeWordData() {
+    size_t frame_samples = 16000 * wake_word_frame_duration_ / 1000;
+    {
+        std::lock_guard<std::mutex> lock(wake_word_mutex_);
+        ESP_LOGI(TAG, "Wake word pre-roll: %zu opus packets, %zu bytes, %zu samples to encode",
+            wake_word_opus_packets_, wake_word_opus_tail_ - wake_word_opus_head_,
+            wake_word_pcm_write_ - wake_word_pcm_read_);
+        wake_word_sealed_ = true;
+        if (wake_word_encoding_) {
+            // The running job finishes the pre-roll
+            return;
         }
-        vTaskDelete(NULL);
-    }, "encode_detect_packets", 4096 * 8, this, 2, wake_word_encode_task_stack_, &wake_word_encode_task_buffer_);
+        if (wake_word_pcm_write_ - wake_word_pcm_read_ < frame_samples) {
+            wake_word_encoded_ = true;
+            wake_word_cv_.notify_all();
+            return;
+        }
+        wake_word_encoding_ = true;
+    }
+    background_task_->Schedule([this]() {
+        EncodeWakeWordFrames();
+    }, kBackgroundBulk);
 }
 
 bool WakeWordDetect::GetWakeWordOpus(std::vector<uint8_t>& opus) {
     std::unique_lock<std::mutex> lock(wake_word_mutex_);
-    wake_word_cv_.wait(lock, [this]() {
-        return !wake_word_opus_.empty();
+    bool ready = wake_word_cv_.wait_for(lock, std::chrono::milliseconds(WAKE_WORD_OPUS_TIMEOUT_MS), [this]() {
+        return wake_word_opus_packets_ > 0 || wake_word_encoded_;
     });
-    opus.swap(wake_word_opus_.front());
-    wake_word_opus_.pop_front();
-    return !opus.empty();
+    if (!ready) {
+        // The background task is held up, the chat starts without the rest of the pre-roll
+        ESP_LOGW(TAG, "Wake word audio not encoded within %d ms, sent without the rest of it", WAKE_WORD_OPUS_TIMEOUT_MS);
+        return false;
+    }
+    if (wake_word_opus_packets_ == 0) {
+        return false;
+    }
+    PopWakeWordOpus(opus);
+    return true;
 }
@@ -8,27 +8,33 @@
 #include <esp_afe_sr_models.h>
 #include <esp_nsn_models.h>
 
-#include <list>
 #include <string>
 #include <vector>
 #include <functional>
 #include <mutex>
 #include <condition_variable>
+#include <memory>
 
 #include "audio_codec.h"
+#include "background_task.h"
+
+class OpusEncoderWrapper;
 
 class WakeWordDetect {
 public:
     WakeWordDetect();
     ~WakeWordDetect();
 
-    void Initialize(AudioCodec* codec);
+    // The pre-roll is encoded on the background task while detection runs, in frames of frame_duration
+    void Initialize(AudioCodec* codec, BackgroundTask* background_task, int frame_duration);
     void Feed(const std::vector<int16_t>& data);
     void OnWakeWordDetected(std::function<void(const std::string& wake_word)> callback);
     void StartDetection();
     void StopDetection();
     bool IsDetectionRunning();
     size_t GetFeedSize();
+    // Encodes what is left of the pre-roll, GetWakeWordOpus returns false after its last packet,
+    // or when the next packet takes longer than WAKE_WORD_OPUS_TIMEOUT_MS
     void EncodeWakeWordData();
     bool GetWakeWordOpus(std::vector<uint8_t>& opus);
     const std::string& GetLastDetectedWakeWord() const { return last_detected_wake_word_; }
@@ -43,15 +49,35 @@ private:
     AudioCodec* codec_ = nullptr;
     std::string last_detected_wake_word_;
 
-    TaskHandle_t wake_word_encode_task_ = nullptr;
-    StaticTask_t wake_word_encode_task_buffer_;
-    StackType_t* wake_word_encode_task_stack_ = nullptr;
-    std::list<std::vector<int16_t>> wake_word_pcm_;
-    std::list<std::vector<uint8_t>> wake_word_opus_;
+    BackgroundTask* background_task_ = nullptr;
+    std::unique_ptr<OpusEncoderWrapper> wake_word_encoder_;
+    int wake_word_frame_duration_ = 60;
+    // Audio waiting to be encoded, the positions count every sample stored or read since detection started
+    int16_t* wake_word_pcm_ = nullptr;
+    size_t wake_word_pcm_size_ = 0;
+    size_t wake_word_pcm_write_ = 0;
+    size_t wake_word_pcm_read_ = 0;
+    // The encoded pre-roll, each packet is a 2 byte length followed by the payload, the positions count bytes
+    uint8_t* wake_word_opus_ = nullptr;
+    size_t wake_word_opus_size_ = 0;
+    size_t wake_word_opus_head_ = 0;
+    size_t wake_word_opus_tail_ = 0;
+    size_t wake_word_opus_packets_ = 0;
+    size_t wake_word_opus_max_packets_ = 0;
+    bool wake_word_encoding_ = false;  // an encode job is scheduled or running
+    bool wake_word_reset_ = false;     // the encoder state belongs to the previous detection
+    bool wake_word_sealed_ = false;    // no more audio comes, encode the rest and finish
+    bool wake_word_encoded_ = false;   // every packet of the pre-roll is in the ring
     std::mutex wake_word_mutex_;
     std::condition_variable wake_word_cv_;
 
     void StoreWakeWordData(uint16_t* data, size_t size);
+    void ReadWakeWordData(size_t position, int16_t* data, size_t samples);
+    void EncodeWakeWordFrames();
+    void PushWakeWordOpus(const uint8_t* data, size_t size);
+    void PopWakeWordOpus(std::vector<uint8_t>& opus);
+    void CopyToOpusRing(size_t position, const uint8_t* data, size_t size);
+    void CopyFromOpusRing(size_t position, uint8_t* data, size_t size);
     void AudioDetectionTask();
 };
 
@@ -0,0 +1,145 @@
+#include "audio_resampler.h"
+
+#include <esp_log.h>
+
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <algorithm>
+
+#define TAG "AudioResampler"
+
+// Ratios with a larger numerator or denominator are left to OpusResampler, their tables would not pay off
+#define RESAMPLER_MAX_FACTOR 8
+// Taps per phase, times the decimation factor rounded up so the lower cutoff keeps its steepness
+#define RESAMPLER_TAPS_PER_STEP 24
+// Cutoff relative to the lower Nyquist frequency, and the Kaiser window beta (about 70 dB stopband)
+#define RESAMPLER_ROLLOFF 0.9
+#define RESAMPLER_KAISER_BETA 7.0
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window
+static double BesselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+// Four independent accumulators, so the multiply-accumulates do not wait for each other
+// and the compiler can map the loop to vector or dual MAC instructions. n is a multiple of 4.
+static inline int32_t DotProduct(const int16_t* __restrict a, const int16_t* __restrict b, int n) {
+    int32_t sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+    for (int i = 0; i < n; i += 4) {
+        sum0 += (int32_t)a[i] * b[i];
+        sum1 += (int32_t)a[i + 1] * b[i + 1];
+        sum2 += (int32_t)a[i + 2] * b[i + 2];
+        sum3 += (int32_t)a[i + 3] * b[i + 3];
+    }
+    return (sum0 + sum1) + (sum2 + sum3);
+}
+
+void AudioResampler::Configure(int input_sample_rate, int output_sample_rate) {
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+    int divisor = std::gcd(input_sample_rate, output_sample_rate);
+    up_ = output_sample_rate / divisor;
+    down_ = input_sample_rate / divisor;
+    next_position_ = 0;
+
+    if (up_ > RESAMPLER_MAX_FACTOR || down_ > RESAMPLER_MAX_FACTOR) {
+        ESP_LOGI(TAG, "No polyphase table for %d -> %d, using OpusResampler", input_sample_rate, output_sample_rate);
+        taps_ = 0;
+        coefficients_.clear();
+        buffer_.clear();
+        fallback_.Configure(input_sample_rate, output_sample_rate);
+        return;
+    }
+
+    // Decimation needs a filter that is longer in input samples, its cutoff is lower
+    taps_ = RESAMPLER_TAPS_PER_STEP * ((down_ + up_ - 1) / up_);
+    int length = taps_ * up_;
+    // Cutoff in cycles per sample at the upsampled rate, below the Nyquist frequency of the slower side
+    double cutoff = RESAMPLER_ROLLOFF * 0.5 / std::max(up_, down_);
+    double center = (length - 1) / 2.0;
+    double window_norm = BesselI0(RESAMPLER_KAISER_BETA);
+    std::vector<double> prototype(length);
+    for (int i = 0; i < length; i++) {
+        double t = i - center;
+        double sinc = t == 0 ? 2.0 * cutoff : std::sin(2.0 * M_PI * cutoff * t) / (M_PI * t);
+        double r = t / (center + 1.0);
+        double window = BesselI0(RESAMPLER_KAISER_BETA * std::sqrt(std::max(0.0, 1.0 - r * r))) / window_norm;
+        prototype[i] = sinc * window;
+    }
+
+    // Every phase gets unity DC gain, the zeros stuffed in between cost exactly a factor of up_
+    coefficients_.assign(up_ * taps_, 0);
+    for (int phase = 0; phase < up_; phase++) {
+        double sum = 0;
+        for (int k = 0; k < taps_; k++) {
+            sum += prototype[phase + k * up_];
+        }
+        for (int k = 0; k < taps_; k++) {
+            double value = std::round(prototype[phase + k * up_] / sum * 32768.0);
+            coefficients_[phase * taps_ + (taps_ - 1 - k)] = (int16_t)std::clamp(value, -32768.0, 32767.0);
+        }
+    }
+
+    buffer_.assign(taps_ - 1, 0);
+    ESP_LOGI(TAG, "Polyphase %d -> %d, %d/%d with %d taps per phase", input_sample_rate, output_sample_rate,
+        up_, down_, taps_);
+}
+
+int AudioResampler::GetOutputSamples(int input_samples) {
+    if (taps_ == 0) {
+        return fallback_.GetOutputSamples(input_samples);
+    }
+    int end = input_samples * up_;
+    if (next_position_ >= end) {
+        return 0;
+    }
+    return (end - next_position_ + down_ - 1) / down_;
+}
+
+void AudioResampler::Process(const int16_t* input, int input_samples, int16_t* output) {
+    if (taps_ == 0) {
+        fallback_.Process(input, input_samples, output);
+        return;
+    }
+
+    size_t history = taps_ - 1;
+    buffer_.resize(history + input_samples);
+    memcpy(buffer_.data() + history, input, input_samples * sizeof(int16_t));
+
+    // Output n sits at input index + phase / up_, stepping by down_ / up_ input samples
+    int end = input_samples * up_;
+    int index = next_position_ / up_;
+    int phase = next_position_ % up_;
+    int step_index = down_ / up_;
+    int step_phase = down_ % up_;
+    int position = next_position_;
+    const int16_t* samples = buffer_.data();
+    const int16_t* coefficients = coefficients_.data();
+    while (position < end) {
+        int32_t sum = DotProduct(coefficients + phase * taps_, samples + index, taps_);
+        sum = (sum + (1 << 14)) >> 15;
+        *output++ = (int16_t)std::clamp<int32_t>(sum, INT16_MIN, INT16_MAX);
+        position += down_;
+        index += step_index;
+        phase += step_phase;
+        if (phase >= up_) {
+            phase -= up_;
+            index++;
+        }
+    }
+    next_position_ = position - end;
+
+    // Keep the tail of this block as the history of the next one
+    memmove(buffer_.data(), buffer_.data() + input_samples, history * sizeof(int16_t));
+    buffer_.resize(history);
+}
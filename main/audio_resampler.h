@@ -0,0 +1,41 @@
+#ifndef AUDIO_RESAMPLER_H
+#define AUDIO_RESAMPLER_H
+
+#include <opus_resampler.h>
+
+#include <vector>
+#include <cstdint>
+
+// Drop-in replacement for OpusResampler on the audio paths.
+// Ratios that reduce to small integers (16k <-> 24k, 48k -> 16k, 24k -> 48k, 8k -> 16k, ...) run a fixed-ratio
+// polyphase FIR with Q15 tables computed once in Configure, anything else falls back to OpusResampler.
+// The phase is carried across calls, so GetOutputSamples must be called with the size passed to the next Process.
+class AudioResampler {
+public:
+    AudioResampler() = default;
+    AudioResampler(const AudioResampler&) = delete;
+    AudioResampler& operator=(const AudioResampler&) = delete;
+
+    void Configure(int input_sample_rate, int output_sample_rate);
+    int GetOutputSamples(int input_samples);
+    void Process(const int16_t* input, int input_samples, int16_t* output);
+
+    int input_sample_rate() const { return input_sample_rate_; }
+    int output_sample_rate() const { return output_sample_rate_; }
+    bool polyphase() const { return taps_ > 0; }
+    // Taps per phase, the multiply-accumulates of one output sample
+    int taps() const { return taps_; }
+
+private:
+    int input_sample_rate_ = 0;
+    int output_sample_rate_ = 0;
+    int up_ = 1;
+    int down_ = 1;
+    int taps_ = 0;                       // taps per phase, 0 when the fallback is used
+    std::vector<int16_t> coefficients_;  // up_ phases of taps_, each reversed for a forward dot product
+    std::vector<int16_t> buffer_;        // the last taps_ - 1 input samples followed by the current block
+    int next_position_ = 0;              // next output in 1/up_ input samples from the start of the next block
+    OpusResampler fallback_;
+};
+
+#endif // AUDIO_RESAMPLER_H
@@ -0,0 +1,153 @@
+#include "audio_sender.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <opus.h>
+#include <cassert>
+#include <cstring>
+
+#define TAG "AudioSender"
+
+AudioSender::AudioSender(size_t slot_count, size_t slot_size, AudioSenderPolicy policy)
+    : slot_count_(slot_count), slot_size_(slot_size), policy_(policy) {
+    assert(slot_count_ >= 2);
+    assert(slot_size_ <= UINT16_MAX);
+
+    slots_ = (uint8_t*)heap_caps_malloc(slot_count_ * slot_size_, MALLOC_CAP_SPIRAM);
+    if (slots_ == nullptr) {
+        slots_ = (uint8_t*)heap_caps_malloc(slot_count_ * slot_size_, MALLOC_CAP_8BIT);
+    }
+    sizes_ = (uint16_t*)heap_caps_calloc(slot_count_, sizeof(uint16_t), MALLOC_CAP_8BIT);
+    capture_times_ = (int64_t*)heap_caps_calloc(slot_count_, sizeof(int64_t), MALLOC_CAP_8BIT);
+    assert(slots_ != nullptr && sizes_ != nullptr && capture_times_ != nullptr);
+    packet_.reserve(slot_size_);
+
+    if (policy_ == kAudioSenderCoalesce) {
+        repacketizer_ = opus_repacketizer_create();
+        merged_.resize(slot_size_);
+    }
+}
+
+AudioSender::~AudioSender() {
+    if (task_handle_ != nullptr) {
+        vTaskDelete(task_handle_);
+    }
+    if (repacketizer_ != nullptr) {
+        opus_repacketizer_destroy(repacketizer_);
+    }
+    heap_caps_free(slots_);
+    heap_caps_free(sizes_);
+    heap_caps_free(capture_times_);
+}
+
+void AudioSender::Start(SendCallback callback, FlushCallback flush_callback, uint32_t stack_size, UBaseType_t priority,
+    BaseType_t core) {
+    send_callback_ = callback;
+    flush_callback_ = flush_callback;
+    xTaskCreatePinnedToCore([](void* arg) {
+        AudioSender* sender = (AudioSender*)arg;
+        sender->SenderLoop();
+        vTaskDelete(NULL);
+    }, "audio_sender", stack_size, this, priority, &task_handle_, core);
+}
+
+bool AudioSender::Push(const uint8_t* data, size_t size, int64_t capture_time) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    statistics_.queued++;
+    if (size > slot_size_) {
+        ESP_LOGW(TAG, "Packet of %u bytes exceeds slot size %u, dropped", (unsigned)size, (unsigned)slot_size_);
+        statistics_.dropped++;
+        return true;
+    }
+    bool overflowed = count_ == slot_count_;
+    if (overflowed) {
+        if (policy_ != kAudioSenderCoalesce || !CoalesceOldest()) {
+            DropOldest();
+        }
+    }
+
+    size_t index = (head_ + count_) % slot_count_;
+    memcpy(slots_ + index * slot_size_, data, size);
+    sizes_[index] = size;
+    capture_times_[index] = capture_time;
+    count_++;
+    if ((int)count_ > statistics_.max_depth) {
+        statistics_.max_depth = count_;
+    }
+    condition_variable_.notify_one();
+    return !overflowed;
+}
+
+void AudioSender::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    head_ = 0;
+    count_ = 0;
+}
+
+AudioSender::Statistics AudioSender::GetStatistics() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    statistics_.depth = count_;
+    if (task_handle_ != nullptr) {
+        statistics_.stack_free = uxTaskGetStackHighWaterMark(task_handle_);
+    }
+    return statistics_;
+}
+
+void AudioSender::DropOldest() {
+    head_ = (head_ + 1) % slot_count_;
+    count_--;
+    statistics_.dropped++;
+}
+
+// Merges the two oldest packets into the slot of the second one, keeping the capture time of the first
+bool AudioSender::CoalesceOldest() {
+    size_t first = head_;
+    size_t second = (head_ + 1) % slot_count_;
+    opus_repacketizer_init(repacketizer_);
+    if (opus_repacketizer_cat(repacketizer_, slots_ + first * slot_size_, sizes_[first]) != OPUS_OK ||
+        opus_repacketizer_cat(repacketizer_, slots_ + second * slot_size_, sizes_[second]) != OPUS_OK) {
+        // Different modes or more than 120 ms of audio
+        return false;
+    }
+    opus_int32 size = opus_repacketizer_out(repacketizer_, merged_.data(), slot_size_);
+    if (size <= 0) {
+        return false;
+    }
+    memcpy(slots_ + second * slot_size_, merged_.data(), size);
+    sizes_[second] = size;
+    capture_times_[second] = capture_times_[first];
+    head_ = second;
+    count_--;
+    statistics_.coalesced++;
+    return true;
+}
+
+void AudioSender::SenderLoop() {
+    bool flushed = true;
+    while (true) {
+        int64_t capture_time;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (flushed) {
+                condition_variable_.wait(lock, [this]() { return count_ > 0; });
+            } else if (!condition_variable_.wait_for(lock, std::chrono::milliseconds(AUDIO_SENDER_FLUSH_IDLE_MS),
+                    [this]() { return count_ > 0; })) {
+                // The stream paused, once per pause
+                flushed = true;
+                lock.unlock();
+                if (flush_callback_) {
+                    flush_callback_();
+                }
+                continue;
+            }
+            auto data = slots_ + head_ * slot_size_;
+            packet_.assign(data, data + sizes_[head_]);
+            capture_time = capture_times_[head_];
+            head_ = (head_ + 1) % slot_count_;
+            count_--;
+            statistics_.sent++;
+        }
+        send_callback_(packet_, capture_time);
+        flushed = false;
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef AUDIO_SENDER_H
+#define AUDIO_SENDER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+struct OpusRepacketizer;
+
+// Time without a new packet after which the protocol is told to send what it holds back,
+// longer than a frame so a steady stream is not flushed between frames
+#define AUDIO_SENDER_FLUSH_IDLE_MS 80
+
+enum AudioSenderPolicy {
+    kAudioSenderDropOldest,  // the oldest queued frame is dropped to make room
+    kAudioSenderCoalesce,    // the two oldest frames are merged into one opus packet (up to 120 ms), dropped if they can't be
+};
+
+// Sends the encoded uplink audio from its own task.
+// The encoder pushes opus packets into a bounded queue of preallocated slots, the sender task hands them
+// to the protocol in order. A slow network fills the queue and the overflow policy decides what is lost,
+// the counters make it visible. Once the stream pauses the flush callback runs, so the last frames of a
+// turn do not wait in the protocol for a next frame that never comes.
+class AudioSender {
+public:
+    struct Statistics {
+        uint32_t queued = 0;     // frames pushed by the encoder
+        uint32_t sent = 0;       // packets handed to the protocol
+        uint32_t dropped = 0;    // frames lost on overflow
+        uint32_t coalesced = 0;  // frames merged into the packet before them
+        int depth = 0;           // packets waiting now
+        int max_depth = 0;
+        int stack_free = 0;      // least stack the sender task had left, in bytes on ESP-IDF
+    };
+    using SendCallback = std::function<void(const std::vector<uint8_t>& packet, int64_t capture_time)>;
+    using FlushCallback = std::function<void()>;
+
+    AudioSender(size_t slot_count, size_t slot_size, AudioSenderPolicy policy);
+    ~AudioSender();
+    AudioSender(const AudioSender&) = delete;
+    AudioSender& operator=(const AudioSender&) = delete;
+
+    // The send callback runs on the sender task, its stack has to hold the protocol's writes (TLS, AES, AT commands)
+    void Start(SendCallback callback, FlushCallback flush_callback, uint32_t stack_size, UBaseType_t priority,
+        BaseType_t core);
+    // Returns false if the queue was full and the overflow policy had to drop or merge frames
+    bool Push(const uint8_t* data, size_t size, int64_t capture_time);
+    void Clear();
+    Statistics GetStatistics();
+
+private:
+    std::mutex mutex_;
+    std::condition_variable condition_variable_;
+    size_t slot_count_;
+    size_t slot_size_;
+    AudioSenderPolicy policy_;
+    uint8_t* slots_ = nullptr;
+    uint16_t* sizes_ = nullptr;
+    int64_t* capture_times_ = nullptr;
+    size_t head_ = 0;
+    size_t count_ = 0;
+    Statistics statistics_;
+
+    OpusRepacketizer* repacketizer_ = nullptr;
+    std::vector<uint8_t> merged_;
+    std::vector<uint8_t> packet_;
+    SendCallback send_callback_;
+    FlushCallback flush_callback_;
+    TaskHandle_t task_handle_ = nullptr;
+
+    bool CoalesceOldest();
+    void DropOldest();
+    void SenderLoop();
+};
+
+#endif // AUDIO_SENDER_H
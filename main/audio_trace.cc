@@ -0,0 +1,172 @@
+#include "audio_trace.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <mbedtls/base64.h>
+
+#include <cstring>
+#include <algorithm>
+
+#define TAG "AudioTrace"
+
+// Bytes per console line, every line is base64 on its own
+#define AUDIO_TRACE_CONSOLE_CHUNK 576
+// The writer wakes up at this size or after the interval, whichever comes first
+#define AUDIO_TRACE_WRITE_THRESHOLD 4096
+#define AUDIO_TRACE_WRITE_INTERVAL_MS 100
+#define AUDIO_TRACE_FLUSH_INTERVAL_MS 1000
+
+AudioTrace::~AudioTrace() {
+    if (task_handle_ != nullptr) {
+        vTaskDelete(task_handle_);
+    }
+    if (file_ != nullptr) {
+        fclose(file_);
+    }
+    heap_caps_free(buffer_);
+}
+
+void AudioTrace::Start(const std::string& path, size_t buffer_size, bool pcm) {
+    if (started_) {
+        return;
+    }
+    buffer_ = (uint8_t*)heap_caps_malloc(buffer_size, MALLOC_CAP_SPIRAM);
+    if (buffer_ == nullptr) {
+        buffer_ = (uint8_t*)heap_caps_malloc(buffer_size, MALLOC_CAP_8BIT);
+    }
+    if (buffer_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes, tracing disabled", (unsigned)buffer_size);
+        return;
+    }
+    buffer_size_ = buffer_size;
+
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ != nullptr) {
+        ESP_LOGI(TAG, "Tracing to %s", path.c_str());
+    } else {
+        ESP_LOGI(TAG, "Cannot open %s, tracing to the console", path.c_str());
+    }
+
+    AudioTraceHeader header = {};
+    memcpy(header.magic, AUDIO_TRACE_MAGIC, sizeof(header.magic));
+    header.version = AUDIO_TRACE_VERSION;
+    Append(&header, sizeof(header));
+
+    start_time_ = esp_timer_get_time();
+    pcm_enabled_ = pcm;
+    xTaskCreate([](void* arg) {
+        AudioTrace* trace = (AudioTrace*)arg;
+        trace->WriterLoop();
+        vTaskDelete(NULL);
+    }, "audio_trace", 4096, this, 2, &task_handle_);
+    started_ = true;
+}
+
+void AudioTrace::Append(const void* data, size_t size) {
+    size_t tail = (head_ + count_) % buffer_size_;
+    size_t first = std::min(size, buffer_size_ - tail);
+    memcpy(buffer_ + tail, data, first);
+    memcpy(buffer_, (const uint8_t*)data + first, size - first);
+    count_ += size;
+}
+
+void AudioTrace::Record(AudioTraceRecordType type, const void* data, size_t size, int64_t time_us,
+    const void* prefix, size_t prefix_size) {
+    if (!started_) {
+        return;
+    }
+    if (time_us == 0) {
+        time_us = esp_timer_get_time();
+    }
+    size_t payload_size = prefix_size + size;
+    if (payload_size > UINT16_MAX) {
+        ESP_LOGW(TAG, "Record of %u bytes is too large, dropped", (unsigned)payload_size);
+        return;
+    }
+
+    AudioTraceRecordHeader header = {};
+    header.type = type;
+    header.size = payload_size;
+    header.time_us = (uint32_t)(time_us - start_time_);
+    bool wake_writer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Tell the reader about the gap before the first record that fits again
+        size_t gap_size = dropped_bytes_ > 0 ? sizeof(AudioTraceRecordHeader) + sizeof(uint32_t) : 0;
+        if (count_ + gap_size + sizeof(header) + payload_size > buffer_size_) {
+            dropped_bytes_ += sizeof(header) + payload_size;
+            return;
+        }
+        if (gap_size > 0) {
+            AudioTraceRecordHeader gap = {};
+            gap.type = kTraceDropped;
+            gap.size = sizeof(uint32_t);
+            gap.time_us = header.time_us;
+            Append(&gap, sizeof(gap));
+            Append(&dropped_bytes_, sizeof(dropped_bytes_));
+            dropped_bytes_ = 0;
+        }
+        Append(&header, sizeof(header));
+        if (prefix_size > 0) {
+            Append(prefix, prefix_size);
+        }
+        Append(data, size);
+        wake_writer = count_ >= AUDIO_TRACE_WRITE_THRESHOLD;
+    }
+    if (wake_writer) {
+        xTaskNotifyGive(task_handle_);
+    }
+}
+
+void AudioTrace::RecordPcm(AudioTraceRecordType type, const int16_t* samples, size_t count, int64_t time_us) {
+    if (pcm_enabled_) {
+        Record(type, samples, count * sizeof(int16_t), time_us);
+    }
+}
+
+// Producers only append behind the tail, so the bytes between head and tail are written out without the lock
+void AudioTrace::WriterLoop() {
+    int64_t last_flush_time = esp_timer_get_time();
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(AUDIO_TRACE_WRITE_INTERVAL_MS));
+        while (true) {
+            size_t head, size;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                head = head_;
+                size = std::min(count_, buffer_size_ - head_);
+            }
+            if (file_ == nullptr) {
+                size = std::min(size, (size_t)AUDIO_TRACE_CONSOLE_CHUNK);
+            }
+            if (size == 0) {
+                break;
+            }
+            if (file_ != nullptr) {
+                fwrite(buffer_ + head, 1, size, file_);
+            } else {
+                WriteConsole(buffer_ + head, size);
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            head_ = (head_ + size) % buffer_size_;
+            count_ -= size;
+        }
+
+        int64_t now = esp_timer_get_time();
+        if (file_ != nullptr && now - last_flush_time >= AUDIO_TRACE_FLUSH_INTERVAL_MS * 1000) {
+            fflush(file_);
+            last_flush_time = now;
+        }
+    }
+}
+
+void AudioTrace::WriteConsole(const uint8_t* data, size_t size) {
+    char line[sizeof(AUDIO_TRACE_CONSOLE_PREFIX) + 12 + (AUDIO_TRACE_CONSOLE_CHUNK / 3) * 4 + 4];
+    int length = snprintf(line, sizeof(line), AUDIO_TRACE_CONSOLE_PREFIX " %lu ", (unsigned long)console_line_++);
+    size_t encoded = 0;
+    mbedtls_base64_encode((unsigned char*)line + length, sizeof(line) - length - 1, &encoded, data, size);
+    line[length + encoded] = '\n';
+    // One write per line, so log output of other tasks lands between the lines and not inside them
+    fwrite(line, 1, length + encoded + 1, stdout);
+}
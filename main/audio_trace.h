@@ -0,0 +1,59 @@
+#ifndef AUDIO_TRACE_H
+#define AUDIO_TRACE_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <mutex>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+
+#include "audio_trace_format.h"
+
+// Records the audio path for offline replay (host/tools/trace_replay.cc).
+// Record() copies into a ring buffer under a short lock and never blocks on I/O, a writer task drains the ring
+// to a file (an SD card mounted at the configured path) or, if it can't be opened, to the console as base64 lines.
+// When the writer falls behind, whole records are dropped and a kTraceDropped record says how much was lost.
+class AudioTrace {
+public:
+    static AudioTrace& GetInstance() {
+        static AudioTrace instance;
+        return instance;
+    }
+    AudioTrace(const AudioTrace&) = delete;
+    AudioTrace& operator=(const AudioTrace&) = delete;
+
+    void Start(const std::string& path, size_t buffer_size, bool pcm);
+    bool enabled() const { return started_; }
+    // PCM records are left out when only the packets are traced, they need far more bandwidth
+    bool pcm_enabled() const { return pcm_enabled_; }
+    // time_us is an esp_timer time, 0 means now. prefix goes before data in the same payload
+    void Record(AudioTraceRecordType type, const void* data, size_t size, int64_t time_us = 0,
+        const void* prefix = nullptr, size_t prefix_size = 0);
+    void RecordPcm(AudioTraceRecordType type, const int16_t* samples, size_t count, int64_t time_us = 0);
+
+private:
+    AudioTrace() = default;
+    ~AudioTrace();
+
+    std::mutex mutex_;
+    bool started_ = false;
+    bool pcm_enabled_ = false;
+    uint8_t* buffer_ = nullptr;
+    size_t buffer_size_ = 0;
+    size_t head_ = 0;
+    size_t count_ = 0;
+    uint32_t dropped_bytes_ = 0;
+    int64_t start_time_ = 0;
+    FILE* file_ = nullptr;
+    uint32_t console_line_ = 0;
+    TaskHandle_t task_handle_ = nullptr;
+
+    void Append(const void* data, size_t size);
+    void WriterLoop();
+    void WriteConsole(const uint8_t* data, size_t size);
+};
+
+#endif // AUDIO_TRACE_H
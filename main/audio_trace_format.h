@@ -0,0 +1,64 @@
+#ifndef AUDIO_TRACE_FORMAT_H
+#define AUDIO_TRACE_FORMAT_H
+
+#include <cstdint>
+
+// Trace file layout, little endian: an AudioTraceHeader, then records of an AudioTraceRecordHeader
+// followed by size bytes of payload. Times are microseconds since the trace started.
+// Shared by the firmware and the host tools, scripts/audio_trace.py reads the same layout.
+#define AUDIO_TRACE_MAGIC "XZAT"
+#define AUDIO_TRACE_VERSION 1
+// Console lines are "<prefix> <line number> <base64>", the numbers show lines lost by the host
+#define AUDIO_TRACE_CONSOLE_PREFIX "@XZAT"
+
+enum AudioTraceRecordType : uint8_t {
+    kTraceInputFormat = 1,   // AudioTraceInputFormat
+    kTraceMicPcm = 2,        // interleaved PCM as read from the codec and resampled, microphones and reference
+    kTraceUplinkPcm = 3,     // mono PCM handed to the encoder, the AFE output when the audio processor is used
+    kTraceEncoderConfig = 4, // AudioTraceEncoderConfig, written whenever the encoder changes
+    kTraceUplinkOpus = 5,    // one encoded packet, in the order the encoder produced them
+    kTraceDecoderConfig = 6, // AudioTraceDecoderConfig, written when the audio channel opens
+    kTraceDownlinkOpus = 7,  // AudioTraceDownlink then the packet, timed at its arrival
+    kTraceDeviceState = 8,   // one byte, the DeviceState
+    kTraceDropped = 9,       // uint32_t bytes of records lost because the writer fell behind
+};
+
+struct __attribute__((packed)) AudioTraceHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+};
+
+struct __attribute__((packed)) AudioTraceRecordHeader {
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t size;
+    uint32_t time_us;  // wraps after about 71 minutes
+};
+
+struct __attribute__((packed)) AudioTraceInputFormat {
+    uint32_t sample_rate;
+    uint8_t channels;
+    uint8_t reference;  // the last channel is the AEC reference
+    uint16_t reserved;
+};
+
+struct __attribute__((packed)) AudioTraceEncoderConfig {
+    uint32_t sample_rate;
+    uint16_t frame_duration;
+    uint8_t complexity;
+    uint8_t reserved;
+};
+
+struct __attribute__((packed)) AudioTraceDecoderConfig {
+    uint32_t sample_rate;
+    uint16_t frame_duration;
+    uint16_t reserved;
+    uint32_t output_sample_rate;
+};
+
+struct __attribute__((packed)) AudioTraceDownlink {
+    uint32_t sequence;
+};
+
+#endif // AUDIO_TRACE_FORMAT_H
@@ -1,63 +1,136 @@
 #include "background_task.h"
 
 #include <esp_log.h>
-#include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
 
 #define TAG "BackgroundTask"
 
-BackgroundTask::BackgroundTask(uint32_t stack_size) {
-    xTaskCreate([](void* arg) {
-        BackgroundTask* task = (BackgroundTask*)arg;
-        task->BackgroundTaskLoop();
-    }, "background_task", stack_size, this, 2, &background_task_handle_);
+BackgroundTask::BackgroundTask(uint32_t stack_size, int worker_count) {
+    // The workers keep a pointer to their entry, so the vector must not grow after this
+    workers_.resize(worker_count);
+    for (int i = 0; i < worker_count; i++) {
+        auto& worker = workers_[i];
+        worker.pool = this;
+        worker.index = i;
+        auto entry = [](void* arg) {
+            Worker* worker = (Worker*)arg;
+            ESP_LOGI(TAG, "background_task %d started on core %d", worker->index, xPortGetCoreID());
+            worker->pool->WorkerLoop();
+        };
+        BaseType_t core = i % portNUM_PROCESSORS;
+        if (i > 0) {
+            worker.stack = (StackType_t*)heap_caps_malloc(stack_size, MALLOC_CAP_SPIRAM);
+            if (worker.stack == nullptr) {
+                ESP_LOGW(TAG, "No PSRAM for the stack of background_task %d, the pool runs %d workers", i, i);
+                workers_.resize(i);
+                break;
+            }
+            worker.task_buffer = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL);
+            worker.handle = xTaskCreateStaticPinnedToCore(entry, "background_task", stack_size, &worker, 2,
+                worker.stack, worker.task_buffer, core);
+        } else {
+            xTaskCreatePinnedToCore(entry, "background_task", stack_size, &worker, 2, &worker.handle, core);
+        }
+    }
 }
 
 BackgroundTask::~BackgroundTask() {
-    if (background_task_handle_ != nullptr) {
-        vTaskDelete(background_task_handle_);
+    for (auto& worker : workers_) {
+        if (worker.handle != nullptr) {
+            vTaskDelete(worker.handle);
+        }
+        heap_caps_free(worker.stack);
+        heap_caps_free(worker.task_buffer);
     }
 }
 
-void BackgroundTask::Schedule(std::function<void()> callback) {
+void BackgroundTask::Schedule(std::function<void()> callback, BackgroundPriority priority, CancellationToken token) {
     std::lock_guard<std::mutex> lock(mutex_);
-    if (active_tasks_ >= 30) {
-        int free_sram = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
-        if (free_sram < 10000) {
-            ESP_LOGW(TAG, "active_tasks_ == %u, free_sram == %u", active_tasks_.load(), free_sram);
-        }
+    auto& queue = queues_[priority];
+    queue.push_back(Job{std::move(callback), token, esp_timer_get_time()});
+    auto& statistics = statistics_[priority];
+    if ((int)queue.size() > statistics.max_depth) {
+        statistics.max_depth = queue.size();
     }
-    active_tasks_++;
-    main_tasks_.emplace_back([this, cb = std::move(callback)]() {
-        cb();
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            active_tasks_--;
-            if (main_tasks_.empty() && active_tasks_ == 0) {
-                condition_variable_.notify_all();
-            }
-        }
-    });
     condition_variable_.notify_all();
 }
 
 void BackgroundTask::WaitForCompletion() {
     std::unique_lock<std::mutex> lock(mutex_);
     condition_variable_.wait(lock, [this]() {
-        return main_tasks_.empty() && active_tasks_ == 0;
+        for (auto& queue : queues_) {
+            if (!queue.empty()) {
+                return false;
+            }
+        }
+        return running_ == 0;
+    });
+}
+
+void BackgroundTask::WaitForCompletion(BackgroundPriority priority) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_variable_.wait(lock, [this, priority]() {
+        return queues_[priority].empty() && running_jobs_[priority] == 0;
     });
 }
 
-void BackgroundTask::BackgroundTaskLoop() {
-    ESP_LOGI(TAG, "background_task started");
+BackgroundTask::Statistics BackgroundTask::GetStatistics(BackgroundPriority priority) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto statistics = statistics_[priority];
+    statistics.depth = queues_[priority].size();
+    if (statistics.completed + statistics.cancelled > 0) {
+        statistics.wait_avg_us = wait_sum_us_[priority] / (statistics.completed + statistics.cancelled);
+    }
+    statistics_[priority] = Statistics();
+    wait_sum_us_[priority] = 0;
+    return statistics;
+}
+
+// Realtime jobs come first, but only one of them runs at a time so they keep their order
+int BackgroundTask::NextPriority() const {
+    if (running_jobs_[kBackgroundRealtime] == 0 && !queues_[kBackgroundRealtime].empty()) {
+        return kBackgroundRealtime;
+    }
+    if (!queues_[kBackgroundBulk].empty()) {
+        return kBackgroundBulk;
+    }
+    return -1;
+}
+
+void BackgroundTask::WorkerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
     while (true) {
-        std::unique_lock<std::mutex> lock(mutex_);
-        condition_variable_.wait(lock, [this]() { return !main_tasks_.empty(); });
-        
-        std::list<std::function<void()>> tasks = std::move(main_tasks_);
+        condition_variable_.wait(lock, [this]() { return NextPriority() >= 0; });
+        auto priority = (BackgroundPriority)NextPriority();
+        Job job = std::move(queues_[priority].front());
+        queues_[priority].pop_front();
+        running_jobs_[priority]++;
+        running_++;
+
+        int64_t wait_us = esp_timer_get_time() - job.enqueue_time;
+        wait_sum_us_[priority] += wait_us;
+        auto& statistics = statistics_[priority];
+        if (wait_us > statistics.wait_max_us) {
+            statistics.wait_max_us = wait_us;
+        }
         lock.unlock();
 
-        for (auto& task : tasks) {
-            task();
+        bool cancelled = job.token.IsCancelled();
+        if (!cancelled) {
+            job.callback();
+        }
+        job.callback = nullptr;
+
+        lock.lock();
+        if (cancelled) {
+            statistics.cancelled++;
+        } else {
+            statistics.completed++;
         }
+        running_jobs_[priority]--;
+        running_--;
+        // Wakes the other workers for the next realtime job and anyone waiting for completion
+        condition_variable_.notify_all();
     }
 }
@@ -5,25 +5,97 @@
 #include <freertos/task.h>
 #include <mutex>
 #include <list>
+#include <vector>
+#include <functional>
 #include <condition_variable>
 #include <atomic>
 
+enum BackgroundPriority {
+    kBackgroundRealtime,  // audio jobs, run one at a time in order and before any bulk job
+    kBackgroundBulk,      // everything else, may run in parallel on several workers
+    kBackgroundPriorityCount
+};
+
+// Handed out by a CancellationSource, a job whose token has been cancelled is skipped
+class CancellationToken {
+public:
+    CancellationToken() = default;
+    bool IsCancelled() const {
+        return generation_ != nullptr && generation_->load(std::memory_order_acquire) != issued_;
+    }
+
+private:
+    friend class CancellationSource;
+    const std::atomic<uint32_t>* generation_ = nullptr;
+    uint32_t issued_ = 0;
+};
+
+class CancellationSource {
+public:
+    CancellationToken GetToken() const {
+        CancellationToken token;
+        token.generation_ = &generation_;
+        token.issued_ = generation_.load(std::memory_order_acquire);
+        return token;
+    }
+    // Cancels every token handed out so far
+    void Cancel() {
+        generation_.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+private:
+    std::atomic<uint32_t> generation_{0};
+};
+
+// A small pool of workers, one per core, taking jobs from the priority classes.
 class BackgroundTask {
 public:
-    BackgroundTask(uint32_t stack_size = 4096 * 2);
+    struct Statistics {
+        uint32_t completed = 0;
+        uint32_t cancelled = 0;
+        int depth = 0;
+        int max_depth = 0;
+        int64_t wait_avg_us = 0;
+        int64_t wait_max_us = 0;
+    };
+
+    // The first worker has its stack in internal RAM, the others in PSRAM when there is any
+    BackgroundTask(uint32_t stack_size = 4096 * 2, int worker_count = 1);
     ~BackgroundTask();
 
-    void Schedule(std::function<void()> callback);
+    void Schedule(std::function<void()> callback, BackgroundPriority priority = kBackgroundRealtime,
+        CancellationToken token = CancellationToken());
     void WaitForCompletion();
+    // Waits until the jobs of one class, queued or running, are done
+    void WaitForCompletion(BackgroundPriority priority);
+    // Statistics since the last call
+    Statistics GetStatistics(BackgroundPriority priority);
 
 private:
+    struct Job {
+        std::function<void()> callback;
+        CancellationToken token;
+        int64_t enqueue_time;
+    };
+    struct Worker {
+        BackgroundTask* pool;
+        int index;
+        TaskHandle_t handle = nullptr;
+        StaticTask_t* task_buffer = nullptr;
+        StackType_t* stack = nullptr;
+    };
+
     std::mutex mutex_;
-    std::list<std::function<void()>> main_tasks_;
     std::condition_variable condition_variable_;
-    TaskHandle_t background_task_handle_ = nullptr;
-    std::atomic<size_t> active_tasks_{0};
+    std::list<Job> queues_[kBackgroundPriorityCount];
+    Statistics statistics_[kBackgroundPriorityCount];
+    int64_t wait_sum_us_[kBackgroundPriorityCount] = {};
+    int running_jobs_[kBackgroundPriorityCount] = {};
+    int running_ = 0;
+    std::vector<Worker> workers_;
 
-    void BackgroundTaskLoop();
+    int NextPriority() const;
+    void WorkerLoop();
 };
 
 #endif
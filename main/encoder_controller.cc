@@ -0,0 +1,156 @@
+#include "encoder_controller.h"
+
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define TAG "EncoderController"
+
+#define WINDOW_US (1000 * 1000)
+// Encode time in percent of the audio duration
+#define LOAD_HIGH_PERCENT 50
+#define LOAD_LOW_PERCENT 25
+// Idle time of the busiest core the encoder ran on
+#define IDLE_LOW_PERCENT 10
+#define IDLE_HIGH_PERCENT 30
+// Quiet windows required before the complexity goes up again
+#define QUIET_WINDOWS_TO_STEP_UP 3
+
+EncoderController::EncoderController(int min_complexity, int max_complexity)
+    : min_complexity_(min_complexity), max_complexity_(max_complexity) {
+    if (max_complexity_ < min_complexity_) {
+        max_complexity_ = min_complexity_;
+    }
+    complexity_ = min_complexity_;
+}
+
+int EncoderController::Reset(int complexity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    complexity_ = complexity < min_complexity_ ? min_complexity_ : (complexity > max_complexity_ ? max_complexity_ : complexity);
+    quiet_windows_ = 0;
+    StartWindow(esp_timer_get_time());
+    return complexity_;
+}
+
+void EncoderController::OnEncoded(int64_t encode_us, size_t samples, size_t opus_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    encode_us_ += encode_us;
+    samples_ += samples;
+    opus_bytes_ += opus_bytes;
+    encoder_cores_ |= 1u << xPortGetCoreID();
+}
+
+void EncoderController::OnDropped() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dropped_++;
+    total_dropped_++;
+}
+
+bool EncoderController::Update() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now_us = esp_timer_get_time();
+    if (now_us - window_start_us_ < WINDOW_US) {
+        return false;
+    }
+    if (samples_ == 0) {
+        // Nothing was sent in this window
+        StartWindow(now_us);
+        return false;
+    }
+
+    // The uplink is always 16 kHz mono
+    int64_t audio_us = (int64_t)samples_ * 1000 / 16;
+    load_percent_ = audio_us > 0 ? (int)(encode_us_ * 100 / audio_us) : 0;
+    bitrate_ = audio_us > 0 ? (int)((int64_t)opus_bytes_ * 8 * 1000000 / audio_us) : 0;
+    idle_percent_ = SampleIdlePercent();
+
+    const char* reason = nullptr;
+    if (load_percent_ > LOAD_HIGH_PERCENT) {
+        reason = "encode_time";
+    } else if (idle_percent_ < IDLE_LOW_PERCENT) {
+        reason = "cpu";
+    }
+
+    int complexity = complexity_;
+    if (reason != nullptr) {
+        quiet_windows_ = 0;
+        if (complexity_ > min_complexity_) {
+            complexity = complexity_ - 1;
+            step_downs_++;
+            last_reason_ = reason;
+        }
+    } else if (load_percent_ < LOAD_LOW_PERCENT && idle_percent_ > IDLE_HIGH_PERCENT) {
+        if (++quiet_windows_ >= QUIET_WINDOWS_TO_STEP_UP && complexity_ < max_complexity_) {
+            complexity = complexity_ + 1;
+            step_ups_++;
+            last_reason_ = "headroom";
+            quiet_windows_ = 0;
+        }
+    } else {
+        quiet_windows_ = 0;
+    }
+
+    StartWindow(now_us);
+    if (complexity == complexity_) {
+        return false;
+    }
+    ESP_LOGI(TAG, "Complexity %d -> %d (%s), load %d%%, idle %d%%, %d bps",
+        complexity_, complexity, last_reason_, load_percent_, idle_percent_, bitrate_);
+    complexity_ = complexity;
+    return true;
+}
+
+int EncoderController::complexity() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return complexity_;
+}
+
+std::string EncoderController::ToJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string json = "{\"complexity\":" + std::to_string(complexity_);
+    json += ",\"min\":" + std::to_string(min_complexity_);
+    json += ",\"max\":" + std::to_string(max_complexity_);
+    json += ",\"load\":" + std::to_string(load_percent_);
+    json += ",\"idle\":" + std::to_string(idle_percent_);
+    json += ",\"bitrate\":" + std::to_string(bitrate_);
+    json += ",\"dropped\":" + std::to_string(total_dropped_);
+    json += ",\"ups\":" + std::to_string(step_ups_);
+    json += ",\"downs\":" + std::to_string(step_downs_);
+    json += ",\"reason\":\"" + std::string(last_reason_) + "\"}";
+    return json;
+}
+
+void EncoderController::StartWindow(int64_t now_us) {
+    window_start_us_ = now_us;
+    encode_us_ = 0;
+    samples_ = 0;
+    opus_bytes_ = 0;
+    dropped_ = 0;
+    encoder_cores_ = 0;
+    run_time_start_ = portGET_RUN_TIME_COUNTER_VALUE();
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        idle_start_[i] = ulTaskGetRunTimeCounter(xTaskGetIdleTaskHandleForCore(i));
+    }
+}
+
+// Idle time of the busiest core the encoder ran on since the window started, from the FreeRTOS run time
+// counters. The background workers are pinned one per core, a busy core the encoder does not use is
+// not a reason to make it cheaper
+int EncoderController::SampleIdlePercent() {
+    configRUN_TIME_COUNTER_TYPE elapsed = portGET_RUN_TIME_COUNTER_VALUE() - run_time_start_;
+    if (elapsed == 0) {
+        return 100;
+    }
+    int idle_percent = 100;
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        if (!(encoder_cores_ & (1u << i))) {
+            continue;
+        }
+        configRUN_TIME_COUNTER_TYPE idle = ulTaskGetRunTimeCounter(xTaskGetIdleTaskHandleForCore(i)) - idle_start_[i];
+        int percent = (int)((uint64_t)idle * 100 / elapsed);
+        if (percent < idle_percent) {
+            idle_percent = percent;
+        }
+    }
+    return idle_percent;
+}
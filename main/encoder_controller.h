@@ -0,0 +1,64 @@
+#ifndef ENCODER_CONTROLLER_H
+#define ENCODER_CONTROLLER_H
+
+#include <freertos/FreeRTOS.h>
+
+#include <mutex>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Adjusts the opus encoder complexity to the load of the uplink path.
+// Encode time and idle time of the cores that ran the encoder are collected over one second windows.
+// The complexity steps down as soon as a window is over any limit and steps up again only after
+// several quiet windows in a row. Frames dropped by the busy send path are counted but do not change
+// the complexity, a cheaper encoder does not make the packets smaller.
+// Everything but ToJson() is called from the task that runs the encoder.
+class EncoderController {
+public:
+    EncoderController(int min_complexity, int max_complexity);
+
+    // Starts over for a new stream, returns the initial complexity clamped to the bounds
+    int Reset(int complexity);
+    // One call of the encoder: its duration, the pcm fed to it and the opus bytes it produced
+    void OnEncoded(int64_t encode_us, size_t samples, size_t opus_bytes);
+    // The send queue overflowed, a frame was dropped or merged. Reported only
+    void OnDropped();
+    // Closes the window when it is due, returns true if the complexity has to change
+    bool Update();
+    int complexity();
+    // {"complexity":..,"min":..,"max":..,"load":..,"idle":..,"bitrate":..,"dropped":..,"ups":..,"downs":..,"reason":".."}
+    std::string ToJson();
+
+private:
+    std::mutex mutex_;
+    int min_complexity_;
+    int max_complexity_;
+    int complexity_ = 0;
+
+    // Current window
+    int64_t window_start_us_ = 0;
+    int64_t encode_us_ = 0;
+    size_t samples_ = 0;
+    size_t opus_bytes_ = 0;
+    uint32_t dropped_ = 0;
+    // Bit per core the encoder ran on
+    uint32_t encoder_cores_ = 0;
+    configRUN_TIME_COUNTER_TYPE idle_start_[portNUM_PROCESSORS] = {};
+    configRUN_TIME_COUNTER_TYPE run_time_start_ = 0;
+    int quiet_windows_ = 0;
+
+    // Results of the last window and the decisions taken so far
+    int load_percent_ = 0;
+    int idle_percent_ = 100;
+    int bitrate_ = 0;
+    uint32_t total_dropped_ = 0;
+    uint32_t step_ups_ = 0;
+    uint32_t step_downs_ = 0;
+    const char* last_reason_ = "none";
+
+    void StartWindow(int64_t now_us);
+    int SampleIdlePercent();
+};
+
+#endif // ENCODER_CONTROLLER_H
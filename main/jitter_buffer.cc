@@ -0,0 +1,198 @@
+#include "jitter_buffer.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <cassert>
+#include <cstring>
+#include <cstdlib>
+
+#define TAG "JitterBuffer"
+
+// Never conceal more than this many frames in a row, skip the gap instead
+#define MAX_CONSECUTIVE_CONCEALED 3
+
+// Sequence numbers are compared with wrap around
+static inline bool SequenceBefore(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+JitterBuffer::JitterBuffer(size_t slot_count, size_t slot_size)
+    : slot_count_(slot_count), slot_size_(slot_size) {
+    assert(slot_count_ > 0 && (slot_count_ & (slot_count_ - 1)) == 0);
+    assert(slot_size_ <= UINT16_MAX);
+
+    slots_ = (uint8_t*)heap_caps_malloc(slot_count_ * slot_size_, MALLOC_CAP_SPIRAM);
+    if (slots_ == nullptr) {
+        slots_ = (uint8_t*)heap_caps_malloc(slot_count_ * slot_size_, MALLOC_CAP_8BIT);
+    }
+    sizes_ = (uint16_t*)heap_caps_calloc(slot_count_, sizeof(uint16_t), MALLOC_CAP_8BIT);
+    sequences_ = (uint32_t*)heap_caps_calloc(slot_count_, sizeof(uint32_t), MALLOC_CAP_8BIT);
+    arrivals_ = (int64_t*)heap_caps_calloc(slot_count_, sizeof(int64_t), MALLOC_CAP_8BIT);
+    filled_ = (bool*)heap_caps_calloc(slot_count_, sizeof(bool), MALLOC_CAP_8BIT);
+    assert(slots_ != nullptr && sizes_ != nullptr && sequences_ != nullptr && arrivals_ != nullptr && filled_ != nullptr);
+}
+
+JitterBuffer::~JitterBuffer() {
+    heap_caps_free(slots_);
+    heap_caps_free(sizes_);
+    heap_caps_free(sequences_);
+    heap_caps_free(arrivals_);
+    heap_caps_free(filled_);
+}
+
+void JitterBuffer::Reset(int frame_duration_ms) {
+    DropAll();
+    frame_us_ = frame_duration_ms * 1000;
+    jitter_q4_ = 0;
+    has_last_arrival_ = false;
+    target_depth_ = 1;
+    statistics_ = Statistics();
+}
+
+void JitterBuffer::Clear() {
+    DropAll();
+}
+
+void JitterBuffer::DropAll() {
+    memset(filled_, 0, slot_count_ * sizeof(bool));
+    count_ = 0;
+    playing_ = false;
+    synced_ = false;
+    consecutive_concealed_ = 0;
+}
+
+void JitterBuffer::Put(uint32_t sequence, const uint8_t* data, size_t size, int64_t arrival_us) {
+    if (size > slot_size_) {
+        ESP_LOGW(TAG, "Packet of %u bytes exceeds slot size %u, dropped", (unsigned)size, (unsigned)slot_size_);
+        return;
+    }
+
+    statistics_.received++;
+    UpdateJitter(sequence, arrival_us);
+
+    if (count_ == 0) {
+        bool start = !synced_ || (!playing_ && !SequenceBefore(sequence, next_sequence_)) ||
+            (playing_ && sequence - next_sequence_ >= slot_count_ && !SequenceBefore(sequence, next_sequence_));
+        if (start) {
+            // Start of a stream, after an underrun, or a jump too large to bridge
+            playing_ = false;
+            synced_ = true;
+            next_sequence_ = sequence;
+            buffering_since_us_ = arrival_us;
+        }
+    } else if (!playing_ && SequenceBefore(sequence, next_sequence_)) {
+        // Reordered while still buffering, move the start back if the window allows
+        if (highest_sequence_ - sequence < slot_count_) {
+            next_sequence_ = sequence;
+        }
+    }
+
+    if (SequenceBefore(sequence, next_sequence_)) {
+        statistics_.late++;
+        return;
+    }
+    if (sequence - next_sequence_ >= slot_count_) {
+        statistics_.overflowed++;
+        return;
+    }
+
+    size_t index = sequence & (slot_count_ - 1);
+    if (filled_[index]) {
+        statistics_.duplicated++;
+        return;
+    }
+    memcpy(slots_ + index * slot_size_, data, size);
+    sizes_[index] = size;
+    sequences_[index] = sequence;
+    arrivals_[index] = arrival_us;
+    filled_[index] = true;
+    if (count_ == 0 || SequenceBefore(highest_sequence_, sequence)) {
+        highest_sequence_ = sequence;
+    }
+    count_++;
+}
+
+bool JitterBuffer::Get(std::vector<uint8_t>& packet, int64_t* arrival_us) {
+    if (count_ == 0) {
+        if (playing_) {
+            playing_ = false;
+            statistics_.underruns++;
+        }
+        return false;
+    }
+
+    if (!playing_) {
+        // Hold the first packets back until the target depth is reached,
+        // or until the oldest one has waited as long as the target depth lasts (end of a short stream)
+        int64_t waited_us = esp_timer_get_time() - buffering_since_us_;
+        if ((int)count_ < target_depth_ && waited_us < target_depth_ * frame_us_) {
+            return false;
+        }
+        playing_ = true;
+        consecutive_concealed_ = 0;
+    }
+
+    size_t index = next_sequence_ & (slot_count_ - 1);
+    if (!filled_[index] && consecutive_concealed_ >= MAX_CONSECUTIVE_CONCEALED) {
+        SkipToFirstBuffered();
+        index = next_sequence_ & (slot_count_ - 1);
+    }
+    if (filled_[index] && sequences_[index] == next_sequence_) {
+        auto data = slots_ + index * slot_size_;
+        packet.assign(data, data + sizes_[index]);
+        if (arrival_us != nullptr) {
+            *arrival_us = arrivals_[index];
+        }
+        filled_[index] = false;
+        count_--;
+        consecutive_concealed_ = 0;
+        statistics_.played++;
+    } else {
+        packet.clear();
+        if (arrival_us != nullptr) {
+            *arrival_us = 0;
+        }
+        consecutive_concealed_++;
+        statistics_.concealed++;
+    }
+    next_sequence_++;
+    return true;
+}
+
+JitterBuffer::Statistics JitterBuffer::GetStatistics() const {
+    Statistics statistics = statistics_;
+    statistics.jitter_ms = (jitter_q4_ >> 4) / 1000;
+    statistics.target_depth = target_depth_;
+    statistics.buffered = count_;
+    return statistics;
+}
+
+void JitterBuffer::UpdateJitter(uint32_t sequence, int64_t arrival_us) {
+    if (has_last_arrival_) {
+        // Difference of the relative transit times of two packets
+        int64_t expected_us = (int64_t)(int32_t)(sequence - last_sequence_) * frame_us_;
+        int64_t d = (arrival_us - last_arrival_us_) - expected_us;
+        jitter_q4_ += llabs(d) - ((jitter_q4_ + 8) >> 4);
+
+        // Target one frame plus twice the jitter, rounded to whole frames
+        int64_t jitter_us = jitter_q4_ >> 4;
+        int depth = 1 + (int)((2 * jitter_us + frame_us_ / 2) / frame_us_);
+        int max_depth = slot_count_ / 2;
+        target_depth_ = depth > max_depth ? max_depth : depth;
+    }
+    has_last_arrival_ = true;
+    last_sequence_ = sequence;
+    last_arrival_us_ = arrival_us;
+}
+
+void JitterBuffer::SkipToFirstBuffered() {
+    for (size_t i = 0; i < slot_count_; i++) {
+        size_t index = (next_sequence_ + i) & (slot_count_ - 1);
+        if (filled_[index] && sequences_[index] == next_sequence_ + i) {
+            next_sequence_ += i;
+            break;
+        }
+    }
+    consecutive_concealed_ = 0;
+}
@@ -0,0 +1,73 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Reorders incoming opus packets by sequence number and releases them at playout pace.
+// The playout depth adapts to the measured inter-arrival jitter (RFC 3550 estimator),
+// missing packets are reported as empty packets so the decoder can run packet loss concealment.
+// Not thread safe: the decode task owns it and is the only one calling it, other tasks hand packets over through
+// the AudioPacketQueue. All storage is preallocated.
+class JitterBuffer {
+public:
+    struct Statistics {
+        uint32_t received = 0;
+        uint32_t played = 0;
+        uint32_t concealed = 0;
+        uint32_t late = 0;        // arrived after their playout time
+        uint32_t duplicated = 0;
+        uint32_t overflowed = 0;  // too far ahead of the playout position
+        uint32_t underruns = 0;   // ran dry while playing, includes the end of each stream
+        int jitter_ms = 0;
+        int target_depth = 0;     // in frames
+        int buffered = 0;         // in frames
+    };
+
+    JitterBuffer(size_t slot_count, size_t slot_size);
+    ~JitterBuffer();
+    JitterBuffer(const JitterBuffer&) = delete;
+    JitterBuffer& operator=(const JitterBuffer&) = delete;
+
+    void Reset(int frame_duration_ms);
+    void Clear();
+    void Put(uint32_t sequence, const uint8_t* data, size_t size, int64_t arrival_us);
+    // Returns false if nothing is due yet, an empty packet means the frame was lost (arrival_us is then 0)
+    bool Get(std::vector<uint8_t>& packet, int64_t* arrival_us = nullptr);
+    bool Empty() const { return count_ == 0; }
+    Statistics GetStatistics() const;
+
+private:
+    size_t slot_count_;
+    size_t slot_size_;
+    uint8_t* slots_ = nullptr;
+    uint16_t* sizes_ = nullptr;
+    uint32_t* sequences_ = nullptr;
+    int64_t* arrivals_ = nullptr;
+    bool* filled_ = nullptr;
+
+    int64_t frame_us_ = 60 * 1000;
+    bool playing_ = false;
+    bool synced_ = false;
+    uint32_t next_sequence_ = 0;
+    uint32_t highest_sequence_ = 0;
+    size_t count_ = 0;
+    int64_t buffering_since_us_ = 0;
+    int consecutive_concealed_ = 0;
+
+    // Interarrival jitter in microseconds, scaled by 16 as in RFC 3550
+    int64_t jitter_q4_ = 0;
+    bool has_last_arrival_ = false;
+    uint32_t last_sequence_ = 0;
+    int64_t last_arrival_us_ = 0;
+    int target_depth_ = 1;
+
+    Statistics statistics_;
+
+    void UpdateJitter(uint32_t sequence, int64_t arrival_us);
+    void DropAll();
+    void SkipToFirstBuffered();
+};
+
+#endif // JITTER_BUFFER_H
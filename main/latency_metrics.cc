@@ -0,0 +1,136 @@
+#include "latency_metrics.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cstdio>
+#include <algorithm>
+
+#define TAG "LatencyMetrics"
+
+static const char* const kStageNames[kLatencyStageCount] = {
+    "mic_to_processed",
+    "mic_to_encoded",
+    "mic_to_wire",
+    "wire_to_dequeue",
+    "dequeue_to_decoded",
+    "wire_to_speaker",
+};
+
+constexpr uint16_t LatencyHistogram::kBucketBounds[];
+
+void LatencyHistogram::Record(int64_t us) {
+    uint32_t ms = us > 0 ? (uint32_t)(us / 1000) : 0;
+    int index = 0;
+    while (index < kBucketCount - 1 && ms > kBucketBounds[index]) {
+        index++;
+    }
+    buckets_[index].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_ms_.fetch_add(ms, std::memory_order_relaxed);
+
+    uint32_t max = max_ms_.load(std::memory_order_relaxed);
+    while (ms > max && !max_ms_.compare_exchange_weak(max, ms, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::Reset() {
+    for (auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_ms_.store(0, std::memory_order_relaxed);
+    max_ms_.store(0, std::memory_order_relaxed);
+}
+
+uint32_t LatencyHistogram::average_ms() const {
+    uint32_t n = count();
+    return n == 0 ? 0 : sum_ms_.load(std::memory_order_relaxed) / n;
+}
+
+uint32_t LatencyHistogram::PercentileMs(int percentile) const {
+    uint32_t n = count();
+    if (n == 0) {
+        return 0;
+    }
+    uint32_t rank = (n * percentile + 99) / 100;
+    uint32_t seen = 0;
+    for (int i = 0; i < kBucketCount - 1; i++) {
+        seen += bucket(i);
+        if (seen >= rank) {
+            // The bound can be above every sample in the bucket
+            return std::min<uint32_t>(kBucketBounds[i], max_ms());
+        }
+    }
+    return max_ms();
+}
+
+void LatencyMetrics::Record(LatencyStage stage, int64_t start_us) {
+    if (start_us == 0) {
+        return;
+    }
+    histograms_[stage].Record(esp_timer_get_time() - start_us);
+}
+
+void LatencyMetrics::Reset() {
+    for (auto& histogram : histograms_) {
+        histogram.Reset();
+    }
+}
+
+uint32_t LatencyMetrics::total_count() const {
+    uint32_t total = 0;
+    for (auto& histogram : histograms_) {
+        total += histogram.count();
+    }
+    return total;
+}
+
+void LatencyMetrics::Dump() {
+    for (int i = 0; i < kLatencyStageCount; i++) {
+        auto& h = histograms_[i];
+        if (h.count() == 0) {
+            continue;
+        }
+        char buckets[LatencyHistogram::kBucketCount * 11 + 1];
+        int length = 0;
+        for (int b = 0; b < LatencyHistogram::kBucketCount; b++) {
+            length += snprintf(buckets + length, sizeof(buckets) - length, " %lu", (unsigned long)h.bucket(b));
+        }
+        ESP_LOGI(TAG, "%-18s n=%lu avg=%lu p50<=%lu p95<=%lu max=%lu ms |%s",
+            kStageNames[i], (unsigned long)h.count(), (unsigned long)h.average_ms(),
+            (unsigned long)h.PercentileMs(50), (unsigned long)h.PercentileMs(95), (unsigned long)h.max_ms(), buckets);
+    }
+}
+
+std::string LatencyMetrics::ToJson() {
+    std::string json = "{\"bounds\":[";
+    for (int b = 0; b < LatencyHistogram::kBucketCount - 1; b++) {
+        if (b > 0) {
+            json += ",";
+        }
+        json += std::to_string(LatencyHistogram::kBucketBounds[b]);
+    }
+    json += "]";
+    for (int i = 0; i < kLatencyStageCount; i++) {
+        auto& h = histograms_[i];
+        if (h.count() == 0) {
+            continue;
+        }
+        json += ",\"" + std::string(kStageNames[i]) + "\":{";
+        json += "\"count\":" + std::to_string(h.count());
+        json += ",\"avg\":" + std::to_string(h.average_ms());
+        json += ",\"p50\":" + std::to_string(h.PercentileMs(50));
+        json += ",\"p95\":" + std::to_string(h.PercentileMs(95));
+        json += ",\"max\":" + std::to_string(h.max_ms());
+        json += ",\"buckets\":[";
+        for (int b = 0; b < LatencyHistogram::kBucketCount; b++) {
+            if (b > 0) {
+                json += ",";
+            }
+            json += std::to_string(h.bucket(b));
+        }
+        json += "]}";
+    }
+    json += "}";
+    return json;
+}
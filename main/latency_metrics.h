@@ -0,0 +1,67 @@
+#ifndef LATENCY_METRICS_H
+#define LATENCY_METRICS_H
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+// Hops of the audio path, each one measured from the capture or arrival of the audio
+enum LatencyStage {
+    kLatencyMicToProcessed,     // capture -> audio processor output
+    kLatencyMicToEncoded,       // capture -> opus packet ready
+    kLatencyMicToWire,          // capture -> handed to the protocol
+    kLatencyWireToDequeue,      // arrival -> taken from the jitter buffer
+    kLatencyDequeueToDecoded,   // taken from the jitter buffer -> decoded and resampled
+    kLatencyWireToSpeaker,      // arrival -> written to the codec
+    kLatencyStageCount
+};
+
+// Fixed bucket histogram, recording is a handful of relaxed atomic operations and never allocates
+class LatencyHistogram {
+public:
+    static constexpr int kBucketCount = 14;
+    // Upper bound of each bucket in milliseconds, the last bucket is unbounded
+    static constexpr uint16_t kBucketBounds[kBucketCount - 1] = {5, 10, 20, 40, 60, 80, 100, 150, 200, 300, 500, 1000, 2000};
+
+    void Record(int64_t us);
+    void Reset();
+    uint32_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint32_t bucket(int index) const { return buckets_[index].load(std::memory_order_relaxed); }
+    uint32_t average_ms() const;
+    uint32_t max_ms() const { return max_ms_.load(std::memory_order_relaxed); }
+    // Upper bound of the bucket holding the given percentile, capped at the maximum
+    uint32_t PercentileMs(int percentile) const;
+
+private:
+    std::atomic<uint32_t> buckets_[kBucketCount] = {};
+    std::atomic<uint32_t> count_{0};
+    std::atomic<uint32_t> sum_ms_{0};
+    std::atomic<uint32_t> max_ms_{0};
+};
+
+class LatencyMetrics {
+public:
+    static LatencyMetrics& GetInstance() {
+        static LatencyMetrics instance;
+        return instance;
+    }
+    LatencyMetrics(const LatencyMetrics&) = delete;
+    LatencyMetrics& operator=(const LatencyMetrics&) = delete;
+
+    // Records the time elapsed since start_us (esp_timer_get_time), ignored if start_us is 0
+    void Record(LatencyStage stage, int64_t start_us);
+    void Reset();
+    // Prints the histograms to the console
+    void Dump();
+    // {"bounds":[..],"mic_to_wire":{"count":..,"avg":..,"p50":..,"p95":..,"max":..,"buckets":[..]},..}
+    // Stages without samples are left out
+    std::string ToJson();
+    uint32_t total_count() const;
+
+private:
+    LatencyMetrics() = default;
+
+    LatencyHistogram histograms_[kLatencyStageCount];
+};
+
+#endif // LATENCY_METRICS_H
@@ -0,0 +1,366 @@
+#include "opus_benchmark.h"
+#include "audio_resampler.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <opus.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#if CONFIG_USE_OPUS_BENCHMARK
+#include <esp_console.h>
+#include "assets/lang_config.h"
+#endif
+
+#define TAG "OpusBenchmark"
+
+// Runs the encoder and the decoder, large enough for complexity 10 at 60 ms
+#define OPUS_BENCH_STACK_SIZE (4096 * 8)
+// Same as the encoder controller's LOAD_LOW_PERCENT, an initial complexity within it is not stepped down
+#define OPUS_BENCH_LOAD_BUDGET_PERCENT 25
+#define OPUS_BENCH_MAX_PACKET_SIZE 1500
+#define OPUS_BENCH_CLIP_GAP_MS 200
+#define OPUS_BENCH_SEGMENT_MS 20
+// Segments quieter than this (about -50 dBFS) don't count in the segmental SNR
+#define OPUS_BENCH_SILENCE_POWER 10000.0
+
+struct OpusBenchmark::RunContext {
+    OpusBenchmarkConfig config;
+    const std::vector<int16_t>* reference;
+    OpusBenchmarkResult result;
+    TaskHandle_t caller;
+};
+
+void OpusBenchmark::AddClip(std::vector<int16_t>&& pcm, int sample_rate) {
+    if (!pcm.empty()) {
+        clips_.push_back({std::move(pcm), sample_rate});
+        references_.clear();
+    }
+}
+
+bool OpusBenchmark::AddP3Clip(const std::string_view& p3) {
+    int error;
+    auto decoder = opus_decoder_create(16000, 1, &error);
+    if (decoder == nullptr) {
+        ESP_LOGE(TAG, "Failed to create the p3 decoder, error code: %d", error);
+        return false;
+    }
+    std::vector<int16_t> pcm;
+    std::vector<int16_t> frame(16000 * 60 / 1000);
+    size_t offset = 0;
+    // Frames of BinaryProtocol3: type, reserved, big endian payload size, payload
+    while (offset + 4 <= p3.size()) {
+        auto header = (const uint8_t*)p3.data() + offset;
+        size_t payload_size = (header[2] << 8) | header[3];
+        offset += 4 + payload_size;
+        if (offset > p3.size()) {
+            break;
+        }
+        int samples = opus_decode(decoder, header + 4, payload_size, frame.data(), frame.size(), 0);
+        if (samples > 0) {
+            pcm.insert(pcm.end(), frame.begin(), frame.begin() + samples);
+        }
+    }
+    opus_decoder_destroy(decoder);
+    if (pcm.empty()) {
+        return false;
+    }
+    AddClip(std::move(pcm), 16000);
+    return true;
+}
+
+// All clips at the sample rate, with a short gap of silence in between
+const std::vector<int16_t>& OpusBenchmark::Reference(int sample_rate) {
+    auto it = references_.find(sample_rate);
+    if (it != references_.end()) {
+        return it->second;
+    }
+    auto& reference = references_[sample_rate];
+    for (auto& clip : clips_) {
+        if (clip.sample_rate == sample_rate) {
+            reference.insert(reference.end(), clip.pcm.begin(), clip.pcm.end());
+        } else {
+            AudioResampler resampler;
+            resampler.Configure(clip.sample_rate, sample_rate);
+            size_t offset = reference.size();
+            reference.resize(offset + resampler.GetOutputSamples(clip.pcm.size()));
+            resampler.Process(clip.pcm.data(), clip.pcm.size(), reference.data() + offset);
+        }
+        reference.resize(reference.size() + sample_rate * OPUS_BENCH_CLIP_GAP_MS / 1000, 0);
+    }
+    return reference;
+}
+
+void OpusBenchmark::RunTask(void* arg) {
+    auto context = (RunContext*)arg;
+    auto& config = context->config;
+    auto& reference = *context->reference;
+    auto& result = context->result;
+    result.config = config;
+
+    int frame_size = config.sample_rate * config.frame_duration_ms / 1000;
+    size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    int error;
+    auto encoder = opus_encoder_create(config.sample_rate, 1, OPUS_APPLICATION_VOIP, &error);
+    auto decoder = opus_decoder_create(config.sample_rate, 1, &error);
+    if (encoder != nullptr && decoder != nullptr) {
+        result.heap_bytes = heap_before - heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        opus_encoder_ctl(encoder, OPUS_SET_DTX(1));
+        opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(config.complexity));
+        opus_encoder_ctl(encoder, OPUS_SET_BITRATE(config.bitrate > 0 ? config.bitrate : OPUS_AUTO));
+        opus_int32 lookahead = 0;
+        opus_encoder_ctl(encoder, OPUS_GET_LOOKAHEAD(&lookahead));
+
+        result.frames = reference.size() / frame_size;
+        std::vector<int16_t> decoded(result.frames * frame_size);
+        uint8_t packet[OPUS_BENCH_MAX_PACKET_SIZE];
+        int64_t encode_total_us = 0;
+        int64_t decode_total_us = 0;
+        size_t total_bytes = 0;
+        result.ok = true;
+        for (int i = 0; i < result.frames && result.ok; i++) {
+            int64_t start = esp_timer_get_time();
+            int size = opus_encode(encoder, reference.data() + i * frame_size, frame_size, packet, sizeof(packet));
+            int64_t encoded = esp_timer_get_time();
+            int samples = size > 0 ? opus_decode(decoder, packet, size, decoded.data() + i * frame_size, frame_size, 0) : -1;
+            int64_t end = esp_timer_get_time();
+            if (size <= 0 || samples != frame_size) {
+                ESP_LOGE(TAG, "Frame %d failed, encode %d, decode %d", i, size, samples);
+                result.ok = false;
+                break;
+            }
+            total_bytes += size;
+            encode_total_us += encoded - start;
+            decode_total_us += end - encoded;
+            result.encode_max_us = std::max<int>(result.encode_max_us, encoded - start);
+            result.decode_max_us = std::max<int>(result.decode_max_us, end - encoded);
+            // Lets the idle task feed the watchdog, outside of the timed calls
+            if (i % 10 == 9) {
+                vTaskDelay(1);
+            }
+        }
+
+        if (result.ok && result.frames > 0) {
+            int64_t audio_us = (int64_t)result.frames * config.frame_duration_ms * 1000;
+            result.encode_us = encode_total_us / result.frames;
+            result.decode_us = decode_total_us / result.frames;
+            result.encode_load_percent = encode_total_us * 100 / audio_us;
+            result.kbps = total_bytes * 8 * 1000 / audio_us;
+
+            // The decoded signal lags the input by the encoder look-ahead
+            int segment = config.sample_rate * OPUS_BENCH_SEGMENT_MS / 1000;
+            double signal = 0, noise = 0, segmental = 0;
+            int segments = 0;
+            for (size_t start = 0; start + segment + lookahead <= decoded.size(); start += segment) {
+                double segment_signal = 0, segment_noise = 0;
+                for (size_t j = start; j < start + segment; j++) {
+                    double s = reference[j];
+                    double e = s - decoded[j + lookahead];
+                    segment_signal += s * s;
+                    segment_noise += e * e;
+                }
+                signal += segment_signal;
+                noise += segment_noise;
+                if (segment_signal / segment > OPUS_BENCH_SILENCE_POWER) {
+                    double snr = 10 * log10(segment_signal / std::max(segment_noise, 1.0));
+                    segmental += std::min(std::max(snr, -10.0), 35.0);
+                    segments++;
+                }
+            }
+            result.snr_db = 10 * log10(std::max(signal, 1.0) / std::max(noise, 1.0));
+            result.segmental_snr_db = segments > 0 ? segmental / segments : 0;
+        }
+    } else {
+        ESP_LOGE(TAG, "Failed to create the codec, error code: %d", error);
+    }
+    if (encoder != nullptr) {
+        opus_encoder_destroy(encoder);
+    }
+    if (decoder != nullptr) {
+        opus_decoder_destroy(decoder);
+    }
+
+    result.stack_bytes = OPUS_BENCH_STACK_SIZE - uxTaskGetStackHighWaterMark(NULL) * sizeof(StackType_t);
+    xTaskNotifyGive(context->caller);
+    vTaskDelete(NULL);
+}
+
+OpusBenchmarkResult OpusBenchmark::Run(const OpusBenchmarkConfig& config) {
+    auto& reference = Reference(config.sample_rate);
+    RunContext context = {};
+    context.config = config;
+    context.reference = &reference;
+    context.result.config = config;
+    context.caller = xTaskGetCurrentTaskHandle();
+    if (xTaskCreate(RunTask, "opus_bench", OPUS_BENCH_STACK_SIZE, &context, 1, nullptr) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the benchmark task");
+        return context.result;
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return context.result;
+}
+
+std::vector<OpusBenchmarkResult> OpusBenchmark::Sweep(const std::vector<int>& sample_rates, const std::vector<int>& durations,
+    const std::vector<int>& complexities, const std::vector<int>& bitrates, bool csv) {
+    std::vector<OpusBenchmarkResult> results;
+    PrintHeader(csv);
+    for (int sample_rate : sample_rates) {
+        for (int duration : durations) {
+            for (int bitrate : bitrates) {
+                for (int complexity : complexities) {
+                    OpusBenchmarkConfig config;
+                    config.sample_rate = sample_rate;
+                    config.frame_duration_ms = duration;
+                    config.complexity = complexity;
+                    config.bitrate = bitrate;
+                    results.push_back(Run(config));
+                    Print(results.back(), csv);
+                }
+            }
+        }
+    }
+    if (!csv) {
+        PrintRecommendations(results);
+    }
+    return results;
+}
+
+void OpusBenchmark::PrintHeader(bool csv) {
+    if (csv) {
+        printf("rate,frame_ms,complexity,bitrate,frames,encode_us,encode_max_us,decode_us,decode_max_us,load_percent,"
+            "kbps,stack_bytes,heap_bytes,snr_db,segmental_snr_db\n");
+    } else {
+        printf(" rate  ms cx bitrate frames | enc us   max | dec us   max | load%% kbps | stack  heap |   snr segsnr\n");
+    }
+}
+
+void OpusBenchmark::Print(const OpusBenchmarkResult& result, bool csv) {
+    auto& config = result.config;
+    if (!result.ok) {
+        printf(csv ? "%d,%d,%d,%d,failed\n" : "%5d %3d %2d %7d failed\n", config.sample_rate, config.frame_duration_ms,
+            config.complexity, config.bitrate);
+        return;
+    }
+    printf(csv ? "%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%.2f,%.2f\n"
+        : "%5d %3d %2d %7d %6d | %6d %5d | %6d %5d | %5d %4d | %5d %5d | %5.1f %6.1f\n",
+        config.sample_rate, config.frame_duration_ms, config.complexity, config.bitrate, result.frames,
+        result.encode_us, result.encode_max_us, result.decode_us, result.decode_max_us, result.encode_load_percent,
+        result.kbps, result.stack_bytes, result.heap_bytes, result.snr_db, result.segmental_snr_db);
+}
+
+void OpusBenchmark::PrintRecommendations(const std::vector<OpusBenchmarkResult>& results) {
+    printf("Highest complexity within %d%% encode load:\n", OPUS_BENCH_LOAD_BUDGET_PERCENT);
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& config = results[i].config;
+        // Once per sample rate, frame duration and bitrate
+        bool seen = false;
+        for (size_t j = 0; j < i && !seen; j++) {
+            auto& other = results[j].config;
+            seen = other.sample_rate == config.sample_rate && other.frame_duration_ms == config.frame_duration_ms
+                && other.bitrate == config.bitrate;
+        }
+        if (seen) {
+            continue;
+        }
+        const OpusBenchmarkResult* best = nullptr;
+        for (auto& result : results) {
+            auto& other = result.config;
+            if (result.ok && other.sample_rate == config.sample_rate && other.frame_duration_ms == config.frame_duration_ms
+                && other.bitrate == config.bitrate && result.encode_load_percent <= OPUS_BENCH_LOAD_BUDGET_PERCENT
+                && (best == nullptr || other.complexity > best->config.complexity)) {
+                best = &result;
+            }
+        }
+        if (best != nullptr) {
+            printf("  %5d Hz %3d ms bitrate %d: complexity %d, %d%% load, %.1f dB segmental SNR\n", config.sample_rate,
+                config.frame_duration_ms, config.bitrate, best->config.complexity, best->encode_load_percent,
+                best->segmental_snr_db);
+        } else {
+            printf("  %5d Hz %3d ms bitrate %d: none\n", config.sample_rate, config.frame_duration_ms, config.bitrate);
+        }
+    }
+}
+
+bool OpusBenchmark::ParseList(const char* text, std::vector<int>& values) {
+    values.clear();
+    while (*text != '\0') {
+        char* end;
+        long value = strtol(text, &end, 10);
+        if (end == text || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        values.push_back(value);
+        text = *end == ',' ? end + 1 : end;
+    }
+    return !values.empty();
+}
+
+#if CONFIG_USE_OPUS_BENCHMARK
+static int OpusBenchmarkCommand(int argc, char** argv) {
+    std::vector<int> sample_rates = {16000, 24000};
+    std::vector<int> durations = {20, 60};
+    std::vector<int> complexities = {0, 3, 5};
+    std::vector<int> bitrates = {0};
+    bool csv = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--csv") {
+            csv = true;
+            continue;
+        }
+        std::vector<int>* list = arg == "-r" ? &sample_rates : arg == "-d" ? &durations
+            : arg == "-c" ? &complexities : arg == "-b" ? &bitrates : nullptr;
+        if (list == nullptr || i + 1 >= argc || !OpusBenchmark::ParseList(argv[++i], *list)) {
+            printf("Usage: opus_bench [-r 16000,24000] [-d 20,60] [-c 0,3,5] [-b 0,16000] [--csv]\n");
+            return 1;
+        }
+    }
+
+    // Speech prompts of the firmware language as the reference clips
+    OpusBenchmark benchmark;
+    benchmark.AddP3Clip(Lang::Sounds::P3_ACTIVATION);
+    benchmark.AddP3Clip(Lang::Sounds::P3_WELCOME);
+    benchmark.AddP3Clip(Lang::Sounds::P3_ERR_REG);
+    benchmark.Sweep(sample_rates, durations, complexities, bitrates, csv);
+    return 0;
+}
+
+void RegisterOpusBenchmarkCommand() {
+    const esp_console_cmd_t command = {
+        .command = "opus_bench",
+        .help = "Benchmark opus encoding and decoding, best run while the device is idle",
+        .hint = "[-r RATES] [-d FRAME_MS] [-c COMPLEXITIES] [-b BITRATES] [--csv]",
+        .func = OpusBenchmarkCommand,
+        .argtable = nullptr
+    };
+    if (esp_console_cmd_register(&command) != ESP_ERR_INVALID_STATE) {
+        return;
+    }
+
+    // The board has no console yet
+    esp_console_repl_t* repl = nullptr;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_config.prompt = "xiaozhi>";
+#if defined(CONFIG_ESP_CONSOLE_UART_DEFAULT) || defined(CONFIG_ESP_CONSOLE_UART_CUSTOM)
+    esp_console_dev_uart_config_t hw_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_console_new_repl_uart(&hw_config, &repl_config, &repl));
+#elif defined(CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG)
+    esp_console_dev_usb_serial_jtag_config_t hw_config = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_console_new_repl_usb_serial_jtag(&hw_config, &repl_config, &repl));
+#elif defined(CONFIG_ESP_CONSOLE_USB_CDC)
+    esp_console_dev_usb_cdc_config_t hw_config = ESP_CONSOLE_DEV_CDC_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_console_new_repl_usb_cdc(&hw_config, &repl_config, &repl));
+#else
+    ESP_LOGW(TAG, "No console for the opus_bench command");
+    return;
+#endif
+    ESP_ERROR_CHECK(esp_console_cmd_register(&command));
+    ESP_ERROR_CHECK(esp_console_start_repl(repl));
+}
+#endif
@@ -0,0 +1,77 @@
+#ifndef OPUS_BENCHMARK_H
+#define OPUS_BENCHMARK_H
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+struct OpusBenchmarkConfig {
+    int sample_rate = 16000;
+    int frame_duration_ms = 60;
+    int complexity = 5;
+    int bitrate = 0;                // bits per second, 0 leaves the libopus default like the wrapper
+};
+
+struct OpusBenchmarkResult {
+    OpusBenchmarkConfig config;
+    bool ok = false;
+    int frames = 0;
+    int encode_us = 0;              // average per frame
+    int encode_max_us = 0;
+    int decode_us = 0;
+    int decode_max_us = 0;
+    int encode_load_percent = 0;    // average encode time over the frame duration
+    int kbps = 0;                   // bitrate actually produced, DTX included
+    int stack_bytes = 0;            // peak stack of the task that ran the encoder and the decoder
+    int heap_bytes = 0;             // heap held by the encoder and the decoder
+    float snr_db = 0;
+    float segmental_snr_db = 0;     // mean over the 20 ms segments with speech, each clamped to -10..35 dB
+};
+
+// Encodes and decodes reference clips with libopus, set up the way OpusEncoderWrapper and OpusDecoderWrapper
+// do it (VOIP application, DTX, complexity) plus an optional bitrate, which the wrappers don't expose.
+// Each configuration runs in a fresh task, so the stack high water mark and the heap held by the codec
+// belong to that configuration alone. Quality is an SNR proxy against the clip, aligned by the encoder
+// look-ahead; it ranks configurations, it is not a perceptual score.
+// Shared by the opus_bench console command and host/tools/opus_bench.
+class OpusBenchmark {
+public:
+    // Clips of any sample rate, resampled to the rate of each configuration
+    void AddClip(std::vector<int16_t>&& pcm, int sample_rate);
+    // Decodes a p3 asset (16 kHz, 60 ms opus frames) to a clip
+    bool AddP3Clip(const std::string_view& p3);
+    bool HasClips() const { return !clips_.empty(); }
+
+    OpusBenchmarkResult Run(const OpusBenchmarkConfig& config);
+    // Runs every combination and prints a row per configuration, then the recommended complexities
+    std::vector<OpusBenchmarkResult> Sweep(const std::vector<int>& sample_rates, const std::vector<int>& durations,
+        const std::vector<int>& complexities, const std::vector<int>& bitrates, bool csv = false);
+
+    static void PrintHeader(bool csv);
+    static void Print(const OpusBenchmarkResult& result, bool csv);
+    // Per sample rate and frame duration, the highest complexity whose encode load stays within the budget
+    static void PrintRecommendations(const std::vector<OpusBenchmarkResult>& results);
+    // "0,3,5" into {0, 3, 5}
+    static bool ParseList(const char* text, std::vector<int>& values);
+
+private:
+    struct Clip {
+        std::vector<int16_t> pcm;
+        int sample_rate;
+    };
+    std::vector<Clip> clips_;
+    std::map<int, std::vector<int16_t>> references_;   // all clips by sample rate
+
+    struct RunContext;
+    static void RunTask(void* arg);
+    const std::vector<int16_t>& Reference(int sample_rate);
+};
+
+#if CONFIG_USE_OPUS_BENCHMARK
+// Registers the opus_bench console command, starting a UART console if the board has none
+void RegisterOpusBenchmarkCommand();
+#endif
+
+#endif // OPUS_BENCHMARK_H
@@ -4,6 +4,7 @@
 #include "settings.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <ml307_mqtt.h>
 #include <ml307_udp.h>
 #include <cstring>
@@ -181,14 +182,14 @@ bool MqttProtocol::OpenAudioChannel() {
     session_id_ = "";
     xEventGroupClearBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 
+    BeginNegotiation();
     // 发送 hello 消息申请 UDP 通道
     std::string message = "{";
     message += "\"type\":\"hello\",";
     message += "\"version\": 3,";
     message += "\"transport\":\"udp\",";
-    message += "\"audio_params\":{";
-    message += "\"format\":\"opus\", \"sample_rate\":16000, \"channels\":1, \"frame_duration\":" + std::to_string(OPUS_FRAME_DURATION_MS);
-    message += "}}";
+    message += "\"audio_params\":" + GetHelloAudioParams();
+    message += "}";
     if (!SendText(message)) {
         return false;
     }
@@ -215,31 +216,28 @@ bool MqttProtocol::OpenAudioChannel() {
             ESP_LOGE(TAG, "Invalid audio packet type: %x", data[0]);
             return;
         }
-        uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
-        if (sequence < remote_sequence_) {
-            ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_);
-            return;
-        }
-        if (sequence != remote_sequence_ + 1) {
-            ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
-        }
+        // Reordered and lost packets are handled by the jitter buffer of the application
+        AudioStreamPacket packet;
+        packet.timestamp = esp_timer_get_time();
+        packet.sequence = ntohl(*(uint32_t*)&data[12]);
 
-        std::vector<uint8_t> decrypted;
         size_t decrypted_size = data.size() - aes_nonce_.size();
         size_t nc_off = 0;
         uint8_t stream_block[16] = {0};
-        decrypted.resize(decrypted_size);
+        packet.payload.resize(decrypted_size);
         auto nonce = (uint8_t*)data.data();
         auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
-        int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, (uint8_t*)decrypted.data());
+        int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, packet.payload.data());
         if (ret != 0) {
             ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
             return;
         }
+        if ((int32_t)(packet.sequence - remote_sequence_) > 0) {
+            remote_sequence_ = packet.sequence;
+        }
         if (on_incoming_audio_ != nullptr) {
-            on_incoming_audio_(std::move(decrypted));
+            on_incoming_audio_(std::move(packet));
         }
-        remote_sequence_ = sequence;
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
@@ -265,17 +263,7 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
     }
 
     // Get sample rate from hello message
-    auto audio_params = cJSON_GetObjectItem(root, "audio_params");
-    if (audio_params != NULL) {
-        auto sample_rate = cJSON_GetObjectItem(audio_params, "sample_rate");
-        if (sample_rate != NULL) {
-            server_sample_rate_ = sample_rate->valueint;
-        }
-        auto frame_duration = cJSON_GetObjectItem(audio_params, "frame_duration");
-        if (frame_duration != NULL) {
-            server_frame_duration_ = frame_duration->valueint;
-        }
-    }
+    ParseServerAudioParams(cJSON_GetObjectItem(root, "audio_params"));
 
     auto udp = cJSON_GetObjectItem(root, "udp");
     if (udp == nullptr) {
@@ -8,7 +8,7 @@ void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
     on_incoming_json_ = callback;
 }
 
-void Protocol::OnIncomingAudio(std::function<void(std::vector<uint8_t>&& data)> callback) {
+void Protocol::OnIncomingAudio(std::function<void(AudioStreamPacket&& packet)> callback) {
     on_incoming_audio_ = callback;
 }
 
@@ -115,13 +115,72 @@ void Protocol::SendIotStates(const std::string& states) {
     SendText(message);
 }
 
+void Protocol::SendMetrics(const std::string& latency, const std::string& encoder) {
+    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"metrics\",\"latency\":" + latency;
+    message += ",\"encoder\":" + encoder + "}";
+    SendText(message);
+}
+
+static bool IsValidUplinkFrameDuration(int frame_duration) {
+    return frame_duration == 10 || frame_duration == 20 || frame_duration == 40 || frame_duration == 60;
+}
+
+void Protocol::SetUplinkFrameDuration(int frame_duration) {
+    if (!IsValidUplinkFrameDuration(frame_duration)) {
+        ESP_LOGE(TAG, "Invalid uplink frame duration: %d", frame_duration);
+        return;
+    }
+    preferred_uplink_frame_duration_ = frame_duration;
+}
+
+// Called before each hello, the server answers the proposal with the uplink frame duration of the session
+void Protocol::BeginNegotiation() {
+    uplink_frame_duration_ = preferred_uplink_frame_duration_;
+}
+
+// The audio params of the client hello
+std::string Protocol::GetHelloAudioParams(bool offer_packing) const {
+    std::string params = "{\"format\":\"opus\", \"sample_rate\":16000, \"channels\":1, ";
+    params += "\"frame_duration\":" + std::to_string(preferred_uplink_frame_duration_) + ", ";
+    params += "\"frame_durations\":[10,20,40,60]";
+    if (offer_packing) {
+        // Several opus frames per binary message, each one prefixed with its length
+        params += ", \"packing\":\"length_prefixed\"";
+    }
+    params += "}";
+    return params;
+}
+
+void Protocol::ParseServerAudioParams(const cJSON* audio_params) {
+    if (audio_params == nullptr) {
+        return;
+    }
+    auto sample_rate = cJSON_GetObjectItem(audio_params, "sample_rate");
+    if (sample_rate != NULL) {
+        server_sample_rate_ = sample_rate->valueint;
+    }
+    auto frame_duration = cJSON_GetObjectItem(audio_params, "frame_duration");
+    if (frame_duration != NULL) {
+        server_frame_duration_ = frame_duration->valueint;
+    }
+    // The server may pick another uplink frame duration from the ones we offered
+    auto uplink_frame_duration = cJSON_GetObjectItem(audio_params, "uplink_frame_duration");
+    if (uplink_frame_duration != NULL) {
+        if (IsValidUplinkFrameDuration(uplink_frame_duration->valueint)) {
+            uplink_frame_duration_ = uplink_frame_duration->valueint;
+        } else {
+            ESP_LOGW(TAG, "Ignore invalid uplink frame duration: %d", uplink_frame_duration->valueint);
+        }
+    }
+}
+
 bool Protocol::IsTimeout() const {
     const int kTimeoutSeconds = 120;
     auto now = std::chrono::steady_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - last_incoming_time_);
     bool timeout = duration.count() > kTimeoutSeconds;
     if (timeout) {
-        ESP_LOGE(TAG, "Channel timeout %lld seconds", duration.count());
+        ESP_LOGE(TAG, "Channel timeout %lld seconds", (long long)duration.count());
     }
     return timeout;
 }
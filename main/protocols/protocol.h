@@ -5,6 +5,7 @@
 #include <string>
 #include <functional>
 #include <chrono>
+#include <vector>
 
 struct BinaryProtocol3 {
     uint8_t type;
@@ -13,6 +14,12 @@ struct BinaryProtocol3 {
     uint8_t payload[];
 } __attribute__((packed));
 
+struct AudioStreamPacket {
+    uint32_t sequence = 0;
+    int64_t timestamp = 0; // arrival time in microseconds, esp_timer_get_time()
+    std::vector<uint8_t> payload;
+};
+
 enum AbortReason {
     kAbortReasonNone,
     kAbortReasonWakeWordDetected
@@ -34,11 +41,15 @@ public:
     inline int server_frame_duration() const {
         return server_frame_duration_;
     }
+    // Frame duration of the audio sent to the server, negotiated in the hello exchange
+    inline int uplink_frame_duration() const {
+        return uplink_frame_duration_;
+    }
     inline const std::string& session_id() const {
         return session_id_;
     }
 
-    void OnIncomingAudio(std::function<void(std::vector<uint8_t>&& data)> callback);
+    void OnIncomingAudio(std::function<void(AudioStreamPacket&& packet)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
@@ -50,22 +61,29 @@ public:
     virtual bool IsAudioChannelOpened() const = 0;
     virtual bool IsAudioChannelBusy() const;
     virtual void SendAudio(const std::vector<uint8_t>& data) = 0;
+    // Sends the audio held back for packing, called when the uplink pauses
+    virtual void FlushAudio() {}
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
     virtual void SendAbortSpeaking(AbortReason reason);
     virtual void SendIotDescriptors(const std::string& descriptors);
     virtual void SendIotStates(const std::string& states);
+    virtual void SendMetrics(const std::string& latency, const std::string& encoder);
+    // Uplink frame duration proposed in the next hello, 10, 20, 40 or 60 ms
+    void SetUplinkFrameDuration(int frame_duration);
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
-    std::function<void(std::vector<uint8_t>&& data)> on_incoming_audio_;
+    std::function<void(AudioStreamPacket&& packet)> on_incoming_audio_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
     std::function<void(const std::string& message)> on_network_error_;
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
+    int preferred_uplink_frame_duration_ = 60;
+    int uplink_frame_duration_ = 60;
     bool error_occurred_ = false;
     bool busy_sending_audio_ = false;
     std::string session_id_;
@@ -74,6 +92,9 @@ protected:
     virtual bool SendText(const std::string& text) = 0;
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
+    void BeginNegotiation();
+    std::string GetHelloAudioParams(bool offer_packing = false) const;
+    void ParseServerAudioParams(const cJSON* audio_params);
 };
 
 #endif // PROTOCOL_H
@@ -7,6 +7,7 @@
 #include <cstring>
 #include <cJSON.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <arpa/inet.h>
 #include "assets/lang_config.h"
 
@@ -29,21 +30,97 @@ bool WebsocketProtocol::Start() {
 }
 
 void WebsocketProtocol::SendAudio(const std::vector<uint8_t>& data) {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
     if (websocket_ == nullptr) {
         return;
     }
+    if (!packing_enabled_) {
+        SendBinary(data.data(), data.size(), 1);
+        return;
+    }
+
+    // Each frame is prefixed with its size, 16 bits big endian
+    int64_t now = esp_timer_get_time();
+    if (pack_frames_ == 0) {
+        pack_start_us_ = now;
+    }
+    uint16_t size = htons(data.size());
+    pack_buffer_.insert(pack_buffer_.end(), (uint8_t*)&size, (uint8_t*)&size + sizeof(size));
+    pack_buffer_.insert(pack_buffer_.end(), data.begin(), data.end());
+    pack_frames_++;
+
+    // Send when the window is full, or when waiting for the next frame would exceed the latency budget
+    int64_t frame_us = uplink_frame_duration_ * 1000;
+    if (pack_frames_ >= pack_window_ || now - pack_start_us_ + frame_us > WEBSOCKET_PACKING_LATENCY_BUDGET_MS * 1000) {
+        FlushPackedAudio();
+    }
+}
+
+void WebsocketProtocol::FlushAudio() {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    if (websocket_ == nullptr) {
+        return;
+    }
+    FlushPackedAudio();
+}
 
+// Requires channel_mutex_
+void WebsocketProtocol::SendBinary(const uint8_t* data, size_t size, int frames) {
     busy_sending_audio_ = true;
-    websocket_->Send(data.data(), data.size(), true);
+    int64_t start_time = esp_timer_get_time();
+    websocket_->Send(data, size, true);
+    int64_t send_us = esp_timer_get_time() - start_time;
     busy_sending_audio_ = false;
+
+    // Client frames carry a 2 byte header, an extended length above 125 bytes and a 4 byte mask
+    frames_sent_ += frames;
+    messages_sent_++;
+    wire_bytes_ += size + 2 + (size > 125 ? 2 : 0) + 4;
+    if (packing_enabled_) {
+        UpdatePackWindow(send_us, frames);
+    }
+}
+
+// Requires channel_mutex_
+void WebsocketProtocol::FlushPackedAudio() {
+    if (pack_frames_ == 0) {
+        return;
+    }
+    SendBinary(pack_buffer_.data(), pack_buffer_.size(), pack_frames_);
+    pack_buffer_.clear();
+    pack_frames_ = 0;
+}
+
+void WebsocketProtocol::UpdatePackWindow(int64_t send_us, int frames) {
+    // Smoothed send time per frame
+    int64_t per_frame_us = send_us / frames;
+    send_us_ += (per_frame_us - send_us_) / 8;
+
+    int64_t frame_us = uplink_frame_duration_ * 1000;
+    int max_window = 1 + WEBSOCKET_PACKING_LATENCY_BUDGET_MS / uplink_frame_duration_;
+    if (send_us_ > frame_us / 2 && pack_window_ < max_window) {
+        pack_window_++;
+        ESP_LOGI(TAG, "Audio packing window %d frames, send %lld us per frame", pack_window_, (long long)send_us_);
+    } else if (send_us_ < frame_us / 4 && pack_window_ > 1) {
+        pack_window_--;
+        ESP_LOGI(TAG, "Audio packing window %d frames, send %lld us per frame", pack_window_, (long long)send_us_);
+    }
 }
 
 bool WebsocketProtocol::SendText(const std::string& text) {
-    if (websocket_ == nullptr) {
-        return false;
+    bool sent;
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (websocket_ == nullptr) {
+            return false;
+        }
+        // Audio packed before this message goes out first
+        FlushPackedAudio();
+        sent = websocket_->Send(text);
     }
 
-    if (!websocket_->Send(text)) {
+    // The error callback may close the channel, so it runs without the lock
+    if (!sent) {
         ESP_LOGE(TAG, "Failed to send text: %s", text.c_str());
         SetError(Lang::Strings::SERVER_ERROR);
         return false;
@@ -57,6 +134,11 @@ bool WebsocketProtocol::IsAudioChannelOpened() const {
 }
 
 void WebsocketProtocol::CloseAudioChannel() {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    if (messages_sent_ > 0) {
+        ESP_LOGI(TAG, "Audio sent: %lu frames in %lu messages, %lu bytes on the wire", (unsigned long)frames_sent_,
+            (unsigned long)messages_sent_, (unsigned long)wire_bytes_);
+    }
     if (websocket_ != nullptr) {
         delete websocket_;
         websocket_ = nullptr;
@@ -64,8 +146,20 @@ void WebsocketProtocol::CloseAudioChannel() {
 }
 
 bool WebsocketProtocol::OpenAudioChannel() {
-    if (websocket_ != nullptr) {
-        delete websocket_;
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (websocket_ != nullptr) {
+            delete websocket_;
+            websocket_ = nullptr;
+        }
+        packing_enabled_ = false;
+        pack_window_ = 1;
+        pack_frames_ = 0;
+        pack_buffer_.clear();
+        send_us_ = 0;
+        frames_sent_ = 0;
+        messages_sent_ = 0;
+        wire_bytes_ = 0;
     }
 
     Settings settings("websocket", false);
@@ -80,7 +174,10 @@ bool WebsocketProtocol::OpenAudioChannel() {
         token = "Bearer " + token;
     }
 
-    websocket_ = Board::GetInstance().CreateWebSocket();
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        websocket_ = Board::GetInstance().CreateWebSocket();
+    }
     websocket_->SetHeader("Authorization", token.c_str());
     websocket_->SetHeader("Protocol-Version", "1");
     websocket_->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
@@ -89,7 +186,12 @@ bool WebsocketProtocol::OpenAudioChannel() {
     websocket_->OnData([this](const char* data, size_t len, bool binary) {
         if (binary) {
             if (on_incoming_audio_ != nullptr) {
-                on_incoming_audio_(std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len));
+                // WebSocket runs over TCP, so the packets arrive in order and are numbered locally
+                AudioStreamPacket packet;
+                packet.timestamp = esp_timer_get_time();
+                packet.sequence = ++remote_sequence_;
+                packet.payload.assign((uint8_t*)data, (uint8_t*)data + len);
+                on_incoming_audio_(std::move(packet));
             }
         } else {
             // Parse JSON data
@@ -125,15 +227,15 @@ bool WebsocketProtocol::OpenAudioChannel() {
         return false;
     }
 
+    BeginNegotiation();
     // Send hello message to describe the client
     // keys: message type, version, audio_params (format, sample_rate, channels)
     std::string message = "{";
     message += "\"type\":\"hello\",";
     message += "\"version\": 1,";
     message += "\"transport\":\"websocket\",";
-    message += "\"audio_params\":{";
-    message += "\"format\":\"opus\", \"sample_rate\":16000, \"channels\":1, \"frame_duration\":" + std::to_string(OPUS_FRAME_DURATION_MS);
-    message += "}}";
+    message += "\"audio_params\":" + GetHelloAudioParams(true);
+    message += "}";
     if (!SendText(message)) {
         return false;
     }
@@ -161,14 +263,13 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
     }
 
     auto audio_params = cJSON_GetObjectItem(root, "audio_params");
-    if (audio_params != NULL) {
-        auto sample_rate = cJSON_GetObjectItem(audio_params, "sample_rate");
-        if (sample_rate != NULL) {
-            server_sample_rate_ = sample_rate->valueint;
-        }
-        auto frame_duration = cJSON_GetObjectItem(audio_params, "frame_duration");
-        if (frame_duration != NULL) {
-            server_frame_duration_ = frame_duration->valueint;
+    ParseServerAudioParams(audio_params);
+    if (audio_params != nullptr) {
+        auto packing = cJSON_GetObjectItem(audio_params, "packing");
+        if (cJSON_IsString(packing) && strcmp(packing->valuestring, "length_prefixed") == 0) {
+            std::lock_guard<std::mutex> lock(channel_mutex_);
+            packing_enabled_ = true;
+            ESP_LOGI(TAG, "Audio packing enabled");
         }
     }
 
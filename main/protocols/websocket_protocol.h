@@ -7,8 +7,11 @@
 #include <web_socket.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <mutex>
 
 #define WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
+// Longest time a packed audio frame may wait for the ones after it
+#define WEBSOCKET_PACKING_LATENCY_BUDGET_MS 120
 
 class WebsocketProtocol : public Protocol {
 public:
@@ -17,15 +20,34 @@ public:
 
     bool Start() override;
     void SendAudio(const std::vector<uint8_t>& data) override;
+    void FlushAudio() override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
 
 private:
     EventGroupHandle_t event_group_handle_;
+    // Audio is sent from the audio sender task, text from the main loop
+    std::mutex channel_mutex_;
     WebSocket* websocket_ = nullptr;
+    uint32_t remote_sequence_ = 0;
+
+    // Packing of several opus frames into one binary message, enabled by the server hello.
+    // The window grows while sending takes a large share of the real time and shrinks again when the link is idle.
+    bool packing_enabled_ = false;
+    int pack_window_ = 1;
+    int pack_frames_ = 0;
+    int64_t pack_start_us_ = 0;
+    int64_t send_us_ = 0;
+    std::vector<uint8_t> pack_buffer_;
+    uint32_t frames_sent_ = 0;
+    uint32_t messages_sent_ = 0;
+    uint32_t wire_bytes_ = 0;
 
     void ParseServerHello(const cJSON* root);
+    void SendBinary(const uint8_t* data, size_t size, int frames);
+    void FlushPackedAudio();
+    void UpdatePackWindow(int64_t send_us, int frames);
     bool SendText(const std::string& text) override;
 };
 
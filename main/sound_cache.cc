@@ -0,0 +1,75 @@
+#include "sound_cache.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+
+#define TAG "SoundCache"
+
+PcmClip::~PcmClip() {
+    heap_caps_free(samples);
+}
+
+SoundCache::SoundCache(size_t budget_bytes) : budget_bytes_(budget_bytes) {
+}
+
+std::shared_ptr<const PcmClip> SoundCache::Lookup(const void* asset, int sample_rate) {
+    if (budget_bytes_ == 0) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->asset == asset && it->sample_rate == sample_rate) {
+            entries_.splice(entries_.begin(), entries_, it);
+            statistics_.hits++;
+            statistics_.saved_us += it->clip->decode_us;
+            return it->clip;
+        }
+    }
+    statistics_.misses++;
+    return nullptr;
+}
+
+void SoundCache::Insert(const void* asset, int sample_rate, const int16_t* samples, size_t size, int64_t decode_us) {
+    size_t bytes = size * sizeof(int16_t);
+    if (bytes == 0 || bytes > max_clip_bytes()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& entry : entries_) {
+        if (entry.asset == asset && entry.sample_rate == sample_rate) {
+            return;
+        }
+    }
+
+    // Evict the least recently used clips until the new one fits
+    while (!entries_.empty() && statistics_.bytes + bytes > budget_bytes_) {
+        statistics_.bytes -= entries_.back().clip->size * sizeof(int16_t);
+        statistics_.evictions++;
+        entries_.pop_back();
+    }
+
+    auto clip = std::make_shared<PcmClip>();
+    clip->samples = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+    if (clip->samples == nullptr) {
+        clip->samples = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+    }
+    if (clip->samples == nullptr) {
+        ESP_LOGW(TAG, "Failed to allocate %u bytes for sound clip", (unsigned)bytes);
+        return;
+    }
+    memcpy(clip->samples, samples, bytes);
+    clip->size = size;
+    clip->decode_us = decode_us;
+
+    entries_.push_front(Entry{asset, sample_rate, std::move(clip)});
+    statistics_.bytes += bytes;
+}
+
+SoundCache::Statistics SoundCache::GetStatistics() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    statistics_.clips = entries_.size();
+    return statistics_;
+}
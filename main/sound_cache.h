@@ -0,0 +1,53 @@
+#ifndef SOUND_CACHE_H
+#define SOUND_CACHE_H
+
+#include <mutex>
+#include <list>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// PCM of a sound, decoded and resampled to the codec output sample rate
+struct PcmClip {
+    int16_t* samples = nullptr;
+    size_t size = 0;        // in samples
+    int64_t decode_us = 0;  // time spent decoding and resampling the sound
+    ~PcmClip();
+};
+
+// LRU cache of decoded system sounds, keyed by the asset address and the output sample rate.
+// Clips are stored in PSRAM and shared with the sounds being played, so eviction never frees a clip in use.
+class SoundCache {
+public:
+    struct Statistics {
+        uint32_t hits = 0;
+        uint32_t misses = 0;
+        uint32_t evictions = 0;
+        size_t clips = 0;
+        size_t bytes = 0;
+        int64_t saved_us = 0;   // decode time skipped thanks to hits
+    };
+
+    explicit SoundCache(size_t budget_bytes);
+
+    std::shared_ptr<const PcmClip> Lookup(const void* asset, int sample_rate);
+    void Insert(const void* asset, int sample_rate, const int16_t* samples, size_t size, int64_t decode_us);
+    // Larger sounds are not worth evicting everything else for
+    size_t max_clip_bytes() const { return budget_bytes_ / 4; }
+    Statistics GetStatistics();
+
+private:
+    struct Entry {
+        const void* asset;
+        int sample_rate;
+        std::shared_ptr<const PcmClip> clip;
+    };
+
+    std::mutex mutex_;
+    size_t budget_bytes_;
+    std::list<Entry> entries_;  // most recently used first
+    Statistics statistics_;
+};
+
+#endif // SOUND_CACHE_H
@@ -0,0 +1,127 @@
+#include "sound_queue.h"
+#include "protocol.h"
+
+#include <esp_log.h>
+#include <arpa/inet.h>
+#include <cassert>
+
+#define TAG "SoundQueue"
+
+SoundQueue::SoundQueue(size_t capacity) : capacity_(capacity) {
+    // The counters wrap at 2^32, so the capacity must divide it evenly
+    assert(capacity_ > 0 && (capacity_ & (capacity_ - 1)) == 0);
+    entries_ = new Entry[capacity_];
+}
+
+SoundQueue::~SoundQueue() {
+    delete[] entries_;
+}
+
+bool SoundQueue::Push(const std::string_view& sound, std::shared_ptr<const PcmClip> pcm, std::function<void()> on_complete) {
+    if (sound.size() < sizeof(BinaryProtocol3)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(push_mutex_);
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    uint32_t tail = tail_.load(std::memory_order_acquire);
+    if (head - tail >= capacity_) {
+        ESP_LOGW(TAG, "Sound queue is full, sound dropped");
+        return false;
+    }
+
+    auto& entry = entries_[head & (capacity_ - 1)];
+    entry.sound = sound;
+    entry.pcm = std::move(pcm);
+    entry.on_complete = std::move(on_complete);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool SoundQueue::NextFrame(SoundFrame& frame, size_t max_samples) {
+    uint32_t tail = ConsumerTail();
+    if (tail == head_.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    auto& entry = entries_[tail & (capacity_ - 1)];
+    frame.sound = entry.sound.data();
+    frame.first = offset_ == 0;
+    if (entry.pcm) {
+        size_t count = entry.pcm->size - offset_;
+        if (count > max_samples) {
+            count = max_samples;
+        }
+        frame.opus = nullptr;
+        frame.opus_size = 0;
+        frame.pcm = entry.pcm;
+        frame.samples = entry.pcm->samples + offset_;
+        frame.sample_count = count;
+        offset_ += count;
+        frame.last = offset_ >= entry.pcm->size;
+        if (frame.last) {
+            frame.on_complete = std::move(entry.on_complete);
+            FinishEntry(tail);
+        }
+        return true;
+    }
+
+    auto p3 = (const BinaryProtocol3*)(entry.sound.data() + offset_);
+    size_t payload_size = ntohs(p3->payload_size);
+    size_t end = offset_ + sizeof(BinaryProtocol3) + payload_size;
+    if (end > entry.sound.size()) {
+        ESP_LOGE(TAG, "Truncated p3 frame at offset %u", (unsigned)offset_);
+        FinishEntry(tail);
+        return false;
+    }
+
+    frame.opus = p3->payload;
+    frame.opus_size = payload_size;
+    frame.pcm = nullptr;
+    frame.samples = nullptr;
+    frame.sample_count = 0;
+    offset_ = end;
+    frame.last = offset_ + sizeof(BinaryProtocol3) > entry.sound.size();
+    if (frame.last) {
+        frame.on_complete = std::move(entry.on_complete);
+        FinishEntry(tail);
+    }
+    return true;
+}
+
+void SoundQueue::Clear() {
+    clear_to_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+bool SoundQueue::Empty() const {
+    uint32_t head = head_.load(std::memory_order_acquire);
+    uint32_t tail = tail_.load(std::memory_order_acquire);
+    uint32_t clear_to = clear_to_.load(std::memory_order_acquire);
+    if ((int32_t)(clear_to - tail) > 0) {
+        tail = clear_to;
+    }
+    return head == tail;
+}
+
+uint32_t SoundQueue::ConsumerTail() {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    uint32_t clear_to = clear_to_.load(std::memory_order_acquire);
+    while ((int32_t)(clear_to - tail) > 0) {
+        // Discarded sounds release their callbacks without calling them
+        auto& entry = entries_[tail & (capacity_ - 1)];
+        entry.pcm = nullptr;
+        entry.on_complete = nullptr;
+        tail++;
+        offset_ = 0;
+        tail_.store(tail, std::memory_order_release);
+    }
+    return tail;
+}
+
+void SoundQueue::FinishEntry(uint32_t tail) {
+    auto& entry = entries_[tail & (capacity_ - 1)];
+    entry.pcm = nullptr;
+    entry.on_complete = nullptr;
+    offset_ = 0;
+    tail_.store(tail + 1, std::memory_order_release);
+}
@@ -0,0 +1,65 @@
+#ifndef SOUND_QUEUE_H
+#define SOUND_QUEUE_H
+
+#include <atomic>
+#include <mutex>
+#include <string_view>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#include "sound_cache.h"
+
+// One step of a queued sound, either an opus frame in flash or a chunk of cached PCM
+struct SoundFrame {
+    const char* sound = nullptr;            // asset the frame belongs to
+    bool first = false;
+    bool last = false;
+    const uint8_t* opus = nullptr;
+    size_t opus_size = 0;
+    std::shared_ptr<const PcmClip> pcm;     // set for cached sounds, keeps the clip alive while it is played
+    const int16_t* samples = nullptr;
+    size_t sample_count = 0;
+    std::function<void()> on_complete;      // handed out with the last frame
+};
+
+// Fixed capacity queue of p3 sounds waiting to be played.
+// Entries only reference the assets embedded in flash (Lang::Sounds) or a cached PCM clip, the consumer
+// walks them frame by frame with NextFrame(), so no audio data is copied and the hot path never allocates.
+// Any task may Push() or Clear(), only one task may call NextFrame(), it never blocks on the producers.
+class SoundQueue {
+public:
+    explicit SoundQueue(size_t capacity);
+    ~SoundQueue();
+    SoundQueue(const SoundQueue&) = delete;
+    SoundQueue& operator=(const SoundQueue&) = delete;
+
+    bool Push(const std::string_view& sound, std::shared_ptr<const PcmClip> pcm = nullptr,
+        std::function<void()> on_complete = nullptr);
+    // Cached PCM is handed out in chunks of at most max_samples
+    bool NextFrame(SoundFrame& frame, size_t max_samples);
+    void Clear();
+    bool Empty() const;
+
+private:
+    struct Entry {
+        std::string_view sound;
+        std::shared_ptr<const PcmClip> pcm;
+        std::function<void()> on_complete;
+    };
+
+    std::mutex push_mutex_;
+    size_t capacity_;
+    Entry* entries_ = nullptr;
+
+    // Monotonic counters, the entry index is counter & (capacity_ - 1)
+    std::atomic<uint32_t> head_{0};     // written by the producers
+    std::atomic<uint32_t> tail_{0};     // written by the consumer
+    std::atomic<uint32_t> clear_to_{0}; // entries before this counter are discarded by the consumer
+    size_t offset_ = 0;                 // read position of the consumer inside the current entry, in bytes or samples
+
+    uint32_t ConsumerTail();
+    void FinishEntry(uint32_t tail);
+};
+
+#endif // SOUND_QUEUE_H
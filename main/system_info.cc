@@ -88,9 +88,9 @@ esp_err_t SystemInfo::PrintRealTimeStats(TickType_t xTicksToWait) {
 
     printf("| Task | Run Time | Percentage\n");
     //Match each task in start_array to those in the end_array
-    for (int i = 0; i < start_array_size; i++) {
+    for (UBaseType_t i = 0; i < start_array_size; i++) {
         int k = -1;
-        for (int j = 0; j < end_array_size; j++) {
+        for (UBaseType_t j = 0; j < end_array_size; j++) {
             if (start_array[i].xHandle == end_array[j].xHandle) {
                 k = j;
                 //Mark that task have been matched by overwriting their handles
@@ -103,17 +103,18 @@ esp_err_t SystemInfo::PrintRealTimeStats(TickType_t xTicksToWait) {
         if (k >= 0) {
             uint32_t task_elapsed_time = end_array[k].ulRunTimeCounter - start_array[i].ulRunTimeCounter;
             uint32_t percentage_time = (task_elapsed_time * 100UL) / (total_elapsed_time * CONFIG_FREERTOS_NUMBER_OF_CORES);
-            printf("| %-16s | %8lu | %4lu%%\n", start_array[i].pcTaskName, task_elapsed_time, percentage_time);
+            printf("| %-16s | %8lu | %4lu%%\n", start_array[i].pcTaskName, (unsigned long)task_elapsed_time,
+                (unsigned long)percentage_time);
         }
     }
 
     //Print unmatched tasks
-    for (int i = 0; i < start_array_size; i++) {
+    for (UBaseType_t i = 0; i < start_array_size; i++) {
         if (start_array[i].xHandle != NULL) {
             printf("| %s | Deleted\n", start_array[i].pcTaskName);
         }
     }
-    for (int i = 0; i < end_array_size; i++) {
+    for (UBaseType_t i = 0; i < end_array_size; i++) {
         if (end_array[i].xHandle != NULL) {
             printf("| %s | Created\n", end_array[i].pcTaskName);
         }
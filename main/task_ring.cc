@@ -0,0 +1,59 @@
+#include "task_ring.h"
+
+#include <cassert>
+
+TaskRing::TaskRing(size_t capacity) {
+    assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+    slots_ = new Slot[capacity];
+    mask_ = capacity - 1;
+    for (size_t i = 0; i < capacity; i++) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+TaskRing::~TaskRing() {
+    delete[] slots_;
+}
+
+void TaskRing::PushOverflow(std::function<void()>&& callable) {
+    std::lock_guard<std::mutex> lock(overflow_mutex_);
+    overflow_tasks_.push_back(std::move(callable));
+    overflow_.store(true, std::memory_order_release);
+    overflowed_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TaskRing::Drain() {
+    // The ring holds the older tasks, a slot that is claimed but not yet filled ends the pass,
+    // its producer signals the consumer again when it is done
+    while (true) {
+        Slot& slot = slots_[head_ & mask_];
+        if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) {
+            break;
+        }
+        slot.task();
+        slot.task.Reset();
+        slot.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+        head_++;
+    }
+
+    if (!overflow_.load(std::memory_order_acquire)) {
+        return;
+    }
+    std::list<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(overflow_mutex_);
+        tasks = std::move(overflow_tasks_);
+        overflow_tasks_.clear();
+        overflow_.store(false, std::memory_order_release);
+    }
+    for (auto& task : tasks) {
+        task();
+    }
+}
+
+TaskRing::Statistics TaskRing::GetStatistics() const {
+    Statistics statistics;
+    statistics.pushed = pushed_.load(std::memory_order_relaxed);
+    statistics.overflowed = overflowed_.load(std::memory_order_relaxed);
+    return statistics;
+}
@@ -0,0 +1,142 @@
+#ifndef TASK_RING_H
+#define TASK_RING_H
+
+#include <atomic>
+#include <mutex>
+#include <list>
+#include <functional>
+#include <new>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// A void() callable stored inline, without a heap allocation.
+// Only callables of up to kStorageSize bytes can be stored, which covers lambdas capturing a few pointers or a std::function.
+class InlineTask {
+public:
+    static constexpr size_t kStorageSize = 48;
+
+    template <typename F>
+    static constexpr bool Fits() {
+        using T = std::decay_t<F>;
+        return sizeof(T) <= kStorageSize && alignof(T) <= alignof(std::max_align_t) &&
+            std::is_nothrow_move_constructible_v<T>;
+    }
+
+    InlineTask() = default;
+    InlineTask(const InlineTask&) = delete;
+    InlineTask& operator=(const InlineTask&) = delete;
+    ~InlineTask() { Reset(); }
+
+    template <typename F>
+    void Emplace(F&& callable) {
+        static_assert(Fits<F>(), "callable does not fit the inline storage");
+        using T = std::decay_t<F>;
+        Reset();
+        new (storage_) T(std::forward<F>(callable));
+        ops_ = &kOps<T>;
+    }
+
+    void Reset() {
+        if (ops_ != nullptr) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    void operator()() { ops_->invoke(storage_); }
+
+private:
+    struct Ops {
+        void (*invoke)(void* callable);
+        void (*destroy)(void* callable);
+    };
+    template <typename T>
+    static constexpr Ops kOps = {
+        [](void* callable) { (*static_cast<T*>(callable))(); },
+        [](void* callable) { static_cast<T*>(callable)->~T(); },
+    };
+
+    alignas(std::max_align_t) unsigned char storage_[kStorageSize];
+    const Ops* ops_ = nullptr;
+};
+
+// Fixed capacity queue of tasks with many producers and one consumer.
+// Producers claim a slot with a compare-and-swap and build the task in place, the consumer runs the tasks
+// without taking a lock (bounded MPMC queue by D. Vyukov, used with a single consumer).
+// Callables too large for a slot, and tasks pushed while the ring is full, go to a list under a mutex instead,
+// until the consumer has caught up.
+class TaskRing {
+public:
+    struct Statistics {
+        uint32_t pushed = 0;      // tasks stored in the ring
+        uint32_t overflowed = 0;  // tasks that took the list
+    };
+
+    explicit TaskRing(size_t capacity);
+    ~TaskRing();
+    TaskRing(const TaskRing&) = delete;
+    TaskRing& operator=(const TaskRing&) = delete;
+
+    template <typename F>
+    void Push(F&& callable) {
+        if constexpr (InlineTask::Fits<F>()) {
+            if (!overflow_.load(std::memory_order_acquire) && TryPush(std::forward<F>(callable))) {
+                return;
+            }
+        }
+        PushOverflow(std::function<void()>(std::forward<F>(callable)));
+    }
+
+    // Runs everything pushed so far, only called by the consumer
+    void Drain();
+    Statistics GetStatistics() const;
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        InlineTask task;
+    };
+
+    Slot* slots_;
+    size_t mask_;
+    std::atomic<size_t> tail_{0};
+    size_t head_ = 0;
+
+    std::mutex overflow_mutex_;
+    std::list<std::function<void()>> overflow_tasks_;
+    // Set while the list holds tasks, so later pushes queue behind them
+    std::atomic<bool> overflow_{false};
+    std::atomic<uint32_t> pushed_{0};
+    std::atomic<uint32_t> overflowed_{0};
+
+    // Returns false if the ring is full, the callable is left untouched then
+    template <typename F>
+    bool TryPush(F&& callable) {
+        size_t position = tail_.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots_[position & mask_];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+            if (difference == 0) {
+                if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        slot->task.Emplace(std::forward<F>(callable));
+        slot->sequence.store(position + 1, std::memory_order_release);
+        pushed_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void PushOverflow(std::function<void()>&& callable);
+};
+
+#endif // TASK_RING_H
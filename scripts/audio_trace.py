@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""
+Tools for the audio traces recorded with CONFIG_USE_AUDIO_TRACE (see main/audio_trace_format.h).
+
+    python3 scripts/audio_trace.py extract monitor.log trace.xzt
+    python3 scripts/audio_trace.py info trace.xzt
+    python3 scripts/audio_trace.py synth trace.xzt
+
+extract pulls the "@XZAT <line> <base64>" lines out of a console capture (idf.py monitor | tee monitor.log)
+and writes the trace file. The capture has to start before the device boots, the first line holds the header.
+A lost line breaks the record framing, the trace is cut before it.
+synth writes the downlink of a made up turn with jitter, reordering, loss, a duplicate and a stall, for the
+host regression test. Its packets are empty 60 ms SILK frames, any libopus decodes them to the same length.
+
+The trace is replayed through the firmware audio code with the host tool:
+
+    cmake -S host -B build/host && cmake --build build/host
+    build/host/trace_replay --speaker speaker.wav trace.xzt
+"""
+import argparse
+import base64
+import re
+import struct
+import sys
+
+MAGIC = b"XZAT"
+VERSION = 1
+CONSOLE_LINE = re.compile(r"@XZAT (\d+) ([A-Za-z0-9+/=]+)")
+
+RECORD_TYPES = {
+    1: "input_format",
+    2: "mic_pcm",
+    3: "uplink_pcm",
+    4: "encoder_config",
+    5: "uplink_opus",
+    6: "decoder_config",
+    7: "downlink_opus",
+    8: "device_state",
+    9: "dropped",
+}
+FILE_HEADER = struct.Struct("<4sHH")
+RECORD_HEADER = struct.Struct("<BBHI")
+
+
+def extract(log_path, trace_path):
+    data = bytearray()
+    expected = 0
+    with open(log_path, "r", errors="replace") as f:
+        for text in f:
+            match = CONSOLE_LINE.search(text)
+            if match is None:
+                continue
+            line = int(match.group(1))
+            if line != expected:
+                if expected == 0:
+                    print(f"The capture starts at line {line}, the header is missing", file=sys.stderr)
+                    return 1
+                print(f"Line {expected} is missing, the trace is cut at {len(data)} bytes", file=sys.stderr)
+                break
+            data += base64.b64decode(match.group(2))
+            expected += 1
+    if expected == 0:
+        print("No trace lines found", file=sys.stderr)
+        return 1
+    with open(trace_path, "wb") as f:
+        f.write(data)
+    print(f"{expected} lines, {len(data)} bytes written to {trace_path}")
+    return 0
+
+
+def records(data):
+    magic, version, _ = FILE_HEADER.unpack_from(data, 0)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError(f"not an audio trace of version {VERSION}")
+    offset = FILE_HEADER.size
+    time_us = 0
+    while offset + RECORD_HEADER.size <= len(data):
+        record_type, _, size, record_time = RECORD_HEADER.unpack_from(data, offset)
+        offset += RECORD_HEADER.size
+        if offset + size > len(data):
+            print(f"Truncated record of type {record_type}", file=sys.stderr)
+            return
+        # 32 bit times, extended relative to the previous record
+        delta = (record_time - time_us) & 0xFFFFFFFF
+        time_us += delta - (1 << 32) if delta >= (1 << 31) else delta
+        yield record_type, time_us, data[offset:offset + size]
+        offset += size
+
+
+def info(trace_path):
+    with open(trace_path, "rb") as f:
+        data = f.read()
+    counts = {}
+    dropped = 0
+    first = last = None
+    for record_type, time_us, payload in records(data):
+        name = RECORD_TYPES.get(record_type, f"type_{record_type}")
+        count, size = counts.get(name, (0, 0))
+        counts[name] = (count + 1, size + len(payload))
+        if record_type == 9:
+            dropped += struct.unpack_from("<I", payload)[0]
+        elif record_type == 1:
+            rate, channels, reference, _ = struct.unpack_from("<IBBH", payload)
+            print(f"input: {rate} Hz, {channels} channels{', with reference' if reference else ''}")
+        first = time_us if first is None else min(first, time_us)
+        last = time_us if last is None else max(last, time_us)
+    if first is not None:
+        print(f"duration: {(last - first) / 1e6:.3f} s, {len(data)} bytes")
+    for name, (count, size) in sorted(counts.items()):
+        print(f"  {name:16} {count:8} records {size:10} bytes")
+    if dropped:
+        print(f"dropped on the device: {dropped} bytes")
+    return 0
+
+
+def synth(trace_path):
+    data = bytearray(FILE_HEADER.pack(MAGIC, VERSION, 0))
+
+    def record(record_type, time_us, payload):
+        data.extend(RECORD_HEADER.pack(record_type, 0, len(payload), time_us & 0xFFFFFFFF))
+        data.extend(payload)
+
+    frame_us = 60000
+    record(6, 0, struct.pack("<IHHI", 24000, 60, 0, 16000))
+    record(8, 0, bytes([6]))
+    arrivals = []
+    for sequence in range(120):
+        if sequence == 20:
+            continue  # lost
+        time_us = 200000 + sequence * frame_us + (sequence * 37 % 11) * 4000
+        if sequence == 31:
+            time_us -= 70000  # overtakes 30
+        if 70 <= sequence < 78:
+            time_us = 200000 + 78 * frame_us  # a stall, then a burst
+        if sequence == 50:
+            time_us += 600000  # too late to play
+        arrivals.append((time_us, sequence))
+        if sequence == 40:
+            arrivals.append((time_us + 3000, sequence))
+    for time_us, sequence in sorted(arrivals):
+        # TOC of a mono SILK narrowband 60 ms frame, with no frame data
+        record(7, time_us, struct.pack("<I", sequence) + bytes([0x18]))
+    end_us = max(time_us for time_us, _ in arrivals) + 2000000
+    record(8, end_us, bytes([5]))
+    with open(trace_path, "wb") as f:
+        f.write(data)
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Audio trace tools")
+    commands = parser.add_subparsers(dest="command", required=True)
+    extract_parser = commands.add_parser("extract", help="console capture to trace file")
+    extract_parser.add_argument("log")
+    extract_parser.add_argument("trace")
+    info_parser = commands.add_parser("info", help="summary of a trace file")
+    info_parser.add_argument("trace")
+    synth_parser = commands.add_parser("synth", help="write the synthetic trace of the host regression test")
+    synth_parser.add_argument("trace")
+    args = parser.parse_args()
+
+    if args.command == "extract":
+        return extract(args.log, args.trace)
+    if args.command == "synth":
+        return synth(args.trace)
+    return info(args.trace)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""
+Local WebSocket server for checking the uplink audio of the device.
+
+It answers the client hello, accepts the length prefixed packing when the device offers it,
+unpacks the binary messages and prints how many messages and bytes the uplink took,
+compared with sending one message per opus frame.
+
+    pip install websockets
+    python3 scripts/ws_test_server.py --port 8000 [--no-packing] [--read-delay-ms 30]
+
+Point the device to ws://<host>:8000/ (websocket url in the OTA config).
+--read-delay-ms slows down reading each message to emulate a congested link.
+--record-overhead adds a fixed cost per message to the byte counts, e.g. 29 for a TLS 1.2 AES-GCM record.
+"""
+import argparse
+import asyncio
+import json
+import struct
+import time
+
+import websockets
+
+
+def ws_frame_overhead(size):
+    # Client to server frames: 2 byte header, extended length, 4 byte mask
+    if size > 65535:
+        return 2 + 8 + 4
+    if size > 125:
+        return 2 + 2 + 4
+    return 2 + 4
+
+
+def unpack(message):
+    frames = []
+    offset = 0
+    while offset + 2 <= len(message):
+        (size,) = struct.unpack_from(">H", message, offset)
+        offset += 2
+        if offset + size > len(message):
+            raise ValueError("truncated frame at offset %d" % offset)
+        frames.append(message[offset:offset + size])
+        offset += size
+    if offset != len(message):
+        raise ValueError("trailing %d bytes" % (len(message) - offset))
+    return frames
+
+
+class Session:
+    def __init__(self, record_overhead):
+        self.record_overhead = record_overhead
+        self.messages = 0
+        self.frames = 0
+        self.opus_bytes = 0
+        self.wire_bytes = 0
+        self.unpacked_wire_bytes = 0
+        self.max_frames_per_message = 0
+        self.start = time.time()
+
+    def add(self, frames, message_size):
+        self.messages += 1
+        self.frames += len(frames)
+        self.max_frames_per_message = max(self.max_frames_per_message, len(frames))
+        self.wire_bytes += message_size + ws_frame_overhead(message_size) + self.record_overhead
+        for frame in frames:
+            self.opus_bytes += len(frame)
+            self.unpacked_wire_bytes += len(frame) + ws_frame_overhead(len(frame)) + self.record_overhead
+
+    def report(self, title):
+        if self.frames == 0:
+            return
+        print("[%s] %d frames in %d messages (max %d per message), %.1f s" % (
+            title, self.frames, self.messages, self.max_frames_per_message, time.time() - self.start))
+        print("    send calls: %d vs %d unpacked (-%.0f%%)" % (
+            self.messages, self.frames, 100.0 * (self.frames - self.messages) / self.frames))
+        print("    wire bytes: %d vs %d unpacked (-%.1f%%), opus payload %d bytes" % (
+            self.wire_bytes, self.unpacked_wire_bytes,
+            100.0 * (self.unpacked_wire_bytes - self.wire_bytes) / self.unpacked_wire_bytes, self.opus_bytes))
+
+
+async def handle(websocket, args):
+    packing = False
+    session = Session(args.record_overhead)
+    total = Session(args.record_overhead)
+    async for message in websocket:
+        if isinstance(message, str):
+            data = json.loads(message)
+            kind = data.get("type")
+            if kind == "hello":
+                params = data.get("audio_params", {})
+                packing = params.get("packing") == "length_prefixed" and not args.no_packing
+                reply = {
+                    "type": "hello",
+                    "transport": "websocket",
+                    "audio_params": {"sample_rate": 16000, "frame_duration": 60},
+                }
+                if args.uplink_frame_duration:
+                    reply["audio_params"]["uplink_frame_duration"] = args.uplink_frame_duration
+                if packing:
+                    reply["audio_params"]["packing"] = "length_prefixed"
+                print("hello: %s -> packing %s" % (json.dumps(params), "on" if packing else "off"))
+                await websocket.send(json.dumps(reply))
+            elif kind == "listen":
+                print("listen: %s" % data.get("state"))
+                if data.get("state") == "stop":
+                    session.report("turn")
+                    session = Session(args.record_overhead)
+            else:
+                print("%s: %s" % (kind, message[:200]))
+            continue
+
+        frames = unpack(message) if packing else [message]
+        session.add(frames, len(message))
+        total.add(frames, len(message))
+        if args.read_delay_ms > 0:
+            await asyncio.sleep(args.read_delay_ms / 1000.0)
+
+    session.report("turn")
+    total.report("connection")
+
+
+async def main():
+    parser = argparse.ArgumentParser(description="WebSocket uplink test server")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--no-packing", action="store_true", help="do not accept the packing offered by the device")
+    parser.add_argument("--uplink-frame-duration", type=int, choices=[10, 20, 40, 60], help="pick the uplink frame duration")
+    parser.add_argument("--read-delay-ms", type=int, default=0, help="delay after each binary message")
+    parser.add_argument("--record-overhead", type=int, default=0, help="bytes added per message below WebSocket, e.g. TLS")
+    args = parser.parse_args()
+
+    async with websockets.serve(lambda ws: handle(ws, args), args.host, args.port):
+        print("Listening on ws://%s:%d/" % (args.host, args.port))
+        await asyncio.Future()
+
+
+if __name__ == "__main__":
+    asyncio.run(main())